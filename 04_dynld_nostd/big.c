@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+// Program launched by the relocation order benchmark (see `reloc_bench.c`),
+// all the work is done by `dynld.so` when loading `libbig.so`.
+
+extern int big_fn_000();
+
+void _start() {
+    big_fn_000();
+}
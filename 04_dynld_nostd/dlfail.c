@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include <io.h>
+
+#include "dynld.h"
+
+#include <stdint.h>
+
+// API of `libgreet.so`.
+extern const char* get_greet();
+
+// Program of the `dlopen` error example. Objects which can't be loaded are
+// reported by `dlerror` and leave nothing loaded behind.
+
+static void try_dlopen(const char* file) {
+    void* handle = dlopen(file, RTLD_NOW);
+    pfmt("dlopen(%s) -> %s\n", file, handle ? "loaded" : dlerror());
+    if (handle) {
+        dlclose(handle);
+    }
+}
+
+void _start(const uint64_t* prctx) {
+    (void)prctx;
+    if (dlopen == 0) {
+        return;
+    }
+
+    // Dependency not found.
+    try_dlopen("libmissing.so");
+    // Undefined symbol.
+    try_dlopen("libundef.so");
+    // Not a shared library (the main program is not position independent).
+    try_dlopen("/proc/self/exe");
+
+    // The failed objects were removed from the link map again.
+    pfmt("libmissing.so loaded: %s\n", dlopen("libmissing.so", RTLD_NOLOAD) ? "yes" : "no");
+    pfmt("libundef.so loaded: %s\n", dlopen("libundef.so", RTLD_NOLOAD) ? "yes" : "no");
+
+    // The objects loaded before and loading work as before.
+    pfmt("get_greet() -> %s\n", get_greet());
+    void* plugin = dlopen("libplugin.so", RTLD_NOW);
+    const char* (*get_plugin_greet)() = plugin ? dlsym(plugin, "get_plugin_greet") : 0;
+    pfmt("get_plugin_greet() -> %s\n", get_plugin_greet ? get_plugin_greet() : dlerror());
+    if (plugin) {
+        dlclose(plugin);
+    }
+}
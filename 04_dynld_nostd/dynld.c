@@ -2,26 +2,109 @@
 //
 // Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
 
+#include <alloc.h>
 #include <auxv.h>
 #include <common.h>
 #include <elf.h>
+#include <fmt.h>
 #include <io.h>
 #include <syscalls.h>
 
+#include "dynld.h"
+#include "loader.h"
+#include "sdt.h"
+#include "zygote.h"
+
 #include <stdbool.h>
 #include <stdint.h>
 
 // {{{ Global constans
 
 enum {
-    // Hard-coded page size.
-    // We assert against the `AT_PAGESZ` auxiliary vector entry.
-    PAGE_SIZE = 4096,
-    // Hard-coded upper limit of `DT_NEEDED` entries per dso
-    // (for simplicity to not require allocations).
-    MAX_NEEDED = 1,
+    // Size of the `PROT_NONE` guard gap after each dependency in the region
+    // reserved for all dependencies.
+    GUARD_SIZE = PAGE_SIZE,
+    // Number of `io_uring` submission queue entries used to load dependencies.
+    URING_ENTRIES = 64,
+};
+
+// Place a function only run before the handoff to the user program into the
+// `dl_init_text` section, whose pages are released at the handoff (see
+// `reclaim`). Not inlined, such that its code doesn't end up in the callers
+// which stay resident (eg `dl_entry`).
+#define DL_INIT __attribute__((section("dl_init_text"), noinline))
+
+// }}}
+// {{{ String utilities
+
+static char* strdup(const char* str) {
+    const size_t len = strlen(str);
+    char* dup = alloc(len + 1);
+    memcpy(dup, str, len + 1);
+    return dup;
+}
+
+// }}}
+// {{{ Scratch Arena
+
+// Arena for the temporaries of loading objects, eg the headers and string
+// tables read from the files, the discovery state and the prelink cache and
+// direct binding files.
+//
+// Allocations are bumped from a single mapping and never freed individually.
+// The mapping is created by the first allocation in the outermost
+// `scratch_enter`/`scratch_leave` scope and unmapped when the scope is left,
+// that is at the handoff to the user program (see `dl_entry`) and at the end
+// of each `dl_load`. The bookkeeping needed at runtime (link map, handles,
+// ...) is allocated with `alloc` and must not point into the arena. This keeps
+// the `alloc` memory, which neither splits nor coalesces blocks, free of the
+// holes temporaries would leave.
+
+enum {
+    // Size of the address range reserved for the scratch arena (only the
+    // pages used get backed).
+    SCRATCH_SIZE = 64 * 1024 * 1024,
 };
 
+typedef struct {
+    uint8_t* base;   // Start of the arena mapping (0 if not mapped).
+    uint64_t top;    // Offset of the next allocation.
+    uint32_t depth;  // Nesting depth of `scratch_enter`.
+} Scratch;
+
+static Scratch gScratch;
+
+static void scratch_enter() {
+    gScratch.depth += 1;
+}
+
+// Leave the current scope, leaving the outermost scope releases all
+// allocations.
+static void scratch_leave() {
+    ERROR_ON(gScratch.depth == 0, "Unbalanced scratch_leave!");
+    gScratch.depth -= 1;
+    if (gScratch.depth == 0 && gScratch.base) {
+        munmap(gScratch.base, SCRATCH_SIZE);
+        gScratch.base = 0;
+        gScratch.top = 0;
+    }
+}
+
+// Allocate `size` bytes (16 byte aligned) valid until the outermost scope is
+// left.
+static void* scratch_alloc(uint64_t size) {
+    ERROR_ON(gScratch.depth == 0, "Scratch allocation outside of scratch_enter!");
+    if (gScratch.base == 0) {
+        gScratch.base = mmap(0 /* addr */, SCRATCH_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1 /* fd */,
+                             0 /* off */);
+        ERROR_ON(gScratch.base == MAP_FAILED, "Failed to map the scratch arena!");
+    }
+    ERROR_ON(size > SCRATCH_SIZE - gScratch.top, "Scratch arena OOM!");
+    void* ptr = gScratch.base + gScratch.top;
+    gScratch.top = align_up(gScratch.top + size, 16);
+    return ptr;
+}
+
 // }}}
 // {{{ SystemVDescriptor
 
@@ -31,12 +114,13 @@ typedef struct {
     uint64_t envc;              // Number of environment variables.
     const char** envv;          // List of pointers to environment variables.
     uint64_t auxv[AT_MAX_CNT];  // Auxiliary vector entries.
+    const Auxv64Entry* auxvv;   // List of all auxiliary vector entries.
 } SystemVDescriptor;
 
 // Interpret and extract data passed on the stack by the Linux Kernel
 // when loading the initial process image.
 // The data is organized according to the SystemV x86_64 ABI.
-static SystemVDescriptor get_systemv_descriptor(const uint64_t* prctx) {
+DL_INIT static SystemVDescriptor get_systemv_descriptor(const uint64_t* prctx) {
     SystemVDescriptor sysv = {0};
 
     sysv.argc = *prctx;
@@ -49,7 +133,8 @@ static SystemVDescriptor get_systemv_descriptor(const uint64_t* prctx) {
     }
 
     // Decode auxiliary vector `AUXV`.
-    for (const Auxv64Entry* auxvp = (const Auxv64Entry*)(sysv.envv + sysv.envc + 1); auxvp->tag != AT_NULL; ++auxvp) {
+    sysv.auxvv = (const Auxv64Entry*)(sysv.envv + sysv.envc + 1);
+    for (const Auxv64Entry* auxvp = sysv.auxvv; auxvp->tag != AT_NULL; ++auxvp) {
         if (auxvp->tag < AT_MAX_CNT) {
             sysv.auxv[auxvp->tag] = auxvp->val;
         }
@@ -58,43 +143,33 @@ static SystemVDescriptor get_systemv_descriptor(const uint64_t* prctx) {
     return sysv;
 }
 
-// }}}
-// {{{ Dso
-
-typedef struct {
-    uint8_t* base;                 // Base address.
-    void (*entry)();               // Entry function.
-    uint64_t dynamic[DT_MAX_CNT];  // `.dynamic` section entries.
-    uint64_t needed[MAX_NEEDED];   // Shared object dependencies (`DT_NEEDED` entries).
-    uint32_t needed_len;           // Number of `DT_NEEDED` entries (SO dependencies).
-} Dso;
-
-static void decode_dynamic(Dso* dso, uint64_t dynoff) {
-    // Decode `.dynamic` section of the `dso`.
-    for (const Elf64Dyn* dyn = (const Elf64Dyn*)(dso->base + dynoff); dyn->tag != DT_NULL; ++dyn) {
-        if (dyn->tag == DT_NEEDED) {
-            ERROR_ON(dso->needed_len == MAX_NEEDED, "Too many dso dependencies!");
-            dso->needed[dso->needed_len++] = dyn->val;
-        } else if (dyn->tag < DT_MAX_CNT) {
-            dso->dynamic[dyn->tag] = dyn->val;
+// Get the value of the environment variable `name` or `0` if it is not set.
+static const char* get_env(const SystemVDescriptor* sysv, const char* name) {
+    for (uint64_t i = 0; i < sysv->envc; ++i) {
+        const char* env = sysv->envv[i];
+        const char* n = name;
+        while (*n && *n == *env) {
+            ++n;
+            ++env;
+        }
+        if (*n == '\0' && *env == '=') {
+            return env + 1;
         }
     }
+    return 0;
+}
 
-    // Check for string table entries.
-    ERROR_ON(dso->dynamic[DT_STRTAB] == 0, "DT_STRTAB missing in dynamic section!");
-    ERROR_ON(dso->dynamic[DT_STRSZ] == 0, "DT_STRSZ missing in dynamic section!");
+// }}}
+// {{{ Loader
 
-    // Check for symbol table entries.
-    ERROR_ON(dso->dynamic[DT_SYMTAB] == 0, "DT_SYMTAB missing in dynamic section!");
-    ERROR_ON(dso->dynamic[DT_SYMENT] == 0, "DT_SYMENT missing in dynamic section!");
-    ERROR_ON(dso->dynamic[DT_SYMENT] != sizeof(Elf64Sym), "ELf64Sym size miss-match!");
+// Loader context of the process (see `loader.h`), holds the CPU features
+// passed to IFUNC resolvers and the interned symbol versions.
+static Loader gLoader;
 
-    // Check for SystemV hash table. We only support SystemV hash tables
-    // `DT_HASH`, not gnu hash tables `DT_GNU_HASH`.
-    ERROR_ON(dso->dynamic[DT_HASH] == 0, "DT_HASH missing in dynamic section!");
-}
+// }}}
+// {{{ Dso
 
-static Dso get_prog_dso(const SystemVDescriptor* sysv) {
+DL_INIT static Dso get_prog_dso(const SystemVDescriptor* sysv) {
     Dso prog = {0};
 
     // Determine the base address of the user program.
@@ -133,6 +208,9 @@ static Dso get_prog_dso(const SystemVDescriptor* sysv) {
 
     ERROR_ON(sysv->auxv[AT_PHENT] != sizeof(Elf64Phdr), "Elf64Phdr size miss-match!");
 
+    prog.phdr = phdr;
+    prog.phnum = sysv->auxv[AT_PHNUM];
+
     // Decode PHDRs of the user program.
     for (unsigned phdrnum = sysv->auxv[AT_PHNUM]; --phdrnum; ++phdr) {
         if (phdr->type == PT_PHDR) {
@@ -141,13 +219,11 @@ static Dso get_prog_dso(const SystemVDescriptor* sysv) {
         } else if (phdr->type == PT_DYNAMIC) {
             dynoff = phdr->vaddr;
         }
-
-        ERROR_ON(phdr->type == PT_TLS, "Thread local storage not supported found PT_TLS!");
     }
     ERROR_ON(dynoff == 0, "PT_DYNAMIC entry missing in the user programs PHDR!");
 
     // Decode `.dynamic` section.
-    decode_dynamic(&prog, dynoff);
+    decode_dynamic(&gLoader, &prog, dynoff);
 
     // Get the entrypoint of the user program form the auxiliary vector.
     ERROR_ON(sysv->auxv[AT_ENTRY] == 0, "AT_ENTRY entry missing in the AUXV!");
@@ -156,51 +232,13 @@ static Dso get_prog_dso(const SystemVDescriptor* sysv) {
     return prog;
 }
 
-static uint64_t get_num_dynsyms(const Dso* dso) {
-    ERROR_ON(dso->dynamic[DT_HASH] == 0, "DT_HASH missing in dynamic section!");
-
-    // Get SystemV hash table.
-    const uint32_t* hashtab = (const uint32_t*)(dso->base + dso->dynamic[DT_HASH]);
-
-    // SystemV hash table layout:
-    //   nbucket
-    //   nchain
-    //   bucket[nbuckets]
-    //   chain[nchains]
-    //
-    // From the SystemV ABI - Dynamic Linking - Hash Table:
-    //   Both `bucket` and `chain` hold symbol table indexes. Chain
-    //   table entries parallel the symbol table. The number of symbol
-    //   table entries should equal `nchain`.
-    return hashtab[1];
-}
-
-static const char* get_str(const Dso* dso, uint64_t idx) {
-    ERROR_ON(dso->dynamic[DT_STRSZ] < idx, "String table indexed out-of-bounds!");
-    return (const char*)(dso->base + dso->dynamic[DT_STRTAB] + idx);
-}
-
-static const Elf64Sym* get_sym(const Dso* dso, uint64_t idx) {
-    ERROR_ON(get_num_dynsyms(dso) < idx, "Symbol table index out-of-bounds!");
-    return (const Elf64Sym*)(dso->base + dso->dynamic[DT_SYMTAB]) + idx;
-}
-
-static const Elf64Rela* get_pltreloca(const Dso* dso, uint64_t idx) {
-    ERROR_ON(dso->dynamic[DT_PLTRELSZ] < sizeof(Elf64Rela) * idx, "PLT relocation table indexed out-of-bounds!");
-    return (const Elf64Rela*)(dso->base + dso->dynamic[DT_JMPREL]) + idx;
-}
-
-static const Elf64Rela* get_reloca(const Dso* dso, uint64_t idx) {
-    ERROR_ON(dso->dynamic[DT_RELASZ] < sizeof(Elf64Rela) * idx, "RELA relocation table indexed out-of-bounds!");
-    return (const Elf64Rela*)(dso->base + dso->dynamic[DT_RELA]) + idx;
-}
-
 // }}}
 // {{{ Init & Fini
 
 typedef void (*initfptr)();
 
 static void init(const Dso* dso) {
+    DYNLD_PROBE2(init_start, dso->name, dso->base);
     if (dso->dynamic[DT_INIT]) {
         initfptr* fn = (initfptr*)(dso->base + dso->dynamic[DT_INIT]);
         (*fn)();
@@ -211,11 +249,13 @@ static void init(const Dso* dso) {
     while (nfns--) {
         (*fns++)();
     }
+    DYNLD_PROBE2(init_end, dso->name, dso->base);
 }
 
 typedef void (*finifptr)();
 
 static void fini(const Dso* dso) {
+    DYNLD_PROBE2(fini_start, dso->name, dso->base);
     size_t nfns = dso->dynamic[DT_FINI_ARRAYSZ] / sizeof(finifptr);
     finifptr* fns = (finifptr*)(dso->base + dso->dynamic[DT_FINI_ARRAY]) + nfns /* reverse destruction order */;
     while (nfns--) {
@@ -226,409 +266,4366 @@ static void fini(const Dso* dso) {
         finifptr* fn = (finifptr*)(dso->base + dso->dynamic[DT_FINI]);
         (*fn)();
     }
+    DYNLD_PROBE2(fini_end, dso->name, dso->base);
 }
 
 // }}}
-// {{{ Symbol lookup
+// {{{ vDSO
+
+// The vDSO is a shared library mapped by the Kernel into each process (see
+// vdso(7)), it provides eg `__vdso_clock_gettime` without entering the
+// Kernel.
+//
+// It is already mapped and relocated, hence it is only decoded in-memory as a
+// `Dso`. Its symbols are searched after all objects of the link map.
+static Dso gVdso;
+
+// Decode the vDSO at the `AT_SYSINFO_EHDR` auxiliary vector entry into
+// `gVdso`, `gVdso.base` stays 0 if the Kernel doesn't provide a vDSO.
+DL_INIT static void vdso_init(const SystemVDescriptor* sysv) {
+    const uint8_t* ehdr_addr = (const uint8_t*)sysv->auxv[AT_SYSINFO_EHDR];
+    if (ehdr_addr == 0) {
+        return;
+    }
+    const Elf64Ehdr* ehdr = (const Elf64Ehdr*)ehdr_addr;
+    ERROR_ON(ehdr->phentsize != sizeof(Elf64Phdr), "Elf64Phdr size miss-match!");
 
-static inline int strcmp(const char* s1, const char* s2) {
-    while (*s1 == *s2 && *s1) {
-        ++s1;
-        ++s2;
+    // The base address is computed from the first `PT_LOAD` segment, which
+    // maps the ELF header.
+    const Elf64Phdr* phdr = (const Elf64Phdr*)(ehdr_addr + ehdr->phoff);
+    uint8_t* base = 0;
+    uint64_t dynoff = 0;
+    for (unsigned i = 0; i < ehdr->phnum; ++i) {
+        if (phdr[i].type == PT_LOAD && base == 0) {
+            base = (uint8_t*)ehdr_addr + phdr[i].offset - phdr[i].vaddr;
+        } else if (phdr[i].type == PT_DYNAMIC) {
+            dynoff = phdr[i].vaddr;
+        }
     }
-    return *(unsigned char*)s1 - *(unsigned char*)s2;
+    ERROR_ON(base == 0 || dynoff == 0, "vDSO without PT_LOAD or PT_DYNAMIC segment!");
+
+    gVdso.base = base;
+    gVdso.phdr = phdr;
+    gVdso.phnum = ehdr->phnum;
+    gVdso.name = "linux-vdso.so.1";
+    decode_dynamic(&gLoader, &gVdso, dynoff);
+}
+
+// Lookup `symname` in the vDSO.
+static void* lookup_vdso(const char* symname) {
+    return gVdso.base ? lookup_sym(&gLoader, &gVdso, symname, 0 /* ver */) : 0;
 }
 
-// Perform naive lookup for global symbol and return address if symbol was found.
+// }}}
+// {{{ Library Search
+
+// Search paths of an object requesting dependencies.
+typedef struct {
+    const char* origin;   // Directory of the requesting object, substituted for `$ORIGIN` (allocated).
+    const char* rpath;    // `DT_RPATH` of the requesting object (0 if none).
+    const char* runpath;  // `DT_RUNPATH` of the requesting object (0 if none).
+} SearchPath;
+
+// Index of the entries of a library search directory.
 //
-// For simplicity this lookup doesn't use the hash table (`DT_HASH` |
-// `DT_GNU_HASH`) but rather iterates of the dynamic symbol table. Using the
-// hash table doesn't change the lookup result, however it yields better
-// performance for large symbol tables.
+// Each search directory is read once with `getdents64` and the names of its
+// entries are stored in a hash table. Finding a library in a directory is then
+// a lookup in memory instead of a failing `open` syscall for each search
+// directory that doesn't contain the library.
 //
-// `dso`          A handle to the dso which dynamic symbol table should be searched.
-// `symname`     Name of the symbol to look up.
-static void* lookup_sym(const Dso* dso, const char* symname) {
-    for (unsigned i = 0; i < get_num_dynsyms(dso); ++i) {
-        const Elf64Sym* sym = get_sym(dso, i);
+// Directories may change while the program runs. Each `dlopen` starts a new
+// epoch, the first lookup in a directory in an epoch compares the
+// modification and status change time of the directory with the ones recorded
+// when it was read, and reads it again only if they differ. An index read in
+// the same second the directory was changed is read again in the next epoch,
+// as a later change in that second may not change the timestamps.
+typedef struct {
+    const char* path;     // Path of the directory (allocated).
+    char* names;          // Names of the directory entries, each `\0` terminated (allocated).
+    uint32_t* buckets;    // Hash table of offsets + 1 into `names`, `0` marks an empty bucket (allocated).
+    uint32_t nbuckets;    // Number of buckets (power of two).
+    bool has_hwcaps;      // Directory contains a `glibc-hwcaps` entry.
+    bool exists;          // Directory could be opened when it was read.
+    bool racy;            // Directory was changed in the second it was read.
+    uint32_t epoch;       // Epoch the index was last validated in (see `gDirIndexEpoch`).
+    long mtime_sec;       // Modification time of the directory when it was read.
+    long mtime_nsec;
+    long ctime_sec;       // Status change time of the directory when it was read.
+    long ctime_nsec;
+} DirIndex;
 
-        if ((ELF64_ST_TYPE(sym->info) == STT_OBJECT || ELF64_ST_TYPE(sym->info) == STT_FUNC) && ELF64_ST_BIND(sym->info) == STB_GLOBAL &&
-            sym->shndx != SHN_UNDEF) {
-            if (strcmp(symname, get_str(dso, sym->name)) == 0) {
-                return dso->base + sym->value;
-            }
+// Cache of directory indices, each search directory is only read again if it
+// changed.
+static DirIndex* gDirIndex;
+static uint32_t gDirIndexLen;
+static uint32_t gDirIndexCap;
+static uint32_t gDirIndexEpoch;
+
+// Default library search path used after `LD_LIBRARY_PATH` and `DT_RUNPATH`.
+#define DEFAULT_LIBRARY_PATH "/lib/x86_64-linux-gnu:/usr/lib/x86_64-linux-gnu:/lib64:/usr/lib64:/lib:/usr/lib"
+
+// SystemV ABI hash function, also used for the `DT_HASH` table.
+static uint32_t elf_hash(const char* name) {
+    uint32_t h = 0;
+    while (*name) {
+        h = (h << 4) + (unsigned char)*name++;
+        const uint32_t g = h & 0xf0000000;
+        if (g) {
+            h ^= g >> 24;
         }
+        h &= ~g;
     }
-    return 0;
+    return h;
 }
 
-// }}}
-// {{{ Map Shared Library Dependency
+static bool dir_index_contains(const DirIndex* dir, const char* name) {
+    if (dir->nbuckets == 0) {
+        return false;
+    }
+    for (uint32_t b = elf_hash(name) & (dir->nbuckets - 1); dir->buckets[b]; b = (b + 1) & (dir->nbuckets - 1)) {
+        if (strcmp(dir->names + dir->buckets[b] - 1, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
-static Dso map_dependency(const char* dependency) {
-    // For simplicity we only search for SO dependencies in the current working dir.
-    // So no support for DT_RPATH/DT_RUNPATH and LD_LIBRARY_PATH.
-    ERROR_ON(access(dependency, R_OK) != 0, "Dependency '%s' does not exist!\n", dependency);
-
-    const int fd = open(dependency, O_RDONLY);
-    ERROR_ON(fd < 0, "Failed to open '%s'", dependency);
-
-    Elf64Ehdr ehdr;
-    // Read ELF header.
-    ERROR_ON(read(fd, &ehdr, sizeof(ehdr)) != (ssize_t)sizeof(ehdr), "Failed to read Elf64Ehdr!");
-
-    // Check ELF magic.
-    ERROR_ON(ehdr.ident[EI_MAG0] != '\x7f' || ehdr.ident[EI_MAG1] != 'E' || ehdr.ident[EI_MAG2] != 'L' || ehdr.ident[EI_MAG3] != 'F',
-             "Dependency '%s' wrong ELF magic value!\n", dependency);
-    // Check ELF header size.
-    ERROR_ON(ehdr.ehsize != sizeof(ehdr), "Elf64Ehdr size miss-match!");
-    // Check for 64bit ELF.
-    ERROR_ON(ehdr.ident[EI_CLASS] != ELFCLASS64, "Dependency '%s' is not 64bit ELF!\n", dependency);
-    // Check for OS ABI.
-    ERROR_ON(ehdr.ident[EI_OSABI] != ELFOSABI_SYSV, "Dependency '%s' is not built for SysV OS ABI!\n", dependency);
-    // Check ELF type.
-    ERROR_ON(ehdr.type != ET_DYN, "Dependency '%s' is not a dynamic library!");
-    // Check for Phdr.
-    ERROR_ON(ehdr.phnum == 0, "Dependency '%s' has no Phdr!\n", dependency);
-
-
-    Elf64Phdr phdr[ehdr.phnum];
-    // Check PHDR header size.
-    ERROR_ON(ehdr.phentsize != sizeof(phdr[0]), "Elf64Phdr size miss-match!");
-
-    // Read Program headers at offset `phoff`.
-    ERROR_ON(pread(fd, &phdr, sizeof(phdr), ehdr.phoff) != (ssize_t)sizeof(phdr), "Failed to read Elf64Phdr[%d]!\n", ehdr.phnum);
-
-    // Compute start and end address used by the library based on the all the `PT_LOAD` program headers.
-    uint64_t dynoff = 0;
-    uint64_t addr_start = (uint64_t)-1;
-    uint64_t addr_end = 0;
-    for (unsigned i = 0; i < ehdr.phnum; ++i) {
-        const Elf64Phdr* p = &phdr[i];
-        if (p->type == PT_DYNAMIC) {
-            // Offset to `.dynamic` section.
-            dynoff = p->vaddr;
-        } else if (p->type == PT_LOAD) {
-            // Find start & end address.
-            if (p->vaddr < addr_start) {
-                addr_start = p->vaddr;
-            } else if (p->vaddr + p->memsz > addr_end) {
-                addr_end = p->vaddr + p->memsz;
-            }
-        }
-
-        ERROR_ON(phdr->type == PT_TLS, "Thread local storage not supported found PT_TLS!");
-    }
-
-    // Align start address to the next lower page boundary.
-    addr_start = addr_start & ~(PAGE_SIZE - 1);
-    // Align end address to the next higher page boundary.
-    addr_end = (addr_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
-
-    // Reserve region big enough to map all `PT_LOAD` sections of `dependency`.
-    uint8_t* map = mmap(0 /* addr */, addr_end - addr_start /* len */, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
-                        -1 /* fd */, 0 /* file offset */);
-    ERROR_ON(map == MAP_FAILED, "Failed to mmap address space for dependency '%s'\n", dependency);
-
-    // Compute base address for library.
-    uint8_t* base = map - addr_start;
-
-    // Map in all `PT_LOAD` segments from the `dependency`.
-    for (unsigned i = 0; i < ehdr.phnum; ++i) {
-        const Elf64Phdr* p = &phdr[i];
-        if (p->type != PT_LOAD) {
-            continue;
+// Check if the directory of the index `dir` is unchanged since it was read.
+static bool dir_index_valid(const DirIndex* dir) {
+    const int fd = open(dir->path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return !dir->exists;
+    }
+    struct stat st;
+    const bool ok = fstat(fd, &st) == 0;
+    close(fd);
+    return ok && dir->exists && !dir->racy && st.st_mtime_sec == dir->mtime_sec && st.st_mtime_nsec == dir->mtime_nsec &&
+           st.st_ctime_sec == dir->ctime_sec && st.st_ctime_nsec == dir->ctime_nsec;
+}
+
+static void dir_index_build(DirIndex* dir) {
+    const int fd = open(dir->path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        // Non existing search directories are fine, the index just stays empty.
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        dir->exists = true;
+        dir->racy = st.st_mtime_sec >= now.tv_sec || st.st_ctime_sec >= now.tv_sec;
+        dir->mtime_sec = st.st_mtime_sec;
+        dir->mtime_nsec = st.st_mtime_nsec;
+        dir->ctime_sec = st.st_ctime_sec;
+        dir->ctime_nsec = st.st_ctime_nsec;
+    }
+
+    // Collect names of all entries which could be a shared library, that is
+    // everything but directories. Symbolic links and entries of unknown type
+    // are kept, they may point to a library.
+    uint32_t len = 0;
+    uint32_t cap = PAGE_SIZE;
+    uint32_t cnt = 0;
+    char* names = alloc(cap);
+
+    uint8_t buf[PAGE_SIZE];
+    ssize_t ret;
+    while ((ret = getdents64(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t off = 0; off < ret;) {
+            const struct dirent64* d = (const struct dirent64*)(buf + off);
+            off += d->d_reclen;
+
+            if (strcmp(d->d_name, "glibc-hwcaps") == 0) {
+                dir->has_hwcaps = true;
+                continue;
+            }
+
+            if (d->d_type == DT_DIR) {
+                continue;
+            }
+
+            const uint32_t nlen = strlen(d->d_name) + 1;
+            if (len + nlen > cap) {
+                char* grown = alloc(cap * 2);
+                memcpy(grown, names, len);
+                dealloc(names);
+                names = grown;
+                cap *= 2;
+            }
+            memcpy(names + len, d->d_name, nlen);
+            len += nlen;
+            cnt += 1;
         }
+    }
+    close(fd);
+
+    // Build hash table with a load factor <= 0.5.
+    uint32_t nbuckets = 8;
+    while (nbuckets < 2 * cnt) {
+        nbuckets *= 2;
+    }
+    uint32_t* buckets = alloc(sizeof(uint32_t) * nbuckets);
+    memset(buckets, 0, sizeof(uint32_t) * nbuckets);
 
-        // Page align start & end address.
-        uint64_t addr_start = p->vaddr & ~(PAGE_SIZE - 1);
-        uint64_t addr_end = (p->vaddr + p->memsz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    for (uint32_t off = 0; off < len; off += strlen(names + off) + 1) {
+        uint32_t b = elf_hash(names + off) & (nbuckets - 1);
+        while (buckets[b]) {
+            b = (b + 1) & (nbuckets - 1);
+        }
+        buckets[b] = off + 1;
+    }
 
-        // Page align file offset.
-        uint64_t off = p->offset & ~(PAGE_SIZE - 1);
+    dir->names = names;
+    dir->buckets = buckets;
+    dir->nbuckets = nbuckets;
+}
 
-        // Compute segment permissions.
-        uint32_t prot = (p->flags & PF_X ? PROT_EXEC : 0) | (p->flags & PF_R ? PROT_READ : 0) | (p->flags & PF_W ? PROT_WRITE : 0);
+// Release the entries of the index `dir`, keeping its path.
+static void dir_index_clear(DirIndex* dir) {
+    if (dir->names) {
+        dealloc(dir->names);
+        dealloc(dir->buckets);
+    }
+    *dir = (DirIndex){.path = dir->path};
+}
 
-        // Mmap segment.
-        ERROR_ON(mmap(base + addr_start, addr_end - addr_start, prot, MAP_PRIVATE | MAP_FIXED, fd, off) != base + addr_start,
-                 "Failed to map `PT_LOAD` section %d for dependency '%s'.", i, dependency);
+// Get the index of the directory `path` of length `len`, read the directory
+// if it is not cached yet or changed since it was read.
+static const DirIndex* get_dir_index(const char* path, size_t len) {
+    for (uint32_t i = 0; i < gDirIndexLen; ++i) {
+        DirIndex* dir = &gDirIndex[i];
+        if (strlen(dir->path) != len || memcmp(dir->path, path, len) != 0) {
+            continue;
+        }
+        if (dir->epoch != gDirIndexEpoch) {
+            if (!dir_index_valid(dir)) {
+                dir_index_clear(dir);
+                dir_index_build(dir);
+            }
+            dir->epoch = gDirIndexEpoch;
+        }
+        return dir;
+    }
 
-        // From the SystemV ABI - Program Headers:
-        //   If the segment’s memorysize (memsz) is larger than the file size (filesz), the "extra" bytes are defined to hold the value
-        //   `0` and to follow the segment’s initialized are
-        //
-        // This is typically used by the `.bss` section.
-        if (p->memsz > p->filesz) {
-            memset(base + p->vaddr + p->filesz, 0 /* byte */, p->memsz - p->filesz /*len*/);
+    if (gDirIndexLen == gDirIndexCap) {
+        const uint32_t cap = gDirIndexCap ? gDirIndexCap * 2 : 16;
+        DirIndex* grown = alloc(sizeof(DirIndex) * cap);
+        if (gDirIndex) {
+            memcpy(grown, gDirIndex, sizeof(DirIndex) * gDirIndexLen);
+            dealloc(gDirIndex);
         }
+        gDirIndex = grown;
+        gDirIndexCap = cap;
     }
 
-    // Close file descriptor.
-    close(fd);
+    DirIndex* dir = &gDirIndex[gDirIndexLen++];
+    *dir = (DirIndex){0};
 
-    Dso dso = {0};
-    dso.base = base;
-    decode_dynamic(&dso, dynoff);
-    return dso;
+    char* dir_path = alloc(len + 1);
+    memcpy(dir_path, path, len);
+    dir_path[len] = '\0';
+    dir->path = dir_path;
+    dir->epoch = gDirIndexEpoch;
+
+    dir_index_build(dir);
+    return dir;
 }
 
-// }}}
-// {{{ Resolve relocations
+// Start a new epoch, the cached directory indices are validated again when
+// searched the next time.
+static void dir_index_invalidate() {
+    gDirIndexEpoch += 1;
+}
 
-typedef struct LinkMap {
-    const Dso* dso;              // Pointer to Dso list object.
-    const struct LinkMap* next;  // Pointer to next LinkMap entry ('0' terminates the list).
-} LinkMap;
+// Get the path of the library `name` in the directory `dir` of length
+// `dir_len` (allocated) or `0` if the directory doesn't contain it.
+static const char* dir_lookup(const char* dir, size_t dir_len, const char* name) {
+    if (!dir_index_contains(get_dir_index(dir, dir_len), name)) {
+        return 0;
+    }
+    const size_t name_len = strlen(name);
+    char* path = alloc(dir_len + 1 + name_len + 1);
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, name, name_len + 1);
+    return path;
+}
 
-// Resolve a single relocation of `dso`.
+// Search the library `name` in the colon separated list of directories
+// `dirs` and return the path of the library or `0` if not found.
 //
-// Resolve the relocation `reloc` by looking up the address of the symbol
-// referenced by the relocation. If the address of the symbol was found the
-// relocation is patched, if the address was not found the process exits.
-static void resolve_reloc(const Dso* dso, const LinkMap* map, const Elf64Rela* reloc) {
-    // Get symbol referenced by relocation.
-    const int symidx = ELF64_R_SYM(reloc->info);
-    const Elf64Sym* sym = get_sym(dso, symidx);
-    const char* symname = get_str(dso, sym->name);
+// The token `$ORIGIN` (or `${ORIGIN}`) at the beginning of a directory is
+// replaced by `origin`. An empty directory denotes the current working
+// directory.
+//
+// Library variants built for a higher x86-64 micro-architecture level are
+// preferred (glibc-hwcaps layout):
+//   <dir>/glibc-hwcaps/x86-64-v4/  (if supported by the CPU)
+//   <dir>/glibc-hwcaps/x86-64-v3/
+//   <dir>/glibc-hwcaps/x86-64-v2/
+//   <dir>/
+// The subdirectories are only searched if the index of `<dir>` has a
+// `glibc-hwcaps` entry, hence they don't cost any syscall otherwise.
+static const char* search_dirs(const char* name, const char* dirs, const char* origin) {
+    if (dirs == 0) {
+        return 0;
+    }
 
-    // Get relocation type.
-    const unsigned reloctype = ELF64_R_TYPE(reloc->info);
+    while (true) {
+        const char* end = dirs;
+        while (*end && *end != ':') {
+            ++end;
+        }
 
-    // Find symbol address.
-    void* symaddr = 0;
-    // FIXME: Should relocations of type `R_X86_64_64` only be looked up in `dso` directly?
-    if (reloctype == R_X86_64_RELATIVE) {
-        // Symbols address is computed by re-basing the relative address based
-        // on the DSOs base address.
-        symaddr = (void*)(dso->base + reloc->addend);
-    } else {
-        // Special handling of `R_X86_64_COPY` relocations.
-        //
-        // The `R_X86_64_COPY` relocation type is used in the main program when
-        // it references an object provided by a shared library (eg extern
-        // declared variable).
-        // The static linker will still allocate storage for the external
-        // object in the main programs `.bss` section and any reference to the
-        // object from the main program are resolved by the static linker to
-        // the location in the `.bss` section directly (relative addressing).
-        // During runtime, when resolving the `R_X86_64_COPY` relocation, the
-        // dynamic linker will copy the initial value from the shared library
-        // that actually provides the objects symbol into the location of the
-        // main program. References to the object by other shared library are
-        // resolved to the location in the main programs `.bss` section.
-        //
-        // LinkMap:        Relocs:
-        //
-        // main program    { sym: foo, type: R_X86_64_COPY }
-        //      |
-        //      v
-        //    libso        { sym: foo, type: R_X86_64_GLOB_DAT }
-        //                 // Also `foo` is defined in `libso`.
-        //
-        //                                         libso
-        //                                         +-----------+
-        //                                         | .text     |
-        //       main prog                         |           |  ref
-        //       +-----------+                     | ... [foo] |--+
-        //       | .text     |   R_X86_64_GLOB_DAT |           |  |
-        //  ref  |           |   Patch address of  +-----------+  |
-        //    +--| ... [foo] |   foo in .got.      | .got      |  |
-        //    |  |           | +------------------>| foo:      |<-+
-        //    |  +-----------+ |                   |           |
-        //    |  | .bss      | |                   +-----------+
-        //    |  |           | /                   | .data     |
-        //    +->| foo: ...  |<--------------------| foo: ...  |
-        //       |           | R_X86_64_COPY       |           |
-        //       +-----------+ Copy initial value. +-----------+
-        //
-        // The handling of `R_X86_64_COPY` relocation assumes that the main
-        // program is always the first entry in the link map.
-        for (const LinkMap* lmap = (reloctype == R_X86_64_COPY ? map->next : map); lmap && symaddr == 0; lmap = lmap->next) {
-            symaddr = lookup_sym(lmap->dso, symname);
-        }
-    }
-    ERROR_ON(symaddr == 0, "Failed lookup symbol %s while resolving relocations!", symname);
-
-    pfmt("Resolved reloc %s to %p (base %p)\n", reloctype == R_X86_64_RELATIVE ? "<relative>" : symname, symaddr, dso->base);
-
-    // Perform relocation according to relocation type.
-    switch (reloctype) {
-        case R_X86_64_GLOB_DAT:  /* GOT entry for data objects. */
-        case R_X86_64_JUMP_SLOT: /* PLT entry. */
-        case R_X86_64_64:        /* 64bit relocation (non-lazy). */
-        case R_X86_64_RELATIVE:  /* DSO base relative relocation. */
-            // Patch storage unit of relocation with absolute address of the symbol.
-            *(uint64_t*)(dso->base + reloc->offset) = (uint64_t)symaddr;
-            break;
-        case R_X86_64_COPY: /* Reference to global variable in shared ELF file. */
-            // Copy initial value of variable into relocation address.
-            memcpy(dso->base + reloc->offset, (void*)symaddr, sym->size);
-            break;
-        default:
-            ERROR_ON(true, "Unsupported relocation type %d!\n", reloctype);
+        // Expand `$ORIGIN`.
+        const char* dir = dirs;
+        size_t dir_len = end - dirs;
+        const char* suffix = 0;
+        if (dir_len >= 7 && memcmp(dir, "$ORIGIN", 7) == 0) {
+            suffix = dir + 7;
+        } else if (dir_len >= 9 && memcmp(dir, "${ORIGIN}", 9) == 0) {
+            suffix = dir + 9;
+        }
+        char expanded[origin ? strlen(origin) + dir_len + 1 : 1];
+        if (suffix && origin) {
+            const size_t origin_len = strlen(origin);
+            memcpy(expanded, origin, origin_len);
+            memcpy(expanded + origin_len, suffix, end - suffix);
+            dir = expanded;
+            dir_len = origin_len + (end - suffix);
+        } else if (dir_len == 0) {
+            dir = ".";
+            dir_len = 1;
+        }
+
+        if (get_dir_index(dir, dir_len)->has_hwcaps) {
+            const char hwcaps[] = "/glibc-hwcaps/x86-64-v";
+            char sub[dir_len + sizeof(hwcaps) + 1];
+            memcpy(sub, dir, dir_len);
+            memcpy(sub + dir_len, hwcaps, sizeof(hwcaps) - 1);
+            const size_t sub_len = dir_len + sizeof(hwcaps);
+            for (uint32_t level = gLoader.cpu.level; level >= 2; --level) {
+                sub[sub_len - 1] = '0' + level;
+                const char* path = dir_lookup(sub, sub_len, name);
+                if (path) {
+                    return path;
+                }
+            }
+        }
+
+        const char* path = dir_lookup(dir, dir_len, name);
+        if (path) {
+            return path;
+        }
+
+        if (*end == '\0') {
+            return 0;
+        }
+        dirs = end + 1;
     }
 }
 
-// Resolve all relocations of `dso`.
+// Find the library `name` requested by an object with the search paths `sp`.
 //
-// Resolve relocations from the PLT & RELA tables. Use `map` as link map which
-// defines the order of the symbol lookup.
-static void resolve_relocs(const Dso* dso, const LinkMap* map) {
-    // Resolve all relocation from the RELA table found in `dso`. There is
-    // typically one relocation per undefined dynamic object symbol (eg global
-    // variables).
-    for (unsigned long relocidx = 0; relocidx < (dso->dynamic[DT_RELASZ] / sizeof(Elf64Rela)); ++relocidx) {
-        const Elf64Rela* reloc = get_reloca(dso, relocidx);
-        resolve_reloc(dso, map, reloc);
+// Names containing a `/` are used as path directly. Otherwise the directories
+// are searched in the following order:
+//   1. `DT_RPATH` of the requesting object (only if it has no `DT_RUNPATH`).
+//   2. `LD_LIBRARY_PATH` environment variable.
+//   3. `DT_RUNPATH` of the requesting object.
+//   4. Default system library directories.
+static const char* find_library(const char* name, const SearchPath* sp, const char* ld_library_path) {
+    for (const char* c = name; *c; ++c) {
+        if (*c == '/') {
+            return name;
+        }
     }
 
-    // Resolve all relocation from the PLT jump table found in `dso`. There is
-    // typically one relocation per undefined dynamic function symbol.
-    for (unsigned long relocidx = 0; relocidx < (dso->dynamic[DT_PLTRELSZ] / sizeof(Elf64Rela)); ++relocidx) {
-        const Elf64Rela* reloc = get_pltreloca(dso, relocidx);
-        resolve_reloc(dso, map, reloc);
+    const char* path = 0;
+    if (sp->runpath == 0) {
+        path = search_dirs(name, sp->rpath, sp->origin);
+    }
+    if (path == 0) {
+        path = search_dirs(name, ld_library_path, sp->origin);
+    }
+    if (path == 0) {
+        path = search_dirs(name, sp->runpath, sp->origin);
+    }
+    if (path == 0) {
+        path = search_dirs(name, DEFAULT_LIBRARY_PATH, sp->origin);
+    }
+    return path;
+}
+
+// Get the directory part of `path` (allocated).
+static const char* dirname(const char* path) {
+    size_t len = 0;
+    for (size_t i = 0; path[i]; ++i) {
+        if (path[i] == '/') {
+            len = i;
+        }
+    }
+    if (len == 0) {
+        return path[0] == '/' ? strdup("/") : strdup(".");
     }
+    char* dir = alloc(len + 1);
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+    return dir;
 }
 
 // }}}
-// {{{ Dynamic Linking (lazy resolve)
+// {{{ io_uring
 
-// Dynamic link handler for lazy resolve.
-// This handler is installed in the GOT[2] entry of `Dso` objects which holds
-// the address of the jump target for the PLT0 jump pad.
-//
-// Mark `dynresolve_entry` as `naked` because we don't want a prologue/epilogue
-// being generated so we have full control over the stack layout.
+// Minimal `io_uring` instance used to batch the I/O operations of the
+// loader, see io_uring(7).
+typedef struct {
+    int fd;                      // File descriptor of the `io_uring` instance.
+    uint32_t entries;            // Number of submission queue entries.
+    uint32_t* sq_head;           // Submission queue head (advanced by the Kernel).
+    uint32_t* sq_tail;           // Submission queue tail (advanced by us).
+    uint32_t sq_mask;            // Submission queue ring mask.
+    uint32_t* sq_array;          // Submission queue index array.
+    struct io_uring_sqe* sqes;   // Submission queue entries.
+    uint32_t* cq_head;           // Completion queue head (advanced by us).
+    uint32_t* cq_tail;           // Completion queue tail (advanced by the Kernel).
+    uint32_t cq_mask;            // Completion queue ring mask.
+    struct io_uring_cqe* cqes;   // Completion queue entries.
+    uint32_t to_submit;          // Number of queued but not yet submitted entries.
+    void* ring;                  // Mapping of the submission & completion queue rings.
+    size_t ring_sz;              // Size of the ring mapping.
+    size_t sqes_sz;              // Size of the submission queue entries mapping.
+} Uring;
+
+static bool uring_init(Uring* ring, uint32_t entries) {
+    *ring = (Uring){0};
+
+    struct io_uring_params p = {0};
+    const int fd = io_uring_setup(entries, &p);
+    if (fd < 0) {
+        return false;
+    }
+
+    // We rely on the submission & completion queue rings sharing one mapping
+    // (available since Linux 5.4).
+    if ((p.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+    ring->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    uint8_t* rings = mmap(0, ring->ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ERROR_ON(rings == MAP_FAILED, "Failed to mmap io_uring rings!");
+    struct io_uring_sqe* sqes = mmap(0, ring->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    ERROR_ON(sqes == MAP_FAILED, "Failed to mmap io_uring sqes!");
+
+    ring->fd = fd;
+    ring->entries = p.sq_entries;
+    ring->sq_head = (uint32_t*)(rings + p.sq_off.head);
+    ring->sq_tail = (uint32_t*)(rings + p.sq_off.tail);
+    ring->sq_mask = *(uint32_t*)(rings + p.sq_off.ring_mask);
+    ring->sq_array = (uint32_t*)(rings + p.sq_off.array);
+    ring->sqes = sqes;
+    ring->cq_head = (uint32_t*)(rings + p.cq_off.head);
+    ring->cq_tail = (uint32_t*)(rings + p.cq_off.tail);
+    ring->cq_mask = *(uint32_t*)(rings + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(rings + p.cq_off.cqes);
+    ring->ring = rings;
+    return true;
+}
+
+static void uring_fini(Uring* ring) {
+    munmap(ring->sqes, ring->sqes_sz);
+    munmap(ring->ring, ring->ring_sz);
+    close(ring->fd);
+}
+
+// Get a zeroed submission queue entry.
 //
-// `noreturn`  Function never returns.
-// `naked`     Don't generate prologue/epilogue sequences.
-__attribute__((noreturn)) __attribute__((naked)) static void dynresolve_entry() {
-    asm("dynresolve_entry:\n\t"
-        // Pop arguments of PLT0 from the stack into rdi/rsi registers
-        // These are the first two integer arguments registers as defined by
-        // the SystemV abi and hence will be passed correctly to `dynresolve`.
-        "pop %rdi\n\t"  // GOT[1] entry (pushed by PLT0 pad).
-        "pop %rsi\n\t"  // Relocation index (pushed by PLT0 pad).
-        "jmp dynresolve");
+// The caller must not have more than `ring->entries` operations in flight.
+static struct io_uring_sqe* uring_get_sqe(Uring* ring) {
+    const uint32_t tail = *ring->sq_tail + ring->to_submit;
+    ERROR_ON(tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->entries, "io_uring submission queue full!");
+
+    const uint32_t idx = tail & ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    ++ring->to_submit;
+    return sqe;
+}
+
+// Submit all queued entries and wait for at least `wait_nr` completions.
+static void uring_submit(Uring* ring, uint32_t wait_nr) {
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + ring->to_submit, __ATOMIC_RELEASE);
+
+    const uint32_t to_submit = ring->to_submit;
+    ring->to_submit = 0;
+
+    const int ret = io_uring_enter(ring->fd, to_submit, wait_nr, IORING_ENTER_GETEVENTS);
+    ERROR_ON(ret < 0 || (uint32_t)ret != to_submit, "io_uring_enter failed (ret=%d)!", ret);
 }
 
-// `used`    Force to emit code for function.
-// `unused`  Don't warn about unused function.
-__attribute__((used)) __attribute__((unused)) static void dynresolve(uint64_t got1, uint64_t reloc_idx) {
-    ERROR_ON(true,
-             "ERROR: dynresolve request not supported!"
-             "\n\tGOT[1]    = 0x%x"
-             "\n\treloc_idx = %d\n",
-             got1, reloc_idx);
+// Pop the next completion queue entry if available.
+static bool uring_pop_cqe(Uring* ring, struct io_uring_cqe* cqe) {
+    const uint32_t head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *cqe = ring->cqes[head & ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
 }
 
 // }}}
-// {{{ Setup GOT
+// {{{ Map Shared Library Dependency
 
-static void setup_got(const Dso* dso) {
-    // GOT entries {0, 1, 2} have special meaning for the dynamic link process.
-    //   GOT[0]     Hold address of dynamic structure referenced by `_DYNAMIC`.
-    //   GOT[1]     Argument pushed by PLT0 pad on stack before jumping to GOT[2],
-    //              can be freely used by dynamic linker to identify the caller.
-    //   GOT[2]     Jump target for PLT0 pad when doing dynamic resolve (lazy).
-    //
-    // We will not make use of GOT[0]/GOT[1] here but only GOT[2].
+// Image of a shared library dependency which is read in from its file (see
+// `load_images`), but which is not yet mapped into the virtual address space.
+typedef struct {
+    const char* path;     // Path of the dependency.
+    int fd;               // Open file descriptor of the dependency.
+    Elf64Phdr* phdr;      // Program headers (allocated).
+    uint16_t phnum;       // Number of program headers.
+    ObjectLayout layout;  // Layout of the `PT_LOAD` segments and the `.dynamic` section.
+    FileId id;            // Identity of the dependency file.
+    const char* name;     // Name the dependency was requested with (`DT_NEEDED` entry).
+    const char* soname;   // `DT_SONAME` of the dependency (allocated, 0 if none).
+    const char** needed;  // Names of the `DT_NEEDED` entries (allocated).
+    uint32_t needed_len;  // Number of `DT_NEEDED` entries.
+    uint32_t* deps;       // Link map index of each `DT_NEEDED` entry (allocated).
+    SearchPath search;    // Search paths for the `DT_NEEDED` entries.
+    uint32_t alias;       // Index + 1 of the image with the same file (0 if none).
+    Elf64Dyn* dynamic;    // `.dynamic` section read from the file while loading (scratch).
+    int step;             // Current load step (see `LoadStep`).
+    void* io_buf;         // Buffer of the read operation of the current load step.
+    uint64_t io_len;      // Length of the read operation of the current load step.
+    uint64_t io_off;      // File offset of the read operation of the current load step.
+    const char* error;    // Why reading the headers failed (0 if none, see `load_fail`).
+} DsoImage;
 
-    // Install dynamic resolve handler. This handler is used when binding
-    // symbols lazy.
-    //
-    // The handler is installed in the `GOT[2]` entry for each DSO object that
-    // has a GOT. It is jumped to from the `PLT0` pad with the following two
-    // arguments passed via the stack:
-    //   - GOT[1] entry.
-    //   - Relocation index.
-    //
-    // This can be seen in the following disassembly of section .plt:
-    //   PLT0:
-    //     push   QWORD PTR [rip+0x3002]        # GOT[1]
-    //     jmp    QWORD PTR [rip+0x3004]        # GOT[2]
-    //     nop    DWORD PTR [rax+0x0]
-    //
-    //   PLT1:
-    //     jmp    QWORD PTR [rip+0x3002]        # GOT[3]; entry for <PLT1>
-    //     push   0x0                           # Relocation index
-    //     jmp    401000 <PLT0>
-    //
-    // The handler at GOT[2] can pop the arguments as follows:
-    //    pop %rdi  // GOT[1] entry.
-    //    pop %rsi  // Relocation index.
+// Translate the virtual address `vaddr` of `img` into an offset into the
+// file of `img` by using the `PT_LOAD` segment which contains `vaddr`.
+// Returns `-1` if `vaddr` is not backed by the file.
+static uint64_t vaddr_to_offset(const DsoImage* img, uint64_t vaddr) {
+    for (unsigned i = 0; i < img->phnum; ++i) {
+        const Elf64Phdr* p = &img->phdr[i];
+        if (p->type == PT_LOAD && p->vaddr <= vaddr && vaddr < p->vaddr + p->filesz) {
+            return vaddr - p->vaddr + p->offset;
+        }
+    }
+    return (uint64_t)-1;
+}
 
-    if (dso->dynamic[DT_PLTGOT] != 0) {
-        uint64_t* got = (uint64_t*)(dso->base + dso->dynamic[DT_PLTGOT]);
-        got[2] = (uint64_t)&dynresolve_entry;
+// Steps to read in the headers of a dependency. Each step requires one I/O
+// operation, the result of which is processed by `load_step`.
+typedef enum {
+    LOAD_OPEN,     // Open the dependency file.
+    LOAD_EHDR,     // Read the first page containing the ELF header (and typically the program headers).
+    LOAD_PHDR,     // Read the program headers (only if not contained in the first page).
+    LOAD_DYNAMIC,  // Read the `.dynamic` section.
+    LOAD_STRTAB,   // Read the string table.
+    LOAD_DONE,
+} LoadStep;
+
+// Decode the `DT_SONAME`, `DT_NEEDED`, `DT_RPATH` and `DT_RUNPATH` entries of
+// `img` from the `.dynamic` section and string table read from its file.
+//
+// This allows to discover the full dependency graph before any dependency is
+// mapped into the virtual address space.
+// Returns `false` if a `DT_NEEDED` entry is out of bounds of the string table.
+static bool decode_file_dynamic(DsoImage* img, const char* strs, uint64_t strsz) {
+    const Elf64Dyn* dynamic = img->dynamic;
+    const unsigned dyncnt = img->layout.dynsz / sizeof(Elf64Dyn);
+
+    uint64_t soname = (uint64_t)-1;
+    uint64_t rpath = (uint64_t)-1;
+    uint64_t runpath = (uint64_t)-1;
+    for (unsigned i = 0; i < dyncnt && dynamic[i].tag != DT_NULL; ++i) {
+        if (dynamic[i].tag == DT_NEEDED) {
+            img->needed_len += 1;
+        } else if (dynamic[i].tag == DT_SONAME) {
+            soname = dynamic[i].val;
+        } else if (dynamic[i].tag == DT_RPATH) {
+            rpath = dynamic[i].val;
+        } else if (dynamic[i].tag == DT_RUNPATH) {
+            runpath = dynamic[i].val;
+        }
+    }
+
+    // Only the names are kept, the string table itself is released afterwards.
+    img->soname = soname < strsz ? strdup(strs + soname) : 0;
+    img->search.origin = dirname(img->path);
+    img->search.rpath = rpath < strsz ? strdup(strs + rpath) : 0;
+    img->search.runpath = runpath < strsz ? strdup(strs + runpath) : 0;
+    img->needed = img->needed_len ? alloc(sizeof(const char*) * img->needed_len) : 0;
+    img->deps = img->needed_len ? alloc(sizeof(uint32_t) * img->needed_len) : 0;
+
+    unsigned needed_idx = 0;
+    for (unsigned i = 0; i < dyncnt && dynamic[i].tag != DT_NULL; ++i) {
+        if (dynamic[i].tag == DT_NEEDED) {
+            if (dynamic[i].val >= strsz) {
+                img->needed_len = needed_idx;
+                return false;
+            }
+            img->needed[needed_idx++] = strdup(strs + dynamic[i].val);
+        }
     }
+    return true;
 }
 
-// }}}
+// Setup the read request of the next load step of `img`.
+static void load_read(DsoImage* img, LoadStep step, void* buf, uint64_t len, uint64_t off) {
+    img->step = step;
+    img->io_buf = buf;
+    img->io_len = len;
+    img->io_off = off;
+}
 
-// {{{ Dynamic Linker Entrypoint
+// Stop loading the headers of `img` because of `error`, a description of the
+// problem (eg "is not 64bit ELF"). Returns `false` (no further I/O operation).
+static bool load_fail(DsoImage* img, const char* error) {
+    img->error = error;
+    img->step = LOAD_DONE;
+    return false;
+}
 
-void dl_entry(const uint64_t* prctx) {
-    // Parse SystemV ABI block.
-    const SystemVDescriptor sysv_desc = get_systemv_descriptor(prctx);
+// Process the result `res` of the I/O operation of the current load step of
+// `img` and setup the I/O operation for the next step.
+//
+// Returns `true` if `img` requires a further I/O operation. Problems with the
+// file are recorded in `img->error` (see `load_fail`).
+static bool load_step(DsoImage* img, long res) {
+    switch (img->step) {
+        case LOAD_OPEN: {
+            if (res < 0) {
+                return load_fail(img, "can't be opened");
+            }
+            img->fd = res;
 
-    // Ensure hard-coded page size value is correct.
-    ERROR_ON(sysv_desc.auxv[AT_PAGESZ] != PAGE_SIZE, "Hard-coded PAGE_SIZE miss-match!");
+            // Get device & inode to detect the same file being requested by
+            // different names, and the file identity for the prelink cache.
+            struct stat st;
+            if (fstat(img->fd, &st) != 0) {
+                return load_fail(img, "can't be stat'ed");
+            }
+            img->id = get_file_id(&st);
 
-    // Initialize dso handle for user program but extracting necesarry
-    // information from `AUXV` and the `PHDR`.
-    const Dso dso_prog = get_prog_dso(&sysv_desc);
+            load_read(img, LOAD_EHDR, scratch_alloc(PAGE_SIZE), PAGE_SIZE, 0);
+        } break;
+        case LOAD_EHDR: {
+            if (res < (long)sizeof(Elf64Ehdr)) {
+                return load_fail(img, "is too short for an Elf64Ehdr");
+            }
 
-    // Map dependency.
-    //
-    // In this chapter the user program should have a single shared
-    // object dependency, which is our `libgreet.so` no-std shared
-    // library.
-    // The `libgreet.so` library itself should not have any dynamic
-    // dependencies.
-    ERROR_ON(dso_prog.needed_len != 1, "User program should have exactly one dependency!");
+            const Elf64Ehdr* ehdr = img->io_buf;
+            const char* error = check_ehdr(ehdr);
+            if (error) {
+                return load_fail(img, error);
+            }
 
-    const Dso dso_lib = map_dependency(get_str(&dso_prog, dso_prog.needed[0]));
-    ERROR_ON(dso_lib.needed_len != 0, "The library should not have any further dependencies!");
+            img->phnum = ehdr->phnum;
+            img->phdr = alloc(sizeof(Elf64Phdr) * img->phnum);
 
-    // Setup LinkMap.
-    //
-    // Create a list of DSOs as link map with the following order:
-    //   main -> libgreet.so
-    // The link map determines the symbol lookup order.
-    const LinkMap map_lib = {.dso = &dso_lib, .next = 0};
-    const LinkMap map_prog = {.dso = &dso_prog, .next = &map_lib};
-
-    // Resolve relocations of the library (dependency).
-    resolve_relocs(&dso_lib, &map_prog);
-    // Resolve relocations of the main program.
-    resolve_relocs(&dso_prog, &map_prog);
-
-    // Initialize library.
-    init(&dso_lib);
-    // Initialize main program.
-    init(&dso_prog);
+            const uint64_t phoff = ehdr->phoff;
+            const uint64_t phdrsz = sizeof(Elf64Phdr) * img->phnum;
+            if (phoff + phdrsz <= (uint64_t)res) {
+                // Program headers are contained in the first page already.
+                memcpy(img->phdr, (const uint8_t*)img->io_buf + phoff, phdrsz);
+                img->step = LOAD_PHDR;
+                return load_step(img, phdrsz);
+            }
 
-    // Setup global offset table (GOT).
-    //
-    // This installs a dynamic resolve handler, which should not be called in
-    // this example as we resolve all relocations before transferring control
-    // to the user program.
-    // For safety we still install a handler which will terminate the program
-    // once it is called. If we wouldn't install this handler the program would
-    // most probably SEGFAULT in case symbol binding would be invoked during
-    // runtime.
-    setup_got(&dso_lib);
-    setup_got(&dso_prog);
+            // Read Program headers at offset `phoff`.
+            load_read(img, LOAD_PHDR, img->phdr, phdrsz, phoff);
+        } break;
+        case LOAD_PHDR: {
+            if (res != (long)(sizeof(Elf64Phdr) * img->phnum)) {
+                return load_fail(img, "is too short for its Elf64Phdr");
+            }
+            const char* error = decode_layout(img->phdr, img->phnum, &img->layout);
+            if (error) {
+                return load_fail(img, error);
+            }
+            const uint64_t dynamic_off = vaddr_to_offset(img, img->layout.dynoff);
+            if (dynamic_off == (uint64_t)-1) {
+                return load_fail(img, "has a `.dynamic` section not backed by the file");
+            }
 
-    // Transfer control to user program.
-    dso_prog.entry();
+            img->dynamic = scratch_alloc(img->layout.dynsz);
+            load_read(img, LOAD_DYNAMIC, img->dynamic, img->layout.dynsz, dynamic_off);
+        } break;
+        case LOAD_DYNAMIC: {
+            if (res != (long)img->layout.dynsz) {
+                return load_fail(img, "is too short for its `.dynamic` section");
+            }
+
+            uint64_t strtab = 0;
+            uint64_t strsz = 0;
+            for (unsigned i = 0; i < img->layout.dynsz / sizeof(Elf64Dyn) && img->dynamic[i].tag != DT_NULL; ++i) {
+                if (img->dynamic[i].tag == DT_STRTAB) {
+                    strtab = img->dynamic[i].val;
+                } else if (img->dynamic[i].tag == DT_STRSZ) {
+                    strsz = img->dynamic[i].val;
+                }
+            }
+            const uint64_t strtab_off = strtab ? vaddr_to_offset(img, strtab) : (uint64_t)-1;
+            if (strtab_off == (uint64_t)-1 || strsz == 0) {
+                return load_fail(img, "has no DT_STRTAB/DT_STRSZ backed by the file");
+            }
+
+            load_read(img, LOAD_STRTAB, scratch_alloc(strsz + 1), strsz, strtab_off);
+        } break;
+        case LOAD_STRTAB: {
+            if (res != (long)img->io_len) {
+                return load_fail(img, "is too short for its string table");
+            }
+
+            char* strs = img->io_buf;
+            strs[img->io_len] = '\0';
+            const bool decoded = decode_file_dynamic(img, strs, img->io_len);
+            img->dynamic = 0;
+            if (!decoded) {
+                return load_fail(img, "has a DT_NEEDED entry out-of-bounds");
+            }
+            img->step = LOAD_DONE;
+        } break;
+        case LOAD_DONE:
+            ERROR_ON(true, "Dependency '%s' already loaded!", img->path);
+    }
+    return img->step != LOAD_DONE;
+}
 
-    // Finalize main program.
-    fini(&dso_prog);
-    // Finalize library.
-    fini(&dso_lib);
+// Read in the headers of all `imgs` with blocking syscalls, one I/O
+// operation at a time.
+static void load_images_sync(DsoImage* imgs, unsigned cnt) {
+    for (unsigned i = 0; i < cnt; ++i) {
+        DsoImage* img = &imgs[i];
+        long res = open(img->path, O_RDONLY);
+        while (load_step(img, res)) {
+            res = pread(img->fd, img->io_buf, img->io_len, img->io_off);
+        }
+    }
+}
+
+// Read in the headers of all `imgs` with batched and concurrent I/O
+// operations through `io_uring`.
+//
+// The I/O operations of all `imgs` are submitted together and each image
+// advances to its next load step as soon as the completion of its previous
+// I/O operation arrives. On a cold page cache this overlaps the disk latency
+// of all `imgs` instead of paying for it serially.
+//
+// Returns `false` if `io_uring` is not available.
+static bool load_images_uring(DsoImage* imgs, unsigned cnt) {
+    Uring ring;
+    if (!uring_init(&ring, URING_ENTRIES)) {
+        return false;
+    }
+
+    unsigned next = 0;      // Next image to issue the open operation for.
+    unsigned inflight = 0;  // Number of outstanding I/O operations.
+    unsigned done = 0;      // Number of images whose headers are fully read.
+
+    while (done < cnt) {
+        // Issue open operations for images not started yet, bounded by the
+        // ring size (each image has at most one outstanding operation).
+        while (next < cnt && inflight < ring.entries) {
+            struct io_uring_sqe* sqe = uring_get_sqe(&ring);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)imgs[next].path;
+            sqe->op_flags = O_RDONLY;
+            sqe->user_data = next;
+            ++next;
+            ++inflight;
+        }
+
+        uring_submit(&ring, 1 /* wait_nr */);
+
+        struct io_uring_cqe cqe;
+        while (uring_pop_cqe(&ring, &cqe)) {
+            --inflight;
+            DsoImage* img = &imgs[cqe.user_data];
+            if (!load_step(img, cqe.res)) {
+                ++done;
+                continue;
+            }
+
+            // Issue read of next load step.
+            struct io_uring_sqe* sqe = uring_get_sqe(&ring);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = img->fd;
+            sqe->addr = (uint64_t)img->io_buf;
+            sqe->len = img->io_len;
+            sqe->off = img->io_off;
+            sqe->user_data = cqe.user_data;
+            ++inflight;
+        }
+    }
+
+    uring_fini(&ring);
+    return true;
+}
+
+// Read in the headers of all `imgs`.
+//
+// The headers are read concurrently via `io_uring` if there is more than a
+// single image, falling back to blocking syscalls if `io_uring` is not
+// available.
+static void load_images(DsoImage* imgs, unsigned cnt) {
+    if (cnt > 1 && load_images_uring(imgs, cnt)) {
+        return;
+    }
+    load_images_sync(imgs, cnt);
+}
+
+// Map all `PT_LOAD` segments of `img` at `base` and close the file descriptor
+// of `img` afterwards.
+//
+// The address space at `base + img->layout.start` must already be reserved.
+static Dso map_image(DsoImage* img, uint8_t* base) {
+    Dso dso = {0};
+    dso.phdr = img->phdr;
+    dso.phnum = img->phnum;
+    dso.name = img->name;
+    dso.path = img->path;
+    dso.id = img->id;
+    dso.deps = img->deps;
+    map_dso(&gLoader, &dso, img->fd, base, img->layout.dynoff);
+
+    // Close file descriptor.
+    close(img->fd);
+    img->fd = -1;
+    return dso;
+}
+
+// Map the dependencies `imgs` into one contiguous region of the virtual
+// address space and initialize the corresponding `dsos`.
+//
+// Instead of letting the Kernel choose an address for each dependency
+// individually, the span of all dependencies is computed up front and a single
+// `PROT_NONE` region is reserved for all of them. The dependencies are then
+// laid out in the order of `imgs` (link map order) inside the region, each one
+// followed by a guard gap which stays `PROT_NONE`.
+//
+//   hint - region - GUARD_SIZE
+//   |
+//   v
+//   +--------+-------+--------+-------+-----
+//   | dso[0] | guard | dso[1] | guard | ...
+//   +--------+-------+--------+-------+-----
+//
+// The region is placed right below `hint` with `MAP_FIXED_NOREPLACE`, which
+// keeps the dependencies close to each other and to the dynamic linker itself.
+// If that range is already in use, the Kernel chooses the address.
+//
+// If `fixed` is not 0 the region is placed exactly at `fixed` instead (used by
+// the prelink cache), in that case nothing is mapped if the range is in use.
+//
+// Returns the start of the region or 0 if it couldn't be placed at `fixed`.
+static uint8_t* map_dependencies(DsoImage* imgs, Dso* dsos, unsigned cnt, const uint8_t* hint, uint8_t* fixed) {
+    if (cnt == 0) {
+        return 0;
+    }
+
+    // Compute the offset of each dependency in the region and the total
+    // length of the region.
+    uint64_t offs[cnt];
+    uint64_t len = 0;
+    uint64_t align = PAGE_SIZE;
+    for (unsigned i = 0; i < cnt; ++i) {
+        const ObjectLayout* layout = &imgs[i].layout;
+        len = align_up(len, layout->align);
+        offs[i] = len;
+        len += (layout->end - layout->start) + GUARD_SIZE;
+
+        if (layout->align > align) {
+            align = layout->align;
+        }
+    }
+
+    uint8_t* region = reserve_region(len, align, (uint64_t)hint > GUARD_SIZE ? hint - GUARD_SIZE : 0, fixed);
+    if (region == 0) {
+        return 0;
+    }
+
+    // Map the dependencies into the region.
+    //
+    // Each dependency owns the address range from the end of the previous one
+    // up to the end of its guard gap, such that it can be unmapped on its own.
+    uint64_t prev_end = 0;
+    for (unsigned i = 0; i < cnt; ++i) {
+        const ObjectLayout* layout = &imgs[i].layout;
+        // Compute base address for library.
+        dsos[i] = map_image(&imgs[i], region + offs[i] - layout->start);
+
+        const uint64_t end = offs[i] + (layout->end - layout->start) + GUARD_SIZE;
+        dsos[i].map_start = region + prev_end;
+        dsos[i].map_len = end - prev_end;
+        prev_end = end;
+    }
+
+    return region;
+}
+
+// }}}
+// {{{ Prelink Cache
+
+// Persistent cache of the relocated link map (prelink style).
+//
+// Resolving the relocations of the same set of files mapped at the same
+// addresses always yields the same result. The cache records the identity
+// (`FileId`) of every file in the link map, the address of the region of all
+// dependencies and the content of all writable `PT_LOAD` pages after the
+// relocations are resolved.
+// A later start with the same files maps the dependencies at the recorded
+// address, maps the recorded pages over the writable segments and skips
+// resolving relocations entirely.
+// Relocations resolved to symbols of the dynamic linker itself (eg `dlopen`)
+// or of the vDSO are recorded separately as fixups, as both are mapped at a
+// different address on each start. They are patched after mapping the pages.
+// The fixups and how the relocations are resolved depend on the dynamic
+// linker itself, hence the cache also records the identity of the dynamic
+// linker file. Likewise it records a fingerprint of the vDSO, which changes
+// with the Kernel.
+// The implementations selected by IFUNC resolvers depend on the CPU, hence
+// the cache is only used with the same CPU features.
+// Preloaded objects are part of the link map, hence a changed `LD_PRELOAD`
+// list or order changes the recorded `FileId`s and is a miss. Direct binding
+// may bind symbols to other providers than the link map order, hence the
+// cache also records whether `DYNLD_DIRECT` was set. The content of the
+// direct binding sidecar file is not part of the key, a hit replays the
+// providers the sidecar file recorded when the cache was stored.
+//
+// The cache is opt-in by setting `DYNLD_CACHE` to the path of the cache file.
+// A cache file which doesn't match the link map is a miss and is replaced
+// after the relocations are resolved.
+//
+// Cache file layout:
+//   CacheHeader
+//   FileId[len]      Identity of each link map entry in link map order.
+//   CacheSeg[nsegs]  Recorded writable pages.
+//   CacheFixup[nfixups]
+//   <pad>            Padding to the next page boundary.
+//   <pages>          Content of each `CacheSeg` at `CacheSeg.off`.
+
+#define CACHE_MAGIC 0x35454843444c5944ull  // "DYLDCHE5"
+
+typedef struct {
+    uint64_t magic;      // Must be `CACHE_MAGIC`.
+    uint64_t prog_base;  // Base address of the main program.
+    FileId dynld_id;     // Identity of the dynamic linker file (`PT_INTERP` of the main program).
+    uint64_t vdso_hash;  // Fingerprint of the vDSO (see `vdso_fingerprint`).
+    uint64_t region;     // Start of the region of all dependencies (0 if none).
+    uint32_t len;        // Number of `FileId` entries.
+    uint32_t nsegs;      // Number of `CacheSeg` entries.
+    uint32_t nfixups;    // Number of `CacheFixup` entries.
+    uint32_t cpu;        // CPU features the IFUNC resolvers selected implementations for (`DYNLD_CPU_*`).
+    uint32_t direct;     // Direct binding was requested (`DYNLD_DIRECT` set).
+    uint32_t reserved;
+} CacheHeader;
+
+typedef struct {
+    uint64_t addr;  // Page aligned start address.
+    uint64_t len;   // Page aligned length.
+    uint64_t off;   // Page aligned offset of the content in the cache file.
+    uint64_t prot;  // Protection of the pages.
+} CacheSeg;
+
+// Object a fixup is relative to.
+typedef enum {
+    FIXUP_DYNLD,  // Dynamic linker.
+    FIXUP_VDSO,   // vDSO.
+} FixupBase;
+
+typedef struct {
+    uint64_t addr;  // Address of the relocated slot.
+    uint64_t off;   // Value of the slot as offset from the base address of `base`.
+    uint64_t base;  // Object the slot points into (see `FixupBase`).
+} CacheFixup;
+
+typedef struct {
+    const char* path;           // Path of the cache file (0 if the cache is disabled).
+    int fd;                     // Open cache file if it matches the link map (-1 otherwise).
+    FileId prog_id;             // Identity of the main program file.
+    FileId dynld_id;            // Identity of the dynamic linker file.
+    uint64_t vdso_hash;         // Fingerprint of the vDSO.
+    bool direct;                // Direct binding is requested (`DYNLD_DIRECT` set).
+    FileId* ids;                // Identity of each link map entry (scratch).
+    uint32_t len;               // Number of link map entries.
+    uint8_t* prog_base;         // Base address of the main program.
+    uint8_t* region;            // Start of the region of all dependencies.
+    CacheSeg* segs;             // Writable pages recorded in the cache file (scratch).
+    uint32_t nsegs;             // Number of `segs`.
+    const uint8_t* dynld_base;  // Base address of the dynamic linker.
+    const uint8_t* vdso_base;   // Base address of the vDSO.
+    CacheFixup* fixups;         // Slots pointing into the dynamic linker or the vDSO (scratch).
+    uint32_t nfixups;           // Number of `fixups`.
+    uint32_t fixups_cap;        // Capacity of `fixups`.
+    bool hit;                   // Link map is restored from the cache.
+} PrelinkCache;
+
+// Get the identity of the file at `path` into `id`.
+// Returns `false` if the file can't be opened.
+DL_INIT static bool get_path_id(const char* path, FileId* id) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    const bool ok = fstat(fd, &st) == 0;
+    if (ok) {
+        *id = get_file_id(&st);
+    }
+    close(fd);
+    return ok;
+}
+
+// Get the identity of the main program file into `id`.
+// Returns `false` if the main program file can't be opened.
+DL_INIT static bool get_exec_id(const SystemVDescriptor* sysv, FileId* id) {
+    // The main program is not opened by us, get its identity via its path.
+    const char* execfn = (const char*)sysv->auxv[AT_EXECFN];
+    return execfn && get_path_id(execfn, id);
+}
+
+// Get the identity of the dynamic linker file, the program interpreter of the
+// main program `prog`, into `id`.
+// Returns `false` if `prog` has no `PT_INTERP` or the file can't be opened.
+DL_INIT static bool get_interp_id(const Dso* prog, FileId* id) {
+    for (unsigned i = 0; i < prog->phnum; ++i) {
+        if (prog->phdr[i].type == PT_INTERP) {
+            return get_path_id((const char*)(prog->base + prog->phdr[i].vaddr), id);
+        }
+    }
+    return false;
+}
+
+// Compute the fingerprint of the vDSO, the FNV-1a hash of its `PT_LOAD`
+// segment (headers, `.dynsym` and `.text`). Returns 0 if there is no vDSO.
+DL_INIT static uint64_t vdso_fingerprint() {
+    if (gVdso.base == 0) {
+        return 0;
+    }
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned i = 0; i < gVdso.phnum; ++i) {
+        const Elf64Phdr* ph = &gVdso.phdr[i];
+        if (ph->type != PT_LOAD) {
+            continue;
+        }
+        const uint8_t* bytes = gVdso.base + ph->vaddr;
+        for (uint64_t b = 0; b < ph->filesz; ++b) {
+            hash = (hash ^ bytes[b]) * 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+// Setup the prelink cache for the main program `prog` if enabled by the
+// `DYNLD_CACHE` environment variable.
+DL_INIT static PrelinkCache cache_init(const SystemVDescriptor* sysv, const Dso* prog) {
+    PrelinkCache cache = {0};
+    cache.fd = -1;
+    cache.prog_base = prog->base;
+    cache.dynld_base = (const uint8_t*)sysv->auxv[AT_BASE];
+    cache.vdso_base = gVdso.base;
+
+    const char* path = get_env(sysv, "DYNLD_CACHE");
+    if (path && *path && get_exec_id(sysv, &cache.prog_id) && get_interp_id(prog, &cache.dynld_id)) {
+        const char* direct = get_env(sysv, "DYNLD_DIRECT");
+        cache.vdso_hash = vdso_fingerprint();
+        cache.direct = direct && *direct;
+        cache.path = path;
+    }
+    return cache;
+}
+
+// Read the index of the cache file `fd` and check it against the link map.
+DL_INIT static bool cache_read_index(PrelinkCache* cache, int fd) {
+    struct stat st;
+    CacheHeader hdr;
+    if (fstat(fd, &st) != 0 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+        return false;
+    }
+    if (hdr.magic != CACHE_MAGIC || hdr.prog_base != (uint64_t)cache->prog_base || hdr.len != cache->len || hdr.cpu != gLoader.cpu.usable ||
+        hdr.direct != cache->direct || (hdr.len > 1) != (hdr.region != 0)) {
+        return false;
+    }
+    // A rebuilt dynamic linker may resolve relocations differently and
+    // invalidates the fixups, as does a different vDSO.
+    if (memcmp(&hdr.dynld_id, &cache->dynld_id, sizeof(FileId)) != 0 || hdr.vdso_hash != cache->vdso_hash) {
+        return false;
+    }
+    const uint64_t ids_len = sizeof(FileId) * hdr.len;
+    const uint64_t segs_len = sizeof(CacheSeg) * hdr.nsegs;
+    const uint64_t fixups_len = sizeof(CacheFixup) * hdr.nfixups;
+    if (sizeof(hdr) + ids_len + segs_len + fixups_len > (uint64_t)st.st_size) {
+        return false;
+    }
+
+    FileId* ids = scratch_alloc(ids_len);
+    const bool match = pread(fd, ids, ids_len, sizeof(hdr)) == (ssize_t)ids_len && memcmp(ids, cache->ids, ids_len) == 0;
+    if (!match) {
+        return false;
+    }
+
+    cache->segs = hdr.nsegs ? scratch_alloc(segs_len) : 0;
+    cache->fixups = hdr.nfixups ? scratch_alloc(fixups_len) : 0;
+    if (pread(fd, cache->segs, segs_len, sizeof(hdr) + ids_len) != (ssize_t)segs_len ||
+        pread(fd, cache->fixups, fixups_len, sizeof(hdr) + ids_len + segs_len) != (ssize_t)fixups_len) {
+        cache->segs = 0;
+        cache->fixups = 0;
+        return false;
+    }
+    cache->nsegs = hdr.nsegs;
+    cache->nfixups = hdr.nfixups;
+    cache->region = (uint8_t*)hdr.region;
+    return true;
+}
+
+// Check if the cache file matches the link map consisting of the main program
+// followed by the dependencies `imgs`.
+//
+// On a match the cache file is kept open and `cache->region` holds the address
+// the dependencies must be mapped at.
+DL_INIT static bool cache_lookup(PrelinkCache* cache, const DsoImage* imgs, unsigned cnt) {
+    if (cache->path == 0) {
+        return false;
+    }
+
+    cache->len = cnt + 1;
+    cache->ids = scratch_alloc(sizeof(FileId) * cache->len);
+    cache->ids[0] = cache->prog_id;
+    for (unsigned i = 0; i < cnt; ++i) {
+        cache->ids[i + 1] = imgs[i].id;
+    }
+
+    const int fd = open(cache->path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    if (!cache_read_index(cache, fd)) {
+        close(fd);
+        return false;
+    }
+    cache->fd = fd;
+    return true;
+}
+
+// Map the recorded writable pages over the writable segments of the link map,
+// patch the fixups and close the cache file.
+DL_INIT static void cache_apply(PrelinkCache* cache) {
+    for (unsigned i = 0; i < cache->nsegs; ++i) {
+        const CacheSeg* seg = &cache->segs[i];
+        ERROR_ON(mmap((void*)seg->addr, seg->len, seg->prot, MAP_PRIVATE | MAP_FIXED, cache->fd, seg->off) != (void*)seg->addr,
+                 "Failed to map cached pages at 0x%lx from '%s'!", seg->addr, cache->path);
+    }
+    for (unsigned i = 0; i < cache->nfixups; ++i) {
+        const uint8_t* base = cache->fixups[i].base == FIXUP_VDSO ? cache->vdso_base : cache->dynld_base;
+        *(uint64_t*)cache->fixups[i].addr = (uint64_t)base + cache->fixups[i].off;
+    }
+    close(cache->fd);
+    cache->fd = -1;
+}
+
+// Record the relocated slot at `addr` which was resolved to the address
+// `value` inside the dynamic linker or the vDSO (`base`).
+static void cache_add_fixup(PrelinkCache* cache, uint64_t addr, uint64_t value, FixupBase base) {
+    if (cache == 0 || cache->path == 0) {
+        return;
+    }
+    if (cache->nfixups == cache->fixups_cap) {
+        const uint32_t cap = cache->fixups_cap ? cache->fixups_cap * 2 : 16;
+        CacheFixup* grown = scratch_alloc(sizeof(CacheFixup) * cap);
+        if (cache->fixups) {
+            memcpy(grown, cache->fixups, sizeof(CacheFixup) * cache->nfixups);
+        }
+        cache->fixups = grown;
+        cache->fixups_cap = cap;
+    }
+    cache->fixups[cache->nfixups].addr = addr;
+    cache->fixups[cache->nfixups].off = value - (uint64_t)(base == FIXUP_VDSO ? cache->vdso_base : cache->dynld_base);
+    cache->fixups[cache->nfixups].base = base;
+    cache->nfixups += 1;
+}
+
+// Drop a matching cache file which couldn't be applied.
+static void cache_drop(PrelinkCache* cache) {
+    if (cache->fd != -1) {
+        close(cache->fd);
+        cache->fd = -1;
+    }
+}
+
+static bool write_all(int fd, const void* buf, uint64_t len) {
+    const uint8_t* p = buf;
+    while (len) {
+        const ssize_t ret = write(fd, p, len);
+        if (ret <= 0) {
+            return false;
+        }
+        p += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+// Record the writable pages of the relocated link map `dsos` in the cache file.
+//
+// Must be called after all relocations are resolved and before any
+// initialization function is run. The cache file is written to a temporary
+// file first which is then renamed, such that concurrent starts never observe
+// a partially written cache file. Failing to write the cache is not an error.
+DL_INIT static void cache_store(const PrelinkCache* cache, const Dso* dsos, unsigned len) {
+    if (cache->path == 0 || cache->len != len) {
+        return;
+    }
+
+    // Count writable segments.
+    unsigned nsegs = 0;
+    for (unsigned i = 0; i < len; ++i) {
+        for (unsigned p = 0; p < dsos[i].phnum; ++p) {
+            if (dsos[i].phdr[p].type == PT_LOAD && (dsos[i].phdr[p].flags & PF_W)) {
+                ++nsegs;
+            }
+        }
+    }
+
+    // Build the page aligned index.
+    const uint64_t ids_len = sizeof(FileId) * len;
+    const uint64_t segs_len = sizeof(CacheSeg) * nsegs;
+    const uint64_t fixups_len = sizeof(CacheFixup) * cache->nfixups;
+    const uint64_t index_len = align_up(sizeof(CacheHeader) + ids_len + segs_len + fixups_len, PAGE_SIZE);
+    uint8_t* index = scratch_alloc(index_len);
+    memset(index, 0 /* byte */, index_len);
+
+    CacheHeader* hdr = (CacheHeader*)index;
+    hdr->magic = CACHE_MAGIC;
+    hdr->prog_base = (uint64_t)cache->prog_base;
+    hdr->dynld_id = cache->dynld_id;
+    hdr->vdso_hash = cache->vdso_hash;
+    hdr->region = (uint64_t)cache->region;
+    hdr->len = len;
+    hdr->nsegs = nsegs;
+    hdr->nfixups = cache->nfixups;
+    hdr->cpu = gLoader.cpu.usable;
+    hdr->direct = cache->direct;
+    memcpy(index + sizeof(CacheHeader), cache->ids, ids_len);
+    memcpy(index + sizeof(CacheHeader) + ids_len + segs_len, cache->fixups, fixups_len);
+
+    CacheSeg* segs = (CacheSeg*)(index + sizeof(CacheHeader) + ids_len);
+    uint64_t off = index_len;
+    unsigned seg = 0;
+    for (unsigned i = 0; i < len; ++i) {
+        for (unsigned p = 0; p < dsos[i].phnum; ++p) {
+            const Elf64Phdr* ph = &dsos[i].phdr[p];
+            if (ph->type != PT_LOAD || !(ph->flags & PF_W)) {
+                continue;
+            }
+            const uint64_t addr_start = (uint64_t)dsos[i].base + (ph->vaddr & ~(PAGE_SIZE - 1));
+            const uint64_t addr_end = (uint64_t)dsos[i].base + align_up(ph->vaddr + ph->memsz, PAGE_SIZE);
+            segs[seg].addr = addr_start;
+            segs[seg].len = addr_end - addr_start;
+            segs[seg].off = off;
+            segs[seg].prot = (ph->flags & PF_X ? PROT_EXEC : 0) | (ph->flags & PF_R ? PROT_READ : 0) | PROT_WRITE;
+            off += segs[seg].len;
+            ++seg;
+        }
+    }
+
+    const size_t path_len = strlen(cache->path) + 16;
+    char tmp[path_len];
+    fmt(tmp, path_len, "%s.%d", cache->path, getpid());
+
+    const int fd = creat(tmp, 0644);
+    if (fd < 0) {
+        return;
+    }
+    bool ok = write_all(fd, index, index_len);
+    for (unsigned i = 0; i < nsegs && ok; ++i) {
+        ok = write_all(fd, (const void*)segs[i].addr, segs[i].len);
+    }
+    close(fd);
+
+    if (!ok || rename(tmp, cache->path) != 0) {
+        unlink(tmp);
+    }
+}
+
+// }}}
+// {{{ Load Dependencies
+
+// Array based link map.
+//
+// The main program is always the first entry, followed by the preloaded
+// objects and all direct and indirect dependencies in breadth-first load
+// order. Objects loaded with `dlopen` are appended and removed again once
+// unloaded (see `dl_close`).
+// This order defines the symbol lookup scope. Keeping the `Dso` objects in one
+// array keeps walking the scope cache friendly.
+typedef struct {
+    Dso* dso;              // Dso objects in symbol lookup order (allocated).
+    uint32_t* order;       // Link map indices in initialization order, dependencies first (allocated).
+    uint32_t len;          // Number of Dso objects in the link map.
+    uint32_t cap;          // Capacity of `dso` and `order`.
+    uint32_t preload_len;  // Number of preloaded objects (see `load_dependencies`).
+} LinkMap;
+
+// Grow `map` to hold at least `len` objects.
+static void link_map_reserve(LinkMap* map, uint32_t len) {
+    if (len <= map->cap) {
+        return;
+    }
+    uint32_t cap = map->cap ? map->cap : 8;
+    while (cap < len) {
+        cap *= 2;
+    }
+
+    Dso* dso = alloc(sizeof(Dso) * cap);
+    uint32_t* order = alloc(sizeof(uint32_t) * cap);
+    if (map->dso) {
+        memcpy(dso, map->dso, sizeof(Dso) * map->len);
+        memcpy(order, map->order, sizeof(uint32_t) * map->len);
+        dealloc(map->dso);
+        dealloc(map->order);
+    }
+    map->dso = dso;
+    map->order = order;
+    map->cap = cap;
+}
+
+// Find an object in `map` by the name it was requested with or its
+// `DT_SONAME`. Returns the link map index or `-1` if not found.
+static int find_object_by_name(const LinkMap* map, const char* name) {
+    for (unsigned i = 1; i < map->len; ++i) {
+        const Dso* dso = &map->dso[i];
+        if (strcmp(dso->name, name) == 0 || (dso->dynamic[DT_SONAME] && strcmp(get_str(dso, dso->dynamic[DT_SONAME]), name) == 0)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Find an object in `map` by the identity of its file. Returns the link map
+// index or `-1` if not found.
+static int find_object_by_file(const LinkMap* map, const FileId* id) {
+    for (unsigned i = 1; i < map->len; ++i) {
+        if (map->dso[i].id.dev == id->dev && map->dso[i].id.ino == id->ino) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Find an already discovered dependency by the name it was requested with or
+// its `DT_SONAME`. Returns the index into `imgs` or `-1` if not found.
+static int find_image_by_name(const DsoImage* imgs, unsigned cnt, const char* name) {
+    for (unsigned i = 0; i < cnt; ++i) {
+        if (strcmp(imgs[i].name, name) == 0 || (imgs[i].soname && strcmp(imgs[i].soname, name) == 0)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Find an already discovered dependency by the identity of its file. Returns
+// the index into `imgs` or `-1` if not found.
+static int find_image_by_file(const DsoImage* imgs, unsigned cnt, const DsoImage* img) {
+    for (unsigned i = 0; i < cnt; ++i) {
+        if (imgs[i].id.dev == img->id.dev && imgs[i].id.ino == img->id.ino) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// State of discovering the objects to load.
+//
+// Objects are referred to by a discovery index. Indices below `map->len`
+// refer to objects already in the link map, starting from `map->len` they
+// refer to the newly discovered `imgs`.
+typedef struct {
+    const LinkMap* map;           // Objects already loaded.
+    DsoImage* imgs;               // Newly discovered objects in breadth-first order (scratch).
+    unsigned cnt;                 // Number of `imgs`.
+    unsigned cap;                 // Capacity of `imgs`.
+    const char* ld_library_path;  // Value of the `LD_LIBRARY_PATH` environment variable.
+    char error[256];              // Why discovering the objects failed (see `discover_objects`).
+} Discovery;
+
+// Append the object `name` found at `path` to the discovered objects, it is
+// loaded with the next breadth-first level. Returns its discovery index.
+static uint32_t discover_path(Discovery* d, const char* name, const char* path) {
+    if (d->cnt == d->cap) {
+        DsoImage* grown = scratch_alloc(sizeof(DsoImage) * d->cap * 2);
+        memcpy(grown, d->imgs, sizeof(DsoImage) * d->cap);
+        d->imgs = grown;
+        d->cap *= 2;
+    }
+
+    DsoImage* img = &d->imgs[d->cnt];
+    *img = (DsoImage){0};
+    img->path = path;
+    img->name = name;
+    img->fd = -1;
+    img->step = LOAD_OPEN;
+
+    return d->map->len + d->cnt++;
+}
+
+// Resolve the object `name` requested with the search paths `sp` to a
+// discovery index. If the object is neither loaded nor discovered yet it is
+// appended to the discovered objects. Returns `-1` if the object is not found.
+static int try_discover_object(Discovery* d, const char* name, const SearchPath* sp) {
+    int idx = find_object_by_name(d->map, name);
+    if (idx != -1) {
+        return idx;
+    }
+    idx = find_image_by_name(d->imgs, d->cnt, name);
+    if (idx != -1) {
+        return d->map->len + idx;
+    }
+
+    const char* path = find_library(name, sp, d->ld_library_path);
+    if (path == 0) {
+        return -1;
+    }
+    return discover_path(d, strdup(name), path == name ? strdup(path) : path);
+}
+
+// Resolve the dependency `name` requested by an object with the search paths
+// `sp` to a discovery index (see `try_discover_object`).
+static uint32_t discover_dependency(Discovery* d, const char* name, SearchPath sp) {
+    const int idx = try_discover_object(d, name, &sp);
+    ERROR_ON(idx == -1, "Dependency '%s' not found!\n", name);
+    return idx;
+}
+
+// Load the discovered objects and discover their dependencies breadth-first
+// level by level, the discovered objects act as queue. The headers of all
+// objects of one breadth-first level are read in one batch (see
+// `load_images`).
+//
+// Returns `false` if an object can't be loaded or a dependency is not found,
+// `d->error` describes the problem then. The discovered objects must be
+// released with `discard_images` in that case.
+static bool discover_objects(Discovery* d) {
+    for (unsigned level = 0; level < d->cnt;) {
+        const unsigned level_end = d->cnt;
+        load_images(d->imgs + level, level_end - level);
+
+        for (unsigned i = level; i < level_end; ++i) {
+            if (d->imgs[i].error) {
+                fmt(d->error, sizeof(d->error), "'%s' %s", d->imgs[i].path, d->imgs[i].error);
+                return false;
+            }
+        }
+
+        for (unsigned i = level; i < level_end; ++i) {
+            // Same file requested by a different name (eg symlink).
+            int idx = find_object_by_file(d->map, &d->imgs[i].id);
+            if (idx == -1) {
+                idx = find_image_by_file(d->imgs, i, &d->imgs[i]);
+                idx = idx == -1 ? -1 : (int)d->map->len + idx;
+            }
+            if (idx != -1) {
+                close(d->imgs[i].fd);
+                d->imgs[i].alias = 1 + idx;
+                continue;
+            }
+
+            // Discover dependencies of the next level.
+            for (unsigned n = 0; n < d->imgs[i].needed_len; ++n) {
+                // Don't hold a pointer into `imgs` as it may be re-allocated.
+                const SearchPath sp = d->imgs[i].search;
+                const int dep = try_discover_object(d, d->imgs[i].needed[n], &sp);
+                if (dep == -1) {
+                    fmt(d->error, sizeof(d->error), "Dependency '%s' of '%s' not found", d->imgs[i].needed[n], d->imgs[i].path);
+                    return false;
+                }
+                d->imgs[i].deps[n] = dep;
+            }
+        }
+        level = level_end;
+    }
+    return true;
+}
+
+// Release the objects discovered by `d` which are not mapped, after
+// `discover_objects` failed.
+static void discard_images(Discovery* d) {
+    for (unsigned i = 0; i < d->cnt; ++i) {
+        DsoImage* img = &d->imgs[i];
+        if (img->fd >= 0 && img->alias == 0) {
+            close(img->fd);
+        }
+        for (unsigned n = 0; n < img->needed_len; ++n) {
+            dealloc((void*)img->needed[n]);
+        }
+        if (img->needed) {
+            dealloc(img->needed);
+            dealloc(img->deps);
+        }
+        if (img->phdr) {
+            dealloc(img->phdr);
+        }
+        const char* strs[] = {img->soname, img->search.origin, img->search.rpath, img->search.runpath};
+        for (unsigned n = 0; n < sizeof(strs) / sizeof(strs[0]); ++n) {
+            if (strs[n]) {
+                dealloc((void*)strs[n]);
+            }
+        }
+        dealloc((void*)img->name);
+        dealloc((void*)img->path);
+    }
+    d->cnt = 0;
+}
+
+// Map the objects discovered by `d` and append them to `map`.
+//
+// The discovery indices in `roots` are translated to link map indices. All new
+// objects are mapped into one region (see `map_dependencies`) right below
+// `hint`. If the prelink `cache` matches, the region is placed at the recorded
+// address and the recorded writable pages are mapped over the new objects and
+// the main program (see `PrelinkCache`).
+// Returns the start of the region.
+static uint8_t* map_objects(LinkMap* map, Discovery* d, uint32_t* roots, unsigned roots_len, const uint8_t* hint, PrelinkCache* cache) {
+    const uint32_t first = map->len;
+
+    // Compute link map index of each image, aliases share the index of the
+    // object they alias (which always comes first).
+    uint32_t lmidx[d->cnt + 1];
+    uint32_t len = first;
+    for (unsigned i = 0; i < d->cnt; ++i) {
+        const uint32_t alias = d->imgs[i].alias;
+        lmidx[i] = alias == 0 ? len++ : (alias - 1 < first ? alias - 1 : lmidx[alias - 1 - first]);
+    }
+
+    // Drop aliases and translate dependencies to link map indices.
+    const unsigned cnt = len - first;
+    DsoImage* uniq = scratch_alloc(sizeof(DsoImage) * (cnt + 1));
+    for (unsigned i = 0; i < d->cnt; ++i) {
+        if (d->imgs[i].alias) {
+            continue;
+        }
+        for (unsigned n = 0; n < d->imgs[i].needed_len; ++n) {
+            const uint32_t dep = d->imgs[i].deps[n];
+            d->imgs[i].deps[n] = dep < first ? dep : lmidx[dep - first];
+        }
+        uniq[lmidx[i] - first] = d->imgs[i];
+    }
+    for (unsigned i = 0; i < roots_len; ++i) {
+        roots[i] = roots[i] < first ? roots[i] : lmidx[roots[i] - first];
+    }
+    d->imgs = 0;
+
+    // Map all new objects in link map order.
+    link_map_reserve(map, len);
+    Dso* dsos = map->dso + first;
+    uint8_t* region = 0;
+    if (cache && cache_lookup(cache, uniq, cnt)) {
+        cache->hit = map_dependencies(uniq, dsos, cnt, hint, cache->region) == cache->region;
+    }
+    if (cache && cache->hit) {
+        cache_apply(cache);
+        region = cache->region;
+    } else {
+        if (cache) {
+            cache_drop(cache);
+        }
+        region = map_dependencies(uniq, dsos, cnt, hint, 0 /* fixed */);
+        if (cache) {
+            cache->region = region;
+        }
+    }
+    map->len = len;
+
+    // Each object holds a reference on its dependencies.
+    for (unsigned i = first; i < len; ++i) {
+        for (unsigned n = 0; n < map->dso[i].needed_len; ++n) {
+            map->dso[map->dso[i].deps[n]].refcnt += 1;
+        }
+    }
+    return region;
+}
+
+// Compute the initialization order by a depth-first post-order walk of the
+// dependency graph, such that each dso is initialized after all its
+// dependencies.
+static void order_dependencies(LinkMap* map, uint32_t idx, uint8_t* visited, uint32_t* order_len) {
+    visited[idx] = 1;
+    for (unsigned i = 0; i < map->dso[idx].needed_len; ++i) {
+        if (!visited[map->dso[idx].deps[i]]) {
+            order_dependencies(map, map->dso[idx].deps[i], visited, order_len);
+        }
+    }
+    map->order[(*order_len)++] = idx;
+}
+
+// Append the objects starting from link map index `first` to the
+// initialization order of `map`, all of them must be reachable from the
+// `roots` (which are ordered first to last).
+static void order_objects(LinkMap* map, uint32_t first, const uint32_t* roots, unsigned roots_len) {
+    uint8_t visited[map->len];
+    for (unsigned i = 0; i < map->len; ++i) {
+        visited[i] = i < first;
+    }
+    uint32_t order_len = first;
+    for (unsigned i = 0; i < roots_len; ++i) {
+        if (!visited[roots[i]]) {
+            order_dependencies(map, roots[i], visited, &order_len);
+        }
+    }
+    ERROR_ON(order_len != map->len, "Objects not reachable from link map index %d!", roots[0]);
+}
+
+// System wide preload file, analogous to `/etc/ld.so.preload` of glibc.
+#define PRELOAD_FILE "/etc/dynld.so.preload"
+
+// Read the system wide preload file (scratch) or return 0 if there is none.
+DL_INIT static char* read_preload_file() {
+    const int fd = open(PRELOAD_FILE, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    char* list = 0;
+    if (fstat(fd, &st) == 0) {
+        list = scratch_alloc(st.st_size + 1);
+        const long res = read(fd, list, st.st_size);
+        list[res > 0 ? res : 0] = '\0';
+    }
+    close(fd);
+    return list;
+}
+
+// Check if `c` separates entries of a preload list.
+DL_INIT static bool is_preload_sep(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == ':';
+}
+
+// Check if the preloaded object `name` exists. Names containing a `/` are used
+// as path directly by `find_library`, hence only they are checked here.
+DL_INIT static bool preload_exists(const char* name) {
+    for (const char* c = name; *c; ++c) {
+        if (*c == '/') {
+            const int fd = open(name, O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            close(fd);
+            return true;
+        }
+    }
+    return true;
+}
+
+// Discover the objects of the preload list `list` (entries separated by
+// whitespace or colons) with the search paths `sp` and store their discovery
+// indices in `roots` if not 0. Objects not found are skipped with a warning,
+// as done by glibc.
+// Returns the number of objects in the list.
+DL_INIT static unsigned discover_preloads(Discovery* d, const char* list, const SearchPath* sp, uint32_t* roots) {
+    unsigned len = 0;
+    while (list && *list) {
+        if (is_preload_sep(*list)) {
+            ++list;
+            continue;
+        }
+        unsigned name_len = 0;
+        while (list[name_len] && !is_preload_sep(list[name_len])) {
+            ++name_len;
+        }
+
+        if (roots) {
+            char name[name_len + 1];
+            memcpy(name, list, name_len);
+            name[name_len] = '\0';
+            const int idx = preload_exists(name) ? try_discover_object(d, name, sp) : -1;
+            if (idx == -1) {
+                efmt("Preloaded object '%s' not found, ignored!\n", name);
+                list += name_len;
+                continue;
+            }
+            roots[len] = idx;
+        }
+        len += 1;
+        list += name_len;
+    }
+    return len;
+}
+
+// Lazy dependency loading (opt-in via `DYNLD_LAZY=1`).
+//
+// Direct dependencies of the main program, which it only calls through the
+// PLT, are not mapped on startup (see `lazy_defer`). The `JUMP_SLOT`
+// relocations not resolved by the loaded objects keep pointing to their PLT
+// entry, the first call through it enters `dynresolve`, which loads the
+// deferred dependencies in `DT_NEEDED` order (mapped, relocated and
+// initialized like by `dlopen`) until one of them provides the function.
+//
+// Deferred dependencies come after all other objects in the symbol lookup
+// order and are initialized on the first call into them.
+typedef struct {
+    bool enabled;      // Lazy dependency loading enabled.
+    uint64_t* needed;  // `DT_NEEDED` entries of the main program deferred (allocated).
+    uint32_t len;      // Number of `needed` entries.
+    uint32_t next;     // Next entry of `needed` to load.
+} LazyDeps;
+
+static LazyDeps gLazy;
+
+// Load the next deferred dependency, returns `false` if all are loaded.
+static bool lazy_load_next(LinkMap* map);
+
+DL_INIT static void lazy_init(const SystemVDescriptor* sysv, const PrelinkCache* cache) {
+    const char* lazy = get_env(sysv, "DYNLD_LAZY");
+    // The prelink cache and direct binding record the objects of the link map
+    // on startup, hence they are not combined with deferred dependencies.
+    gLazy.enabled = lazy && strcmp(lazy, "1") == 0 && cache->path == 0 && get_env(sysv, "DYNLD_DIRECT") == 0;
+}
+
+// Check if `prog` references symbols defined by the file `fd` other than
+// through `R_X86_64_JUMP_SLOT` relocations, by looking them up in the hash
+// table (`DT_HASH`) of the file.
+// Returns `false` if the file can't be checked.
+DL_INIT static bool lazy_check_file(const Dso* prog, int fd, const char* path) {
+    // ELF header and program headers (from the first page only).
+    uint8_t page[PAGE_SIZE];
+    const long len = pread(fd, page, sizeof(page), 0);
+    const Elf64Ehdr* ehdr = (const Elf64Ehdr*)page;
+    if (len < (long)sizeof(Elf64Ehdr) || check_ehdr(ehdr) != 0 || ehdr->phoff + sizeof(Elf64Phdr) * ehdr->phnum > (uint64_t)len) {
+        return false;
+    }
+
+    DsoImage img = {0};
+    img.path = path;
+    img.phdr = (Elf64Phdr*)(page + ehdr->phoff);
+    img.phnum = ehdr->phnum;
+    const Elf64Phdr* dynamic = 0;
+    for (unsigned i = 0; i < img.phnum; ++i) {
+        if (img.phdr[i].type == PT_TLS) {
+            // The static TLS area is only set up once on startup.
+            return false;
+        }
+        if (img.phdr[i].type == PT_DYNAMIC) {
+            dynamic = &img.phdr[i];
+        }
+    }
+    if (dynamic == 0 || dynamic->filesz < sizeof(Elf64Dyn)) {
+        return false;
+    }
+
+    Elf64Dyn dyn[dynamic->filesz / sizeof(Elf64Dyn)];
+    if (pread(fd, dyn, sizeof(dyn), dynamic->offset) != (long)sizeof(dyn)) {
+        return false;
+    }
+    uint64_t hash = 0;
+    uint64_t symtab = 0;
+    uint64_t strtab = 0;
+    uint64_t strsz = 0;
+    for (unsigned i = 0; i < sizeof(dyn) / sizeof(Elf64Dyn) && dyn[i].tag != DT_NULL; ++i) {
+        if (dyn[i].tag == DT_HASH) {
+            hash = dyn[i].val;
+        } else if (dyn[i].tag == DT_SYMTAB) {
+            symtab = dyn[i].val;
+        } else if (dyn[i].tag == DT_STRTAB) {
+            strtab = dyn[i].val;
+        } else if (dyn[i].tag == DT_STRSZ) {
+            strsz = dyn[i].val;
+        }
+    }
+    // Number of buckets and chains of the hash table.
+    uint32_t nhash[2];
+    const uint64_t hashoff = hash ? vaddr_to_offset(&img, hash) : 0;
+    if (hash == 0 || symtab == 0 || strtab == 0 || pread(fd, nhash, sizeof(nhash), hashoff) != sizeof(nhash) || nhash[0] == 0) {
+        return false;
+    }
+
+    const uint64_t tabsz = sizeof(uint32_t) * (nhash[0] + nhash[1]);
+    const uint64_t symsz = sizeof(Elf64Sym) * nhash[1];
+    uint32_t* tab = scratch_alloc(tabsz);
+    Elf64Sym* syms = scratch_alloc(symsz);
+    char* strs = scratch_alloc(strsz + 1);
+    bool defer = pread(fd, tab, tabsz, hashoff + sizeof(nhash)) == (long)tabsz &&
+                 pread(fd, syms, symsz, vaddr_to_offset(&img, symtab)) == (long)symsz &&
+                 pread(fd, strs, strsz, vaddr_to_offset(&img, strtab)) == (long)strsz;
+    strs[strsz] = '\0';
+
+    const uint32_t* buckets = tab;
+    const uint32_t* chains = tab + nhash[0];
+    for (uint64_t r = 0; r < get_num_relocs(prog) && defer; ++r) {
+        const Elf64Rela* reloc = get_any_reloca(prog, r);
+        const uint64_t symidx = ELF64_R_SYM(reloc->info);
+        if (symidx == 0 || ELF64_R_TYPE(reloc->info) == R_X86_64_JUMP_SLOT) {
+            continue;
+        }
+        const char* symname = get_str(prog, get_sym(prog, symidx)->name);
+        for (uint32_t s = buckets[elf_hash(symname) % nhash[0]]; s != 0 && s < nhash[1] && defer; s = chains[s]) {
+            const unsigned bind = ELF64_ST_BIND(syms[s].info);
+            if (syms[s].shndx != SHN_UNDEF && (bind == STB_GLOBAL || bind == STB_WEAK) && syms[s].name < strsz &&
+                strcmp(strs + syms[s].name, symname) == 0) {
+                defer = false;
+            }
+        }
+    }
+    return defer;
+}
+
+// Check if the direct dependency `name` of the main program `prog` can be
+// deferred: it has no `PT_TLS` segment and `prog` only calls its functions
+// through the PLT (eg it doesn't reference its variables or take the address
+// of its functions).
+//
+// Only the headers and the hash, symbol and string tables of the dependency
+// are read, dependencies without an ELF hash table are not deferred.
+DL_INIT static bool lazy_defer(const Dso* prog, const char* name, const SearchPath* sp, const char* ld_library_path) {
+    const char* path = find_library(name, sp, ld_library_path);
+    if (path == 0) {
+        return false;
+    }
+    bool defer = false;
+    const int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        defer = lazy_check_file(prog, fd, path);
+        close(fd);
+    }
+    if (path != name) {
+        dealloc((void*)path);
+    }
+    return defer;
+}
+
+// Load the preloaded objects and all direct and indirect dependencies of the
+// main program `prog` into the empty link map `map`.
+//
+// The objects listed in the `LD_PRELOAD` environment variable and in the
+// system wide preload file are discovered right before the direct dependencies
+// of the main program. They are placed in the link map right after the main
+// program, such that their symbols interpose the symbols of all dependencies.
+// Interposition is hence decided once by the order of the link map, the
+// symbol lookup itself doesn't special case preloaded objects. As the main
+// program is searched first, `R_X86_64_COPY` relocations (which start the
+// search after the main program) also bind to the preloaded objects first.
+//
+// The dependency graph is discovered breadth-first from the `DT_NEEDED`
+// entries read from the dependency files (see `discover_objects`).
+// Each dependency is only loaded once, dependencies are de-duplicated by the
+// requested name, `DT_SONAME` and the identity (device, inode) of the file.
+// Dependencies are searched as described in `find_library`.
+// Once the full graph is known all dependencies are mapped into one region
+// right below the dynamic linker (see `map_objects`).
+//
+// With lazy dependency loading the deferred direct dependencies of `prog` are
+// recorded in `gLazy` instead (see `lazy_defer`), unless another object
+// depends on them as well.
+//
+// Returns the start of the region.
+DL_INIT static uint8_t* load_dependencies(LinkMap* map, const Dso* prog, const SearchPath* prog_search, const SystemVDescriptor* sysv,
+                                  PrelinkCache* cache) {
+    link_map_reserve(map, 1);
+    map->dso[0] = *prog;
+    map->dso[0].refcnt = 1;
+    map->len = 1;
+
+    Discovery d = {0};
+    d.map = map;
+    d.cap = 8;
+    d.imgs = scratch_alloc(sizeof(DsoImage) * d.cap);
+    d.ld_library_path = get_env(sysv, "LD_LIBRARY_PATH");
+
+    // Discover preloaded objects and direct dependencies of the main program
+    // (first level). The roots are the preloaded objects followed by the main
+    // program, its dependencies are stored right after them.
+    const char* ld_preload = get_env(sysv, "LD_PRELOAD");
+    char* preload_file = read_preload_file();
+    const unsigned preload_cap = discover_preloads(&d, ld_preload, prog_search, 0 /* roots */) +
+                                 discover_preloads(&d, preload_file, prog_search, 0 /* roots */);
+    uint32_t* roots = scratch_alloc(sizeof(uint32_t) * (preload_cap + 1 + prog->needed_len));
+    unsigned preload_len = discover_preloads(&d, ld_preload, prog_search, roots);
+    preload_len += discover_preloads(&d, preload_file, prog_search, roots + preload_len);
+
+    // The `DT_NEEDED` entries of the main program are compacted to the
+    // dependencies loaded now.
+    roots[preload_len] = 0;
+    uint32_t* prog_deps = roots + preload_len + 1;
+    unsigned prog_deps_len = 0;
+    gLazy.needed = gLazy.enabled && prog->needed_len ? alloc(sizeof(uint64_t) * prog->needed_len) : 0;
+    for (unsigned i = 0; i < prog->needed_len; ++i) {
+        const char* name = get_str(prog, prog->needed[i]);
+        if (gLazy.enabled && lazy_defer(prog, name, prog_search, d.ld_library_path)) {
+            gLazy.needed[gLazy.len++] = prog->needed[i];
+            continue;
+        }
+        map->dso[0].needed[prog_deps_len] = prog->needed[i];
+        prog_deps[prog_deps_len++] = discover_dependency(&d, name, *prog_search);
+    }
+    ERROR_ON(!discover_objects(&d), "%s!", d.error);
+
+    uint8_t* region = map_objects(map, &d, roots, preload_len + 1 + prog_deps_len, (const uint8_t*)sysv->auxv[AT_BASE], cache);
+    map->preload_len = preload_len;
+
+    // Deferred dependencies loaded anyway by another object are not deferred.
+    unsigned lazy_len = 0;
+    for (unsigned i = 0; i < gLazy.len; ++i) {
+        const int idx = find_object_by_name(map, get_str(prog, gLazy.needed[i]));
+        if (idx == -1) {
+            gLazy.needed[lazy_len++] = gLazy.needed[i];
+        } else {
+            map->dso[0].needed[prog_deps_len] = gLazy.needed[i];
+            prog_deps[prog_deps_len++] = idx;
+        }
+    }
+    gLazy.len = lazy_len;
+    map->dso[0].needed_len = prog_deps_len;
+
+    // The main program holds a reference on its dependencies, preloaded
+    // objects are referenced until exit.
+    map->dso[0].deps = prog_deps_len ? alloc(sizeof(uint32_t) * prog_deps_len) : 0;
+    for (unsigned i = 0; i < prog_deps_len; ++i) {
+        map->dso[0].deps[i] = prog_deps[i];
+        map->dso[prog_deps[i]].refcnt += 1;
+    }
+    for (unsigned i = 0; i < preload_len; ++i) {
+        map->dso[roots[i]].refcnt += 1;
+    }
+
+    // Preloaded objects are initialized first, eg a preloaded allocator is
+    // ready once the constructors of the dependencies run.
+    order_objects(map, 0 /* first */, roots, preload_len + 1);
+    return region;
+}
+
+// }}}
+// {{{ Direct Binding
+
+// Direct binding records for each symbol referenced by an object which
+// object provided it, such that later starts look up the symbol in that
+// object directly instead of walking the whole link map. The cost of a lookup
+// then doesn't grow with the length of the link map.
+//
+// The providers are recorded relative to the referencing object (see
+// `DirectProvider`) in a sidecar file, written by the dynamic linker after
+// resolving the relocations. Each object is identified by its `FileId`, hence
+// records of unchanged objects stay valid if other objects change.
+// If a symbol is not found in the recorded provider the full link map is
+// searched and the record is updated.
+//
+// Direct binding is opt-in by setting `DYNLD_DIRECT` to the path of the
+// sidecar file. It bypasses interposition by objects earlier in the link map,
+// hence it is disabled if objects are preloaded.
+//
+// Sidecar file layout:
+//   DirectHeader
+//   DirectRecord + uint32_t[nsyms]  For each object (padded to 8 bytes).
+
+#define DIRECT_MAGIC 0x31524944444c5944ull  // "DYLDDIR1"
+
+// Provider of a symbol relative to the referencing object.
+typedef enum {
+    DIRECT_NONE,    // Unknown, search the link map.
+    DIRECT_MAIN,    // Main program.
+    DIRECT_SELF,    // Referencing object itself.
+    DIRECT_NEEDED,  // `DT_NEEDED` entry `n` of the referencing object (`DIRECT_NEEDED + n`).
+} DirectProvider;
+
+typedef struct {
+    uint64_t magic;     // Must be `DIRECT_MAGIC`.
+    uint32_t nrecords;  // Number of `DirectRecord` entries.
+    uint32_t reserved;
+} DirectHeader;
+
+typedef struct {
+    FileId id;       // Identity of the referencing object.
+    uint32_t nsyms;  // Number of dynamic symbols, one provider each.
+    uint32_t reserved;
+} DirectRecord;
+
+typedef struct {
+    const char* path;  // Path of the sidecar file (0 if direct binding is disabled).
+    FileId prog_id;    // Identity of the main program file.
+    bool dirty;        // Providers changed since the sidecar file was read.
+} DirectBinding;
+
+static DirectBinding gDirect;
+
+// Setup direct binding if enabled by the `DYNLD_DIRECT` environment variable
+// and no objects are preloaded into `map`.
+DL_INIT static void direct_init(const SystemVDescriptor* sysv, const LinkMap* map) {
+    const char* path = get_env(sysv, "DYNLD_DIRECT");
+    if (path && *path && map->preload_len == 0 && get_exec_id(sysv, &gDirect.prog_id)) {
+        gDirect.path = path;
+    }
+}
+
+static const FileId* direct_object_id(const LinkMap* map, uint32_t idx) {
+    return idx == 0 ? &gDirect.prog_id : &map->dso[idx].id;
+}
+
+// Allocate the provider tables of all objects in `map` and fill them from the
+// sidecar file.
+DL_INIT static void direct_load(LinkMap* map) {
+    if (gDirect.path == 0) {
+        return;
+    }
+    for (unsigned i = 0; i < map->len; ++i) {
+        Dso* dso = &map->dso[i];
+        const uint64_t nsyms = get_num_dynsyms(dso);
+        dso->direct = alloc(sizeof(uint32_t) * nsyms);
+        memset(dso->direct, 0 /* byte */, sizeof(uint32_t) * nsyms);
+    }
+    gDirect.dirty = true;
+
+    const int fd = open(gDirect.path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    uint8_t* buf = 0;
+    if (fstat(fd, &st) == 0 && st.st_size >= (long)sizeof(DirectHeader)) {
+        buf = scratch_alloc(st.st_size);
+        if (read(fd, buf, st.st_size) != st.st_size) {
+            buf = 0;
+        }
+    }
+    close(fd);
+    if (buf == 0) {
+        return;
+    }
+
+    const DirectHeader* hdr = (const DirectHeader*)buf;
+    uint64_t off = sizeof(DirectHeader);
+    unsigned matched = 0;
+    for (uint32_t r = 0; hdr->magic == DIRECT_MAGIC && r < hdr->nrecords && off + sizeof(DirectRecord) <= (uint64_t)st.st_size; ++r) {
+        const DirectRecord* rec = (const DirectRecord*)(buf + off);
+        const uint64_t providers_len = sizeof(uint32_t) * rec->nsyms;
+        off = align_up(off + sizeof(DirectRecord) + providers_len, 8);
+        if (off > (uint64_t)st.st_size) {
+            break;
+        }
+
+        for (unsigned i = 0; i < map->len; ++i) {
+            if (memcmp(direct_object_id(map, i), &rec->id, sizeof(FileId)) == 0 && get_num_dynsyms(&map->dso[i]) == rec->nsyms) {
+                memcpy(map->dso[i].direct, rec + 1, providers_len);
+                matched += 1;
+                break;
+            }
+        }
+    }
+    gDirect.dirty = matched != map->len;
+}
+
+// Get the object in `map` recorded as provider `provider` of a symbol
+// referenced by the object at link map index `idx` (0 if unknown).
+static const Dso* direct_provider(const LinkMap* map, uint32_t idx, uint32_t provider) {
+    const Dso* dso = &map->dso[idx];
+    if (provider == DIRECT_MAIN) {
+        return &map->dso[0];
+    } else if (provider == DIRECT_SELF) {
+        return dso;
+    } else if (provider >= DIRECT_NEEDED && provider - DIRECT_NEEDED < dso->needed_len) {
+        return &map->dso[dso->deps[provider - DIRECT_NEEDED]];
+    }
+    return 0;
+}
+
+// Record the object at link map index `def` as provider of the symbol
+// `symidx` referenced by the object at link map index `idx`.
+static void direct_record(const LinkMap* map, uint32_t idx, uint64_t symidx, uint32_t def) {
+    const Dso* dso = &map->dso[idx];
+    if (dso->direct == 0) {
+        return;
+    }
+
+    uint32_t provider = DIRECT_NONE;
+    if (def == 0) {
+        provider = DIRECT_MAIN;
+    } else if (def == idx) {
+        provider = DIRECT_SELF;
+    } else {
+        // Symbols provided by indirect dependencies are not recorded.
+        for (unsigned n = 0; n < dso->needed_len && provider == DIRECT_NONE; ++n) {
+            provider = dso->deps[n] == def ? DIRECT_NEEDED + n : DIRECT_NONE;
+        }
+    }
+    if (dso->direct[symidx] != provider) {
+        dso->direct[symidx] = provider;
+        gDirect.dirty = true;
+    }
+}
+
+// Write the providers of all objects in `map` to the sidecar file if they
+// changed.
+DL_INIT static void direct_store(const LinkMap* map) {
+    if (gDirect.path == 0 || !gDirect.dirty) {
+        return;
+    }
+
+    uint64_t len = sizeof(DirectHeader);
+    for (unsigned i = 0; i < map->len; ++i) {
+        len = align_up(len + sizeof(DirectRecord) + sizeof(uint32_t) * get_num_dynsyms(&map->dso[i]), 8);
+    }
+    uint8_t* buf = scratch_alloc(len);
+    memset(buf, 0 /* byte */, len);
+
+    DirectHeader* hdr = (DirectHeader*)buf;
+    hdr->magic = DIRECT_MAGIC;
+    hdr->nrecords = map->len;
+    uint64_t off = sizeof(DirectHeader);
+    for (unsigned i = 0; i < map->len; ++i) {
+        DirectRecord* rec = (DirectRecord*)(buf + off);
+        rec->id = *direct_object_id(map, i);
+        rec->nsyms = get_num_dynsyms(&map->dso[i]);
+        memcpy(rec + 1, map->dso[i].direct, sizeof(uint32_t) * rec->nsyms);
+        off = align_up(off + sizeof(DirectRecord) + sizeof(uint32_t) * rec->nsyms, 8);
+    }
+
+    const size_t path_len = strlen(gDirect.path) + 16;
+    char tmp[path_len];
+    fmt(tmp, path_len, "%s.%d", gDirect.path, getpid());
+
+    const int fd = creat(tmp, 0644);
+    if (fd >= 0) {
+        const bool ok = write_all(fd, buf, len);
+        close(fd);
+        if (!ok || rename(tmp, gDirect.path) != 0) {
+            unlink(tmp);
+        }
+    }
+}
+
+// }}}
+// {{{ Debugger Interface
+
+// Debuggers (eg gdb) and profilers find the loaded objects via the `r_debug`
+// protocol of the SVR4 ABI as implemented by glibc.
+//
+// The address of `_r_debug` is stored in the `DT_DEBUG` entry of the main
+// program, `_r_debug.map` lists the loaded objects in link map order followed
+// by the dynamic linker itself. Each change of the list is announced by a call
+// to `_dl_debug_state` (`_r_debug.brk`), where debuggers place a breakpoint:
+//   1. `state = RT_ADD` or `RT_DELETE`, call `_dl_debug_state`.
+//   2. Update the list.
+//   3. `state = RT_CONSISTENT`, call `_dl_debug_state`.
+
+// Entry of the `r_debug` object list (`struct link_map` in glibc).
+typedef struct DebugLinkMap {
+    uint64_t addr;              // Base address.
+    const char* name;           // Path of the object file ("" for the main program).
+    const Elf64Dyn* ld;         // `.dynamic` section.
+    struct DebugLinkMap* next;  // Next object in lookup order.
+    struct DebugLinkMap* prev;  // Previous object in lookup order.
+} DebugLinkMap;
+
+// State of the object list (`r_state`).
+enum {
+    RT_CONSISTENT,  // List is consistent.
+    RT_ADD,         // Objects are being added.
+    RT_DELETE,      // Objects are being removed.
+};
+
+// `struct r_debug` in glibc.
+typedef struct {
+    int32_t version;     // Protocol version.
+    DebugLinkMap* map;   // Loaded objects (allocated).
+    uint64_t brk;        // Address of `_dl_debug_state`.
+    int32_t state;       // `RT_*` state of `map`.
+    uint64_t ldbase;     // Base address of the dynamic linker.
+} RDebug;
+
+// Named as in glibc, such that tools can find it by symbol as well.
+RDebug _r_debug;
+
+// Entry of the dynamic linker itself in `_r_debug.map`.
+static DebugLinkMap gDebugSelf;
+
+// `.dynamic` section of the dynamic linker (defined by the static linker).
+extern const Elf64Dyn _DYNAMIC[] __attribute__((visibility("hidden")));
+
+// Breakpoint location of debuggers, called on each change of `_r_debug.map`.
+__attribute__((noinline)) __attribute__((used)) void _dl_debug_state() {
+    asm volatile("" ::: "memory");
+}
+
+// Publish `_r_debug` via the `DT_DEBUG` entry of the main program `prog` and
+// setup the entry of the dynamic linker.
+DL_INIT static void debug_init(const SystemVDescriptor* sysv, const Dso* prog) {
+    _r_debug.version = 1;
+    _r_debug.brk = (uint64_t)&_dl_debug_state;
+    _r_debug.ldbase = sysv->auxv[AT_BASE];
+
+    // The path of the dynamic linker is the program interpreter.
+    gDebugSelf.addr = sysv->auxv[AT_BASE];
+    gDebugSelf.name = "";
+    gDebugSelf.ld = _DYNAMIC;
+    for (unsigned i = 0; i < prog->phnum; ++i) {
+        if (prog->phdr[i].type == PT_INTERP) {
+            gDebugSelf.name = (const char*)(prog->base + prog->phdr[i].vaddr);
+        }
+    }
+
+    for (Elf64Dyn* dyn = prog->dyn; dyn->tag != DT_NULL; ++dyn) {
+        if (dyn->tag == DT_DEBUG) {
+            dyn->val = (uint64_t)&_r_debug;
+        }
+    }
+}
+
+// Announce that objects are added (`RT_ADD`) or removed (`RT_DELETE`).
+static void debug_begin(int32_t state) {
+    _r_debug.state = state;
+    _dl_debug_state();
+}
+
+// Rebuild the object list from `map` and announce that it is consistent.
+static void debug_end(const LinkMap* map) {
+    if (_r_debug.map && _r_debug.map != &gDebugSelf) {
+        dealloc(_r_debug.map);
+    }
+
+    DebugLinkMap* list = alloc(sizeof(DebugLinkMap) * map->len);
+    for (unsigned i = 0; i < map->len; ++i) {
+        const Dso* dso = &map->dso[i];
+        list[i].addr = (uint64_t)dso->base;
+        list[i].name = dso->path ? dso->path : "";
+        list[i].ld = dso->dyn;
+        list[i].prev = i == 0 ? 0 : &list[i - 1];
+        list[i].next = i + 1 == map->len ? &gDebugSelf : &list[i + 1];
+    }
+    gDebugSelf.prev = &list[map->len - 1];
+    _r_debug.map = list;
+
+    _r_debug.state = RT_CONSISTENT;
+    _dl_debug_state();
+}
+
+// }}}
+// {{{ perf Map
+
+// perf(1) symbolizes addresses in processes without access to the object
+// files via `/tmp/perf-<pid>.map`, listing one symbol per line:
+//   <start> <size> <name>
+// The map lists the exported functions of each loaded object, named
+// `<object>:<function>`.
+//
+// Writing the map is opt-in by setting `DYNLD_PERF_MAP=1`. It is written
+// before control is transferred to the main program (after forking in zygote
+// mode) and objects loaded by `dlopen` are appended.
+
+static bool gPerfMap;
+
+// Setup the perf map if enabled by the `DYNLD_PERF_MAP` environment variable.
+DL_INIT static void perf_map_init(const SystemVDescriptor* sysv) {
+    const char* perf_map = get_env(sysv, "DYNLD_PERF_MAP");
+    gPerfMap = perf_map && strcmp(perf_map, "1") == 0;
+}
+
+// Write the exported functions of the objects in `map` starting from link map
+// index `first` to the perf map, the map is truncated if `first` is 0.
+static void perf_map_write(const LinkMap* map, uint32_t first) {
+    if (!gPerfMap) {
+        return;
+    }
+
+    char path[32];
+    fmt(path, sizeof(path), "/tmp/perf-%d.map", getpid());
+    const int fd = first == 0 ? creat(path, 0644) : open(path, O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        return;
+    }
+
+    char line[512];
+    for (unsigned i = first; i < map->len; ++i) {
+        const Dso* dso = &map->dso[i];
+        const char* object = dso->name ? dso->name : "<main>";
+        for (unsigned s = 0; s < get_num_dynsyms(dso); ++s) {
+            const Elf64Sym* sym = get_sym(dso, s);
+            if (ELF64_ST_TYPE(sym->info) != STT_FUNC || sym->shndx == SHN_UNDEF || sym->size == 0) {
+                continue;
+            }
+            const int n = fmt(line, sizeof(line), "%lx %lx %s:%s\n", dso->base + sym->value, sym->size, object, get_str(dso, sym->name));
+            write_all(fd, line, n < (int)sizeof(line) ? n : (int)sizeof(line) - 1);
+        }
+    }
+    close(fd);
+}
+
+// }}}
+// {{{ Thread Local Storage
+
+enum {
+    // Static TLS reserved for objects with TLS loaded by `dlopen`.
+    TLS_SURPLUS = 1024,
+    // Minimal alignment of the thread pointer.
+    TLS_MIN_ALIGN = 64,
+};
+
+// Thread control block, the thread pointer (`%fs`) points to it.
+//
+// Only the fields accessed by compiler generated code are provided, the
+// layout follows the x86_64 ABI (as used by glibc).
+typedef struct {
+    void* tcb;               // Self pointer, read by `mov %fs:0`.
+    void* dtv;               // Dynamic thread vector (unused, static TLS only).
+    void* self;              // Self pointer.
+    uint64_t reserved[2];    //
+    uint64_t stack_guard;    // Stack protector canary, read by `%fs:0x28`.
+    uint64_t pointer_guard;  // Pointer mangling guard, read by `%fs:0x30`.
+} Tcb;
+
+// Layout of the static TLS area.
+//
+// All TLS blocks are placed below the thread pointer (x86_64 variant II):
+//
+//          +-----------+ <- tp - offsets[n]
+//          | module n  |
+//          +-----------+
+//          |    ...    |
+//          +-----------+ <- tp - offsets[1]
+//          | module 1  |   (main program)
+//   tp ->  +-----------+
+//          |    Tcb    |
+//          +-----------+
+//
+// The offset of each block is fixed once assigned, such that the initial-exec
+// model (`R_X86_64_TPOFF64`) can be used by all objects, including objects
+// loaded by `dlopen` which get their block from the surplus.
+typedef struct {
+    uint8_t* tp;         // Thread pointer of the main thread.
+    uint64_t size;       // Size of the static TLS area below `tp`.
+    uint64_t used;       // Bytes of the static TLS area assigned to modules.
+    uint64_t align;      // Alignment of `tp`.
+    uint64_t* offsets;   // Offset of the TLS block below `tp` by module id (allocated, 0 if unused).
+    uint64_t nmodules;   // Number of module ids assigned (module ids start at 1).
+    uint64_t cap;        // Capacity of `offsets`.
+} TlsState;
+
+static TlsState gTls;
+
+// Get the `PT_TLS` program header of `dso` or 0 if it has no TLS.
+static const Elf64Phdr* get_tls_phdr(const Dso* dso) {
+    for (unsigned i = 0; i < dso->phnum; ++i) {
+        if (dso->phdr[i].type == PT_TLS) {
+            return &dso->phdr[i];
+        }
+    }
+    return 0;
+}
+
+// Assign module ids and static TLS blocks to the objects with TLS starting
+// from link map index `first`.
+//
+// At startup the static TLS area is not yet allocated and grows as needed
+// (see `tls_setup`), afterwards blocks are taken from the surplus.
+static void tls_layout(LinkMap* map, uint32_t first) {
+    for (unsigned i = first; i < map->len; ++i) {
+        Dso* dso = &map->dso[i];
+        const Elf64Phdr* tls = get_tls_phdr(dso);
+        if (tls == 0) {
+            continue;
+        }
+
+        const uint64_t align = tls->align ? tls->align : 1;
+        const uint64_t offset = align_up(gTls.used + tls->memsz, align);
+        if (gTls.tp) {
+            ERROR_ON(offset > gTls.size || align > gTls.align, "Static TLS exhausted, can't load TLS block of '%s'!", dso->name);
+        } else if (align > gTls.align) {
+            gTls.align = align;
+        }
+        gTls.used = offset;
+
+        if (gTls.nmodules + 1 >= gTls.cap) {
+            const uint64_t cap = gTls.cap ? gTls.cap * 2 : 8;
+            uint64_t* offsets = alloc(sizeof(uint64_t) * cap);
+            memset(offsets, 0 /* byte */, sizeof(uint64_t) * cap);
+            if (gTls.offsets) {
+                memcpy(offsets, gTls.offsets, sizeof(uint64_t) * gTls.cap);
+                dealloc(gTls.offsets);
+            }
+            gTls.offsets = offsets;
+            gTls.cap = cap;
+        }
+
+        dso->tls_modid = ++gTls.nmodules;
+        dso->tls_offset = offset;
+        gTls.offsets[dso->tls_modid] = offset;
+    }
+}
+
+// Allocate the static TLS area of the main thread with the blocks assigned by
+// `tls_layout` plus the surplus, and install the thread pointer.
+DL_INIT static void tls_setup(const SystemVDescriptor* sysv) {
+    if (gTls.align < TLS_MIN_ALIGN) {
+        gTls.align = TLS_MIN_ALIGN;
+    }
+    ERROR_ON(gTls.align > PAGE_SIZE, "TLS alignment %d not supported!", gTls.align);
+
+    gTls.size = align_up(gTls.used + TLS_SURPLUS, gTls.align);
+    uint8_t* area = mmap(0 /* addr */, gTls.size + sizeof(Tcb), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1 /* fd */, 0 /* off */);
+    ERROR_ON(area == MAP_FAILED, "Failed to allocate static TLS area!");
+    gTls.tp = area + gTls.size;
+
+    Tcb* tcb = (Tcb*)gTls.tp;
+    tcb->tcb = tcb;
+    tcb->self = tcb;
+    if (sysv->auxv[AT_RANDOM]) {
+        memcpy(&tcb->stack_guard, (const void*)sysv->auxv[AT_RANDOM], sizeof(tcb->stack_guard));
+        // The low byte is zero to stop string overflows from leaking the canary.
+        tcb->stack_guard &= ~0xffull;
+        memcpy(&tcb->pointer_guard, (const uint8_t*)sysv->auxv[AT_RANDOM] + 8, sizeof(tcb->pointer_guard));
+    }
+
+    ERROR_ON(arch_prctl(ARCH_SET_FS, (unsigned long)gTls.tp) != 0, "Failed to set the thread pointer!");
+}
+
+// Initialize the TLS blocks of the objects starting from link map index
+// `first` in the static TLS area below `tp` from their TLS initialization
+// images.
+//
+// Must be called after relocations are resolved, as the initialization images
+// may be subject to relocations.
+static void tls_init_blocks(const LinkMap* map, uint32_t first, uint8_t* tp) {
+    for (unsigned i = first; i < map->len; ++i) {
+        const Dso* dso = &map->dso[i];
+        const Elf64Phdr* tls = get_tls_phdr(dso);
+        if (tls == 0) {
+            continue;
+        }
+        uint8_t* block = tp - dso->tls_offset;
+        memcpy(block, dso->base + tls->vaddr, tls->filesz);
+        memset(block + tls->filesz, 0 /* byte */, tls->memsz - tls->filesz);
+    }
+}
+
+// Argument of `__tls_get_addr`, generated by the general-dynamic and
+// local-dynamic TLS models (see `R_X86_64_DTPMOD64`, `R_X86_64_DTPOFF64`).
+typedef struct {
+    uint64_t module;  // Module id.
+    uint64_t offset;  // Offset into the TLS block of the module.
+} TlsIndex;
+
+// Implementation of `__tls_get_addr`.
+//
+// All TLS blocks live in the static TLS area, hence the address is computed
+// relative to the thread pointer of the calling thread without taking any
+// lock or allocating memory.
+static void* tls_get_addr(const TlsIndex* ti) {
+    uint8_t* tp;
+    asm("mov %%fs:0, %0" : "=r"(tp));
+    return tp - gTls.offsets[ti->module] + ti->offset;
+}
+
+// Release the module id of `dso`.
+//
+// The static TLS block is not reused, the surplus is consumed by each `dlopen`
+// of an object with TLS.
+static void tls_release(const Dso* dso) {
+    if (dso->tls_modid) {
+        gTls.offsets[dso->tls_modid] = 0;
+    }
+}
+
+// }}}
+// {{{ Relocation Statistics
+
+// Each page patched by a relocation becomes a private copy-on-write copy of
+// the process. The relocation statistics show the cost of each object of the
+// link map in private pages, with one line per object:
+//   relocs    Number of relocations resolved.
+//   dirty     Distinct pages written by relocations.
+//   per-page  Relocations per dirty page (dense is better).
+//   writable  Pages of writable `PT_LOAD` segments.
+//   resident  Resident pages of all `PT_LOAD` segments after startup (`mincore`).
+//
+// The statistics are opt-in by setting `DYNLD_RELOC_STATS` to the path of the
+// report, which is written right before control is transferred to the main
+// program. On a prelink cache hit no relocations are resolved and only the
+// residency is reported.
+
+typedef struct {
+    const char* path;  // Path of the report (0 if disabled).
+    uint32_t len;      // Number of objects tracked (link map indices below `len`).
+    uint64_t* relocs;  // Number of relocations by link map index (allocated).
+    uint8_t** dirty;   // Bitmap of dirty pages by link map index (allocated).
+} RelocStats;
+
+static RelocStats gRelocStats;
+
+// Setup the relocation statistics of the objects in `map` if enabled by the
+// `DYNLD_RELOC_STATS` environment variable.
+DL_INIT static void reloc_stats_init(const SystemVDescriptor* sysv, const LinkMap* map) {
+    const char* path = get_env(sysv, "DYNLD_RELOC_STATS");
+    if (path == 0 || *path == '\0') {
+        return;
+    }
+    gRelocStats.path = path;
+    gRelocStats.len = map->len;
+    gRelocStats.relocs = alloc(sizeof(uint64_t) * map->len);
+    gRelocStats.dirty = alloc(sizeof(uint8_t*) * map->len);
+    for (unsigned i = 0; i < map->len; ++i) {
+        uint64_t start, end;
+        get_load_span(&map->dso[i], &start, &end);
+        const uint64_t bitmap_len = ((end - start) / PAGE_SIZE + 7) / 8;
+        gRelocStats.relocs[i] = 0;
+        gRelocStats.dirty[i] = alloc(bitmap_len);
+        memset(gRelocStats.dirty[i], 0 /* byte */, bitmap_len);
+    }
+}
+
+// Record the pages written by the relocation `reloc` of the object at link
+// map index `idx`.
+static void reloc_stats_record(const Dso* dso, uint32_t idx, const Elf64Rela* reloc) {
+    if (idx >= gRelocStats.len) {
+        return;
+    }
+    uint64_t start, end;
+    get_load_span(dso, &start, &end);
+
+    const uint64_t size = ELF64_R_TYPE(reloc->info) == R_X86_64_COPY ? get_sym(dso, ELF64_R_SYM(reloc->info))->size : sizeof(uint64_t);
+    const uint64_t addr = (uint64_t)dso->base + reloc->offset;
+    for (uint64_t page = (addr - start) / PAGE_SIZE; page <= (addr + (size ? size : 1) - 1 - start) / PAGE_SIZE; ++page) {
+        gRelocStats.dirty[idx][page / 8] |= 1 << (page % 8);
+    }
+    gRelocStats.relocs[idx] += 1;
+}
+
+// Count the resident and writable pages of the `PT_LOAD` segments of `dso`.
+DL_INIT static void count_load_pages(const Dso* dso, uint64_t* resident, uint64_t* writable) {
+    *resident = 0;
+    *writable = 0;
+    for (unsigned i = 0; i < dso->phnum; ++i) {
+        const Elf64Phdr* ph = &dso->phdr[i];
+        if (ph->type != PT_LOAD) {
+            continue;
+        }
+        const uint64_t start = (uint64_t)dso->base + (ph->vaddr & ~(PAGE_SIZE - 1));
+        const uint64_t npages = ((uint64_t)dso->base + align_up(ph->vaddr + ph->memsz, PAGE_SIZE) - start) / PAGE_SIZE;
+        if (ph->flags & PF_W) {
+            *writable += npages;
+        }
+
+        uint8_t vec[npages];
+        if (mincore((void*)start, npages * PAGE_SIZE, vec) == 0) {
+            for (unsigned p = 0; p < npages; ++p) {
+                *resident += vec[p] & 1;
+            }
+        }
+    }
+}
+
+// Write the relocation statistics report of the tracked objects of `map`.
+DL_INIT static void reloc_stats_store(const LinkMap* map) {
+    if (gRelocStats.path == 0) {
+        return;
+    }
+    const int fd = creat(gRelocStats.path, 0644);
+    if (fd < 0) {
+        return;
+    }
+
+    char line[512];
+    int n = fmt(line, sizeof(line), "# object relocs dirty per-page writable resident\n");
+    write_all(fd, line, n);
+    for (unsigned i = 0; i < gRelocStats.len && i < map->len; ++i) {
+        const Dso* dso = &map->dso[i];
+        uint64_t start, end;
+        get_load_span(dso, &start, &end);
+        uint64_t dirty = 0;
+        for (uint64_t page = 0; page < (end - start) / PAGE_SIZE; ++page) {
+            dirty += (gRelocStats.dirty[i][page / 8] >> (page % 8)) & 1;
+        }
+        uint64_t resident, writable;
+        count_load_pages(dso, &resident, &writable);
+
+        // Relocations per dirty page with one decimal.
+        const uint64_t per_page = dirty ? gRelocStats.relocs[i] * 10 / dirty : 0;
+        char ratio[32];
+        fmt(ratio, sizeof(ratio), "%ld.%ld", per_page / 10, per_page % 10);
+
+        n = fmt(line, sizeof(line), "%s %ld %ld %s %ld %ld\n", dso->name ? dso->name : "<main>", gRelocStats.relocs[i], dirty, ratio,
+                writable, resident);
+        write_all(fd, line, n < (int)sizeof(line) ? n : (int)sizeof(line) - 1);
+    }
+    close(fd);
+
+    // The report is final, objects relocated later (eg replaced by
+    // `dlreplace`) are not tracked.
+    gRelocStats.len = 0;
+}
+
+// }}}
+// {{{ Resolve relocations
+
+// Lookup symbols provided by the dynamic linker itself (see `dynld.h`).
+static void* lookup_builtin(const char* symname);
+
+// Don't trace each resolved relocation (opt-in via `DYNLD_QUIET=1`), eg when
+// benchmarking objects with many relocations.
+static bool gQuiet;
+
+// Context of the relocation hooks (see `RelocScope`).
+typedef struct {
+    const LinkMap* map;    // Link map defining the order of the symbol lookup.
+    PrelinkCache* cache;   // Prelink cache recording fixups (may be 0).
+    const char* missing;   // First undefined non-weak symbol (0 if none).
+} RelocCtx;
+
+// Resolve a TLS relocation of `dso`.
+//
+// TLS symbols are resolved to the module id of the defining object and the
+// offset in its TLS block, or to the offset from the thread pointer for the
+// initial-exec model. Relocations without symbol refer to the TLS block of
+// `dso` itself (local-dynamic model).
+static void resolve_tls_reloc(const RelocScope* scope, const Dso* dso, const Elf64Rela* reloc) {
+    const LinkMap* map = ((const RelocCtx*)scope->ctx)->map;
+    const int symidx = ELF64_R_SYM(reloc->info);
+    const char* symname = get_str(dso, get_sym(dso, symidx)->name);
+    const uint32_t ver = get_sym_version(dso, symidx);
+    const unsigned reloctype = ELF64_R_TYPE(reloc->info);
+
+    const Dso* def = symidx == 0 ? dso : 0;
+    uint64_t symoff = 0;
+    for (unsigned i = 0; i < map->len && def == 0; ++i) {
+        const Elf64Sym* sym = find_sym(&map->dso[i], symname, ver, true /* tls */);
+        if (sym) {
+            def = &map->dso[i];
+            symoff = sym->value;
+        }
+    }
+    if (def == 0) {
+        RelocCtx* ctx = scope->ctx;
+        ctx->missing = ctx->missing ? ctx->missing : symname;
+        return;
+    }
+    ERROR_ON(def->tls_modid == 0, "TLS symbol %s defined by object without PT_TLS!", symname);
+
+    uint64_t value = 0;
+    if (reloctype == R_X86_64_DTPMOD64) {
+        value = def->tls_modid;
+    } else if (reloctype == R_X86_64_DTPOFF64) {
+        value = symoff + reloc->addend;
+    } else {
+        value = symoff + reloc->addend - def->tls_offset;
+    }
+
+    if (!gQuiet) {
+        pfmt("Resolved TLS reloc %s to 0x%lx (module %d)\n", symidx ? symname : "<local>", value, def->tls_modid);
+    }
+
+    *(uint64_t*)(dso->base + reloc->offset) = value;
+    reloc_stats_record(dso, dso - map->dso, reloc);
+}
+
+// Lookup the symbol referenced by the relocation `reloc` of `dso` in the link
+// map.
+//
+// With direct binding the recorded provider is tried first, the link map is
+// only searched if that fails. `R_X86_64_COPY` relocations skip the main
+// program (see `relocate`).
+// Symbols not provided by any object may be provided by the vDSO or the
+// dynamic linker itself, those relocations are recorded in the prelink cache.
+static void* lookup_reloc(const RelocScope* scope, const Dso* dso, const Elf64Rela* reloc, const char* symname, uint32_t ver) {
+    const RelocCtx* ctx = scope->ctx;
+    const LinkMap* map = ctx->map;
+    const uint32_t symidx = ELF64_R_SYM(reloc->info);
+    const uint32_t idx = dso - map->dso;
+    const bool copy = ELF64_R_TYPE(reloc->info) == R_X86_64_COPY;
+
+    void* symaddr = 0;
+    if (dso->direct && !copy) {
+        const Dso* provider = direct_provider(map, idx, dso->direct[symidx]);
+        symaddr = provider ? lookup_sym(&gLoader, provider, symname, ver) : 0;
+    }
+    for (unsigned i = (copy ? 1 : 0); i < map->len && symaddr == 0; ++i) {
+        symaddr = lookup_sym(&gLoader, &map->dso[i], symname, ver);
+        if (symaddr && !copy) {
+            direct_record(map, idx, symidx, i);
+        }
+    }
+    if (symaddr || copy) {
+        return symaddr;
+    }
+
+    symaddr = lookup_vdso(symname);
+    if (symaddr) {
+        cache_add_fixup(ctx->cache, (uint64_t)(dso->base + reloc->offset), get_reloc_value(reloc, symaddr), FIXUP_VDSO);
+        return symaddr;
+    }
+    symaddr = lookup_builtin(symname);
+    if (symaddr) {
+        cache_add_fixup(ctx->cache, (uint64_t)(dso->base + reloc->offset), get_reloc_value(reloc, symaddr), FIXUP_DYNLD);
+    }
+    return symaddr;
+}
+
+// Defer the relocation `reloc` of `dso` whose symbol was not found.
+//
+// Functions not found may be provided by a deferred dependency. The slot
+// keeps pointing to the PLT entry (re-based), the first call enters
+// `dynresolve`.
+static bool defer_reloc(const RelocScope* scope, const Dso* dso, const Elf64Rela* reloc, const char* symname) {
+    if (ELF64_R_TYPE(reloc->info) != R_X86_64_JUMP_SLOT || gLazy.next >= gLazy.len) {
+        return false;
+    }
+    *(uint64_t*)(dso->base + reloc->offset) += (uint64_t)dso->base;
+    if (!gQuiet) {
+        pfmt("Deferred reloc %s (base %p)\n", symname, dso->base);
+    }
+    reloc_stats_record(dso, dso - ((const RelocCtx*)scope->ctx)->map->dso, reloc);
+    return true;
+}
+
+// Handle the relocation `reloc` of `dso` whose symbol was not found.
+//
+// Functions may be provided by a deferred dependency (see `defer_reloc`),
+// undefined weak symbols resolve to `0`. Other undefined symbols are recorded
+// in the context and their relocations are left untouched.
+static bool unresolved_reloc(const RelocScope* scope, const Dso* dso, const Elf64Rela* reloc, const char* symname) {
+    if (defer_reloc(scope, dso, reloc, symname)) {
+        return true;
+    }
+    if (ELF64_ST_BIND(get_sym(dso, ELF64_R_SYM(reloc->info))->info) == STB_WEAK) {
+        return false;
+    }
+    RelocCtx* ctx = scope->ctx;
+    ctx->missing = ctx->missing ? ctx->missing : symname;
+    return true;
+}
+
+// Trace the resolved relocation `reloc` of `dso` and record it in the
+// relocation statistics.
+static void trace_reloc(const RelocScope* scope, const Dso* dso, const Elf64Rela* reloc, const char* symname, const void* symaddr) {
+    const unsigned reloctype = ELF64_R_TYPE(reloc->info);
+    if (!gQuiet) {
+        pfmt("Resolved reloc %s to %p (base %p)\n",
+             reloctype == R_X86_64_RELATIVE ? "<relative>" : (reloctype == R_X86_64_IRELATIVE ? "<irelative>" : symname), symaddr, dso->base);
+    }
+    reloc_stats_record(dso, dso - ((const RelocCtx*)scope->ctx)->map->dso, reloc);
+}
+
+// Apply relocations in target page order (opt-in via `DYNLD_RELOC_ORDER=page`).
+static bool gRelocByPage;
+
+// Resolve all relocations of `dso`.
+//
+// Use `map` as link map which defines the order of the symbol lookup.
+// Undefined weak symbols which are not found resolve to `0`. Relocations
+// resolved to symbols of the vDSO or the dynamic linker are recorded in the
+// prelink `cache` (may be 0).
+// Returns the first undefined non-weak symbol, or 0 if all relocations are
+// resolved.
+static const char* resolve_relocs(const Dso* dso, const LinkMap* map, PrelinkCache* cache) {
+    RelocCtx ctx = {map, cache, 0 /* missing */};
+    RelocScope scope = {0};
+    scope.dsos = map->dso;
+    scope.len = map->len;
+    scope.by_page = gRelocByPage;
+    scope.ctx = &ctx;
+    scope.lookup = lookup_reloc;
+    scope.resolve_tls = resolve_tls_reloc;
+    scope.unresolved = unresolved_reloc;
+    scope.resolved = trace_reloc;
+    relocate_object(&gLoader, dso, &scope);
+    return ctx.missing;
+}
+
+// }}}
+// {{{ Dynamic Linking (lazy resolve)
+
+// Bind the `R_X86_64_JUMP_SLOT` relocation on the first call through the PLT
+// (see `Lazy dependency loading`).
+static void* dynresolve(uint64_t got1, uint64_t reloc_idx);
+
+// Dynamic link handler for lazy resolve.
+// This handler is installed in the GOT[2] entry of `Dso` objects which holds
+// the address of the jump target for the PLT0 jump pad.
+//
+// The argument registers of the call being bound are saved around the call
+// to `dynresolve`, which returns the function the handler jumps to. Only the
+// lower halves (`xmm`) of the vector argument registers are saved.
+//
+// Mark `dynresolve_entry` as `naked` because we don't want a prologue/epilogue
+// being generated so we have full control over the stack layout.
+//
+// `noreturn`  Function never returns.
+// `naked`     Don't generate prologue/epilogue sequences.
+__attribute__((noreturn)) __attribute__((naked)) static void dynresolve_entry() {
+    asm("dynresolve_entry:\n\t"
+        // Save integer argument registers, `%rax` holds the number of vector
+        // registers used by a variadic call.
+        "push %rax\n\t"
+        "push %rcx\n\t"
+        "push %rdx\n\t"
+        "push %rsi\n\t"
+        "push %rdi\n\t"
+        "push %r8\n\t"
+        "push %r9\n\t"
+        // Save vector argument registers, the stack is 16 byte aligned now.
+        "sub $128, %rsp\n\t"
+        "movdqa %xmm0, 0(%rsp)\n\t"
+        "movdqa %xmm1, 16(%rsp)\n\t"
+        "movdqa %xmm2, 32(%rsp)\n\t"
+        "movdqa %xmm3, 48(%rsp)\n\t"
+        "movdqa %xmm4, 64(%rsp)\n\t"
+        "movdqa %xmm5, 80(%rsp)\n\t"
+        "movdqa %xmm6, 96(%rsp)\n\t"
+        "movdqa %xmm7, 112(%rsp)\n\t"
+        // Arguments pushed by the PLT pads, passed in rdi/rsi as defined by
+        // the SystemV abi.
+        "mov 184(%rsp), %rdi\n\t"  // GOT[1] entry (pushed by PLT0 pad).
+        "mov 192(%rsp), %rsi\n\t"  // Relocation index (pushed by PLT pad).
+        "call dynresolve\n\t"
+        "mov %rax, %r11\n\t"
+        "movdqa 0(%rsp), %xmm0\n\t"
+        "movdqa 16(%rsp), %xmm1\n\t"
+        "movdqa 32(%rsp), %xmm2\n\t"
+        "movdqa 48(%rsp), %xmm3\n\t"
+        "movdqa 64(%rsp), %xmm4\n\t"
+        "movdqa 80(%rsp), %xmm5\n\t"
+        "movdqa 96(%rsp), %xmm6\n\t"
+        "movdqa 112(%rsp), %xmm7\n\t"
+        "add $128, %rsp\n\t"
+        "pop %r9\n\t"
+        "pop %r8\n\t"
+        "pop %rdi\n\t"
+        "pop %rsi\n\t"
+        "pop %rdx\n\t"
+        "pop %rcx\n\t"
+        "pop %rax\n\t"
+        // Drop the arguments of the PLT pads and enter the bound function.
+        "add $16, %rsp\n\t"
+        "jmp *%r11");
+}
+
+// }}}
+// {{{ PLT Profiler
+
+// The PLT profiler counts the calls through each `R_X86_64_JUMP_SLOT` of the
+// loaded objects, ie the calls of imported functions, without recompiling
+// them.
+//
+// Once the relocations are resolved, each `JUMP_SLOT` GOT entry is redirected
+// to a thunk generated by the dynamic linker, which counts the call and jumps
+// to the resolved function:
+//
+//   lock incq  calls(%rip)
+//   jmp        *target(%rip)
+//
+// In cycles mode the thunk instead passes its slot in `%r11` (scratch at
+// function entry) to `prof_enter`, which also hooks the return address to
+// measure the TSC cycles spent in the callee (including nested calls):
+//
+//   lea        slot(%rip), %r11
+//   jmp        *enter(%rip)
+//
+// The profile is written at exit, after running the finalizers, with one line
+// per slot sorted by the number of calls:
+//
+//   <calls> <cycles> <importing object> <function>
+//
+// Profiling is opt-in by setting `DYNLD_PROFILE` to the path of the profile,
+// cycles are measured if `DYNLD_PROFILE_CYCLES=1` is set. The return address
+// hooks are kept on a single stack of `PROF_MAX_DEPTH` frames, hence cycles
+// mode is only supported for single threaded programs; deeper calls are only
+// counted.
+
+#define PROF_THUNK_SIZE 16
+#define PROF_MAX_DEPTH  256
+
+typedef struct {
+    uint64_t target;      // Address of the imported function (read by the thunk).
+    uint64_t calls;       // Number of calls through the slot.
+    uint64_t cycles;      // TSC cycles spent in the callee (cycles mode only).
+    const char* object;   // Name of the importing object (allocated).
+    const char* symname;  // Name of the imported function (allocated).
+} ProfSlot;
+
+// Thunks and slots of the objects profiled at once, the thunks are placed in
+// the first pages followed by the `ProfRegion` header and the slots.
+typedef struct ProfRegion {
+    struct ProfRegion* next;  // Previously installed region.
+    uint64_t enter;           // Address of `prof_enter` (read by cycles mode thunks).
+    uint8_t* map_start;       // Start of the mapping holding the region.
+    uint64_t nslots;          // Number of `slots`.
+    ProfSlot slots[];         //
+} ProfRegion;
+
+// Return address hook of a call in cycles mode.
+typedef struct {
+    ProfSlot* slot;  // Slot the call went through.
+    uint64_t ret;    // Original return address.
+    uint64_t start;  // TSC at the time of the call.
+} ProfFrame;
+
+typedef struct {
+    const char* path;                    // Path of the profile (0 if profiling is disabled).
+    bool cycles;                         // Measure cycles spent in the callees.
+    ProfRegion* regions;                 // Installed regions, most recent first.
+    ProfFrame frames[PROF_MAX_DEPTH];    // Hooked return addresses.
+    uint32_t depth;                      // Number of `frames` in use.
+} PltProfiler;
+
+static PltProfiler gProf;
+
+static uint64_t rdtsc() {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (uint64_t)hi << 32 | lo;
+}
+
+__attribute__((noreturn)) __attribute__((naked)) static void prof_exit();
+
+// Entry of calls through cycles mode thunks, `%r11` holds the slot.
+//
+// All argument registers are preserved, the arguments of `prof_enter_hook`
+// are the slot and the location of the return address of the call.
+__attribute__((noreturn)) __attribute__((naked)) static void prof_enter() {
+    asm("prof_enter:\n\t"
+        "push %rax\n\t"  // Number of vector registers used by varargs.
+        "push %rdi\n\t"
+        "push %rsi\n\t"
+        "push %rdx\n\t"
+        "push %rcx\n\t"
+        "push %r8\n\t"
+        "push %r9\n\t"
+        "sub $128, %rsp\n\t"
+        "movdqu %xmm0, 0(%rsp)\n\t"
+        "movdqu %xmm1, 16(%rsp)\n\t"
+        "movdqu %xmm2, 32(%rsp)\n\t"
+        "movdqu %xmm3, 48(%rsp)\n\t"
+        "movdqu %xmm4, 64(%rsp)\n\t"
+        "movdqu %xmm5, 80(%rsp)\n\t"
+        "movdqu %xmm6, 96(%rsp)\n\t"
+        "movdqu %xmm7, 112(%rsp)\n\t"
+        "mov %r11, %rdi\n\t"       // Slot.
+        "lea 184(%rsp), %rsi\n\t"  // Return address, above the saved registers.
+        "call prof_enter_hook\n\t"
+        "mov %rax, %r11\n\t"  // Target.
+        "movdqu 0(%rsp), %xmm0\n\t"
+        "movdqu 16(%rsp), %xmm1\n\t"
+        "movdqu 32(%rsp), %xmm2\n\t"
+        "movdqu 48(%rsp), %xmm3\n\t"
+        "movdqu 64(%rsp), %xmm4\n\t"
+        "movdqu 80(%rsp), %xmm5\n\t"
+        "movdqu 96(%rsp), %xmm6\n\t"
+        "movdqu 112(%rsp), %xmm7\n\t"
+        "add $128, %rsp\n\t"
+        "pop %r9\n\t"
+        "pop %r8\n\t"
+        "pop %rcx\n\t"
+        "pop %rdx\n\t"
+        "pop %rsi\n\t"
+        "pop %rdi\n\t"
+        "pop %rax\n\t"
+        "jmp *%r11");
+}
+
+// Hooked return address of calls in cycles mode, the return value registers
+// are preserved.
+__attribute__((noreturn)) __attribute__((naked)) static void prof_exit() {
+    asm("prof_exit:\n\t"
+        "push %rax\n\t"
+        "push %rdx\n\t"
+        "sub $32, %rsp\n\t"
+        "movdqu %xmm0, 0(%rsp)\n\t"
+        "movdqu %xmm1, 16(%rsp)\n\t"
+        "call prof_exit_hook\n\t"
+        "mov %rax, %r11\n\t"  // Original return address.
+        "movdqu 0(%rsp), %xmm0\n\t"
+        "movdqu 16(%rsp), %xmm1\n\t"
+        "add $32, %rsp\n\t"
+        "pop %rdx\n\t"
+        "pop %rax\n\t"
+        "jmp *%r11");
+}
+
+// Count the call through `slot` and hook the return address at `ret`.
+// Returns the address of the imported function.
+__attribute__((used)) static uint64_t prof_enter_hook(ProfSlot* slot, uint64_t* ret) {
+    slot->calls += 1;
+    if (gProf.depth < PROF_MAX_DEPTH) {
+        ProfFrame* frame = &gProf.frames[gProf.depth++];
+        frame->slot = slot;
+        frame->ret = *ret;
+        *ret = (uint64_t)&prof_exit;
+        frame->start = rdtsc();
+    }
+    return slot->target;
+}
+
+// Account the cycles of the innermost hooked call.
+// Returns its original return address.
+__attribute__((used)) static uint64_t prof_exit_hook() {
+    const uint64_t now = rdtsc();
+    ProfFrame* frame = &gProf.frames[--gProf.depth];
+    frame->slot->cycles += now - frame->start;
+    return frame->ret;
+}
+
+// Setup profiling if enabled by the `DYNLD_PROFILE` environment variable.
+DL_INIT static void prof_init(const SystemVDescriptor* sysv) {
+    const char* path = get_env(sysv, "DYNLD_PROFILE");
+    if (path && *path) {
+        gProf.path = path;
+        const char* cycles = get_env(sysv, "DYNLD_PROFILE_CYCLES");
+        gProf.cycles = cycles && strcmp(cycles, "1") == 0;
+    }
+}
+
+// Store the 32 bit displacement from `next` (the end of the instruction) to
+// `target` at `at`.
+static uint8_t* prof_emit_rel32(uint8_t* at, const uint8_t* next, const void* target) {
+    const int64_t rel = (const uint8_t*)target - next;
+    ERROR_ON(rel != (int32_t)rel, "Profiling thunk out of range!");
+    const int32_t rel32 = rel;
+    memcpy(at, &rel32, sizeof(rel32));
+    return at + sizeof(rel32);
+}
+
+// Emit the thunk for `slot` at `thunk`.
+static void prof_emit_thunk(uint8_t* thunk, ProfSlot* slot, const ProfRegion* region) {
+    uint8_t* pc = thunk;
+    if (gProf.cycles) {
+        // lea slot(%rip), %r11
+        *pc++ = 0x4c;
+        *pc++ = 0x8d;
+        *pc++ = 0x1d;
+        pc = prof_emit_rel32(pc, pc + 4, slot);
+        // jmp *enter(%rip)
+        *pc++ = 0xff;
+        *pc++ = 0x25;
+        pc = prof_emit_rel32(pc, pc + 4, &region->enter);
+    } else {
+        // lock incq calls(%rip)
+        *pc++ = 0xf0;
+        *pc++ = 0x48;
+        *pc++ = 0xff;
+        *pc++ = 0x05;
+        pc = prof_emit_rel32(pc, pc + 4, &slot->calls);
+        // jmp *target(%rip)
+        *pc++ = 0xff;
+        *pc++ = 0x25;
+        pc = prof_emit_rel32(pc, pc + 4, &slot->target);
+    }
+    while (pc < thunk + PROF_THUNK_SIZE) {
+        *pc++ = 0xcc;  // int3
+    }
+}
+
+// Redirect the resolved `JUMP_SLOT` GOT entries of the objects in `map`
+// starting from link map index `first` to profiling thunks.
+static void prof_install(const LinkMap* map, uint32_t first) {
+    if (gProf.path == 0) {
+        return;
+    }
+
+    uint64_t nslots = 0;
+    for (unsigned i = first; i < map->len; ++i) {
+        const Dso* dso = &map->dso[i];
+        for (unsigned long relocidx = 0; relocidx < (dso->dynamic[DT_PLTRELSZ] / sizeof(Elf64Rela)); ++relocidx) {
+            nslots += ELF64_R_TYPE(get_pltreloca(dso, relocidx)->info) == R_X86_64_JUMP_SLOT;
+        }
+    }
+    if (nslots == 0) {
+        return;
+    }
+
+    // Thunks and slots are mapped together, such that they are reachable with
+    // 32 bit displacements.
+    const uint64_t code_len = align_up(nslots * PROF_THUNK_SIZE, PAGE_SIZE);
+    const uint64_t len = code_len + align_up(sizeof(ProfRegion) + nslots * sizeof(ProfSlot), PAGE_SIZE);
+    uint8_t* start = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ERROR_ON(start == MAP_FAILED, "Failed to map profiling thunks!");
+
+    ProfRegion* region = (ProfRegion*)(start + code_len);
+    region->enter = (uint64_t)&prof_enter;
+    region->map_start = start;
+
+    for (unsigned i = first; i < map->len; ++i) {
+        const Dso* dso = &map->dso[i];
+        for (unsigned long relocidx = 0; relocidx < (dso->dynamic[DT_PLTRELSZ] / sizeof(Elf64Rela)); ++relocidx) {
+            const Elf64Rela* reloc = get_pltreloca(dso, relocidx);
+            uint64_t* got = (uint64_t*)(dso->base + reloc->offset);
+            if (ELF64_R_TYPE(reloc->info) != R_X86_64_JUMP_SLOT || *got == 0 /* undefined weak */) {
+                continue;
+            }
+
+            // Names are copied, the object may be unloaded before the
+            // profile is written.
+            ProfSlot* slot = &region->slots[region->nslots];
+            slot->target = *got;
+            slot->object = strdup(dso->name ? dso->name : "<main>");
+            slot->symname = strdup(get_str(dso, get_sym(dso, ELF64_R_SYM(reloc->info))->name));
+
+            uint8_t* thunk = start + region->nslots * PROF_THUNK_SIZE;
+            prof_emit_thunk(thunk, slot, region);
+            *got = (uint64_t)thunk;
+            region->nslots += 1;
+        }
+    }
+    ERROR_ON(mprotect(start, code_len, PROT_READ | PROT_EXEC) != 0, "Failed to protect profiling thunks!");
+
+    region->next = gProf.regions;
+    gProf.regions = region;
+}
+
+// Get the slot of the profiling thunk at `addr`, or 0 if `addr` is not a
+// thunk.
+static ProfSlot* prof_find_slot(uint64_t addr) {
+    for (ProfRegion* region = gProf.regions; region; region = region->next) {
+        const uint64_t start = (uint64_t)region->map_start;
+        if (addr >= start && addr < start + region->nslots * PROF_THUNK_SIZE) {
+            return &region->slots[(addr - start) / PROF_THUNK_SIZE];
+        }
+    }
+    return 0;
+}
+
+// Write the profile of all installed regions.
+static void prof_store() {
+    if (gProf.path == 0) {
+        return;
+    }
+
+    uint64_t nslots = 0;
+    for (const ProfRegion* region = gProf.regions; region; region = region->next) {
+        nslots += region->nslots;
+    }
+    if (nslots == 0) {
+        return;
+    }
+
+    // Sort slots by the number of calls, most called first (insertion sort).
+    const ProfSlot** slots = alloc(sizeof(ProfSlot*) * nslots);
+    uint64_t len = 0;
+    for (const ProfRegion* region = gProf.regions; region; region = region->next) {
+        for (unsigned i = 0; i < region->nslots; ++i) {
+            const ProfSlot* slot = &region->slots[i];
+            uint64_t pos = len++;
+            for (; pos > 0 && slots[pos - 1]->calls < slot->calls; --pos) {
+                slots[pos] = slots[pos - 1];
+            }
+            slots[pos] = slot;
+        }
+    }
+
+    const int fd = creat(gProf.path, 0644);
+    if (fd >= 0) {
+        char line[512];
+        for (unsigned i = 0; i < nslots; ++i) {
+            const int n = fmt(line, sizeof(line), "%ld %ld %s %s\n", slots[i]->calls, slots[i]->cycles, slots[i]->object, slots[i]->symname);
+            write_all(fd, line, n < (int)sizeof(line) ? n : (int)sizeof(line) - 1);
+        }
+        close(fd);
+    }
+    dealloc(slots);
+}
+
+// }}}
+// {{{ Setup GOT
+
+static void setup_got(const Dso* dso) {
+    // GOT entries {0, 1, 2} have special meaning for the dynamic link process.
+    //   GOT[0]     Hold address of dynamic structure referenced by `_DYNAMIC`.
+    //   GOT[1]     Argument pushed by PLT0 pad on stack before jumping to GOT[2],
+    //              can be freely used by dynamic linker to identify the caller.
+    //   GOT[2]     Jump target for PLT0 pad when doing dynamic resolve (lazy).
+    //
+    // We will not make use of GOT[0] here. GOT[1] holds the base address of
+    // the object, which identifies the caller in `dynresolve`.
+
+    // Install dynamic resolve handler. This handler is used when binding
+    // symbols lazy.
+    //
+    // The handler is installed in the `GOT[2]` entry for each DSO object that
+    // has a GOT. It is jumped to from the `PLT0` pad with the following two
+    // arguments passed via the stack:
+    //   - GOT[1] entry.
+    //   - Relocation index.
+    //
+    // This can be seen in the following disassembly of section .plt:
+    //   PLT0:
+    //     push   QWORD PTR [rip+0x3002]        # GOT[1]
+    //     jmp    QWORD PTR [rip+0x3004]        # GOT[2]
+    //     nop    DWORD PTR [rax+0x0]
+    //
+    //   PLT1:
+    //     jmp    QWORD PTR [rip+0x3002]        # GOT[3]; entry for <PLT1>
+    //     push   0x0                           # Relocation index
+    //     jmp    401000 <PLT0>
+    //
+    // The handler at GOT[2] finds the arguments right above the saved
+    // registers (see `dynresolve_entry`).
+
+    if (dso->dynamic[DT_PLTGOT] != 0) {
+        uint64_t* got = (uint64_t*)(dso->base + dso->dynamic[DT_PLTGOT]);
+        got[1] = (uint64_t)dso->base;
+        got[2] = (uint64_t)&dynresolve_entry;
+    }
+}
+
+// }}}
+// {{{ Runtime loading (dlopen)
+
+// State of the dynamic linker which is kept after control is transferred to
+// the user program, used by the `dlopen` API (see `dynld.h`).
+typedef struct {
+    LinkMap map;                  // Link map of all loaded objects.
+    SearchPath prog_search;       // Search paths of the main program, used for `dlopen`.
+    const char* ld_library_path;  // Value of the `LD_LIBRARY_PATH` environment variable.
+    const uint8_t* hint;          // Objects loaded by `dlopen` are mapped right below `hint`.
+    Dso* retired;                 // Images replaced by `dlreplace`, unmapped by `dlquiesce` (allocated).
+    uint32_t retired_len;         // Number of `retired` images.
+    uint32_t retired_cap;         // Capacity of `retired`.
+    bool has_error;               // `error` holds an error not yet returned by `dlerror`.
+    char error[256];              // Description of the last error.
+} DlState;
+
+static DlState gDl;
+
+// Handle returned by `dlopen`.
+//
+// Symbols found by `dlsym` are cached per handle in a hash table, such that
+// repeated lookups of a symbol don't walk the symbol tables again.
+struct DlHandle {
+    uint32_t idx;         // Link map index of the object.
+    const char** names;   // Names of the cached symbols, `0` marks an empty bucket (allocated).
+    void** addrs;         // Addresses of the cached symbols (allocated).
+    uint32_t nsyms;       // Number of cached symbols.
+    uint32_t nbuckets;    // Number of buckets (power of two).
+};
+
+static void* sym_cache_get(const DlHandle* h, const char* name) {
+    if (h->nbuckets == 0) {
+        return 0;
+    }
+    for (uint32_t b = elf_hash(name) & (h->nbuckets - 1); h->names[b]; b = (b + 1) & (h->nbuckets - 1)) {
+        if (strcmp(h->names[b], name) == 0) {
+            return h->addrs[b];
+        }
+    }
+    return 0;
+}
+
+static void sym_cache_insert(DlHandle* h, const char* name, void* addr) {
+    uint32_t b = elf_hash(name) & (h->nbuckets - 1);
+    while (h->names[b]) {
+        b = (b + 1) & (h->nbuckets - 1);
+    }
+    h->names[b] = name;
+    h->addrs[b] = addr;
+    h->nsyms += 1;
+}
+
+static void sym_cache_put(DlHandle* h, const char* name, void* addr) {
+    // Grow the hash table to keep the load factor <= 0.5.
+    if (2 * (h->nsyms + 1) > h->nbuckets) {
+        const char** names = h->names;
+        void** addrs = h->addrs;
+        const uint32_t nbuckets = h->nbuckets;
+
+        h->nbuckets = nbuckets ? nbuckets * 2 : 16;
+        h->names = alloc(sizeof(const char*) * h->nbuckets);
+        h->addrs = alloc(sizeof(void*) * h->nbuckets);
+        memset(h->names, 0, sizeof(const char*) * h->nbuckets);
+        h->nsyms = 0;
+
+        for (uint32_t b = 0; b < nbuckets; ++b) {
+            if (names[b]) {
+                sym_cache_insert(h, names[b], addrs[b]);
+            }
+        }
+        if (names) {
+            dealloc(names);
+            dealloc(addrs);
+        }
+    }
+    sym_cache_insert(h, strdup(name), addr);
+}
+
+// Drop all symbols cached in `h`.
+static void sym_cache_clear(DlHandle* h) {
+    for (uint32_t b = 0; b < h->nbuckets; ++b) {
+        if (h->names[b]) {
+            dealloc((void*)h->names[b]);
+        }
+    }
+    if (h->names) {
+        dealloc(h->names);
+        dealloc(h->addrs);
+    }
+    h->names = 0;
+    h->addrs = 0;
+    h->nsyms = 0;
+    h->nbuckets = 0;
+}
+
+static void dl_free_handle(DlHandle* h) {
+    sym_cache_clear(h);
+    dealloc(h);
+}
+
+// Get the handle of the object at link map index `idx`.
+static DlHandle* dl_get_handle(LinkMap* map, uint32_t idx) {
+    Dso* dso = &map->dso[idx];
+    if (dso->handle == 0) {
+        dso->handle = alloc(sizeof(DlHandle));
+        *dso->handle = (DlHandle){0};
+        dso->handle->idx = idx;
+    }
+    return dso->handle;
+}
+
+// Lookup `symname` in the object at link map index `idx` and its direct and
+// indirect dependencies in breadth-first order.
+static void* lookup_local(const LinkMap* map, uint32_t idx, const char* symname) {
+    uint32_t queue[map->len];
+    uint8_t queued[map->len];
+    memset(queued, 0, sizeof(queued));
+
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    queue[tail++] = idx;
+    queued[idx] = 1;
+    while (head < tail) {
+        const Dso* dso = &map->dso[queue[head++]];
+        void* addr = lookup_sym(&gLoader, dso, symname, 0 /* ver */);
+        if (addr) {
+            return addr;
+        }
+        for (unsigned n = 0; n < dso->needed_len; ++n) {
+            if (!queued[dso->deps[n]]) {
+                queued[dso->deps[n]] = 1;
+                queue[tail++] = dso->deps[n];
+            }
+        }
+    }
+    return 0;
+}
+
+// Unmap and release `dso`.
+static void dl_free_object(Dso* dso);
+
+// Remove the objects starting from link map index `first` again, which were
+// mapped but not initialized by a failed `dl_load`.
+static void dl_rollback(LinkMap* map, uint32_t first) {
+    for (unsigned i = first; i < map->len; ++i) {
+        // Drop the references on the objects loaded before.
+        for (unsigned n = 0; n < map->dso[i].needed_len; ++n) {
+            if (map->dso[i].deps[n] < first) {
+                map->dso[map->dso[i].deps[n]].refcnt -= 1;
+            }
+        }
+    }
+    for (unsigned i = first; i < map->len; ++i) {
+        dl_free_object(&map->dso[i]);
+    }
+    map->len = first;
+}
+
+// Load the object `file` and its dependencies not loaded yet, resolve their
+// relocations and run their initializers.
+//
+// Returns the link map index of the object, or `-1` if `file` or one of its
+// dependencies can't be loaded or references an undefined symbol. In that
+// case nothing is loaded and the error is set, prefixed with `api`.
+static int dl_load(LinkMap* map, const char* file, const char* api) {
+    // Search directories may have changed since they were indexed.
+    dir_index_invalidate();
+    const char* path = find_library(file, &gDl.prog_search, gDl.ld_library_path);
+    if (path == 0) {
+        fmt(gDl.error, sizeof(gDl.error), "%s: '%s' not found", api, file);
+        gDl.has_error = true;
+        return -1;
+    }
+    debug_begin(RT_ADD);
+    scratch_enter();
+
+    Discovery d = {0};
+    d.map = map;
+    d.cap = 8;
+    d.imgs = scratch_alloc(sizeof(DsoImage) * d.cap);
+    d.ld_library_path = gDl.ld_library_path;
+
+    uint32_t root = discover_path(&d, strdup(file), path == file ? strdup(path) : path);
+    if (!discover_objects(&d)) {
+        fmt(gDl.error, sizeof(gDl.error), "%s: %s", api, d.error);
+        gDl.has_error = true;
+        discard_images(&d);
+        scratch_leave();
+        debug_end(map);
+        return -1;
+    }
+
+    const uint32_t first = map->len;
+    const uint64_t tls_used = gTls.used;
+    const uint8_t* region = map_objects(map, &d, &root, 1, gDl.hint, 0 /* cache */);
+    order_objects(map, first, &root, 1);
+    tls_layout(map, first);
+
+    for (unsigned i = first; i < map->len; ++i) {
+        const Dso* dso = &map->dso[map->order[i]];
+        const char* missing = resolve_relocs(dso, map, 0 /* cache */);
+        if (missing) {
+            // The symbol name lives in the object, report before unmapping.
+            fmt(gDl.error, sizeof(gDl.error), "%s: undefined symbol '%s' in '%s'", api, missing, dso->path);
+            gDl.has_error = true;
+            dl_rollback(map, first);
+            gTls.used = tls_used;
+            scratch_leave();
+            debug_end(map);
+            return -1;
+        }
+    }
+    scratch_leave();
+    if (region && region < gDl.hint) {
+        gDl.hint = region;
+    }
+    tls_init_blocks(map, first, gTls.tp);
+    for (unsigned i = first; i < map->len; ++i) {
+        setup_got(&map->dso[i]);
+    }
+    prof_install(map, first);
+    debug_end(map);
+    perf_map_write(map, first);
+    for (unsigned i = first; i < map->len; ++i) {
+        init(&map->dso[map->order[i]]);
+    }
+    return root;
+}
+
+// Drop a reference on the object at link map index `idx`, and on its
+// dependencies once the object is not referenced anymore.
+static void dl_release(LinkMap* map, uint32_t idx) {
+    Dso* dso = &map->dso[idx];
+    dso->refcnt -= 1;
+    if (dso->refcnt == 0) {
+        for (unsigned n = 0; n < dso->needed_len; ++n) {
+            dl_release(map, dso->deps[n]);
+        }
+    }
+}
+
+// Unmap `dso` and release its resources.
+static void dl_free_object(Dso* dso) {
+    tls_release(dso);
+    munmap(dso->map_start, dso->map_len);
+    dealloc((void*)dso->phdr);
+    dealloc((void*)dso->name);
+    dealloc((void*)dso->path);
+    if (dso->direct) {
+        dealloc(dso->direct);
+    }
+    if (dso->vers) {
+        dealloc(dso->vers);
+    }
+    if (dso->needed) {
+        dealloc(dso->needed);
+        dealloc(dso->deps);
+    }
+    if (dso->handle) {
+        dl_free_handle(dso->handle);
+    }
+}
+
+// Finalize and unmap all objects which are not referenced anymore and remove
+// them from the link map.
+static void dl_unload(LinkMap* map) {
+    // Finalize in reverse initialization order.
+    for (unsigned i = map->len; i > 0; --i) {
+        if (map->dso[map->order[i - 1]].refcnt == 0) {
+            fini(&map->dso[map->order[i - 1]]);
+        }
+    }
+    debug_begin(RT_DELETE);
+
+    // Unmap and compact the link map.
+    uint32_t remap[map->len];
+    uint32_t len = 0;
+    for (unsigned i = 0; i < map->len; ++i) {
+        Dso* dso = &map->dso[i];
+        if (dso->refcnt != 0) {
+            remap[i] = len;
+            map->dso[len++] = *dso;
+            continue;
+        }
+
+        dl_free_object(dso);
+        remap[i] = (uint32_t)-1;
+    }
+
+    uint32_t order_len = 0;
+    for (unsigned i = 0; i < map->len; ++i) {
+        if (remap[map->order[i]] != (uint32_t)-1) {
+            map->order[order_len++] = remap[map->order[i]];
+        }
+    }
+    for (unsigned i = 0; i < len; ++i) {
+        for (unsigned n = 0; n < map->dso[i].needed_len; ++n) {
+            map->dso[i].deps[n] = remap[map->dso[i].deps[n]];
+        }
+        if (map->dso[i].handle) {
+            map->dso[i].handle->idx = i;
+        }
+    }
+    map->len = len;
+    debug_end(map);
+}
+
+static void* dl_open(const char* file, int mode) {
+    LinkMap* map = &gDl.map;
+
+    int idx = file ? find_object_by_name(map, file) : 0;
+    if (idx == -1 && !(mode & RTLD_NOLOAD)) {
+        idx = dl_load(map, file, "dlopen");
+        if (idx == -1) {
+            return 0;
+        }
+    }
+    if (idx == -1) {
+        fmt(gDl.error, sizeof(gDl.error), "dlopen: '%s' not found", file);
+        gDl.has_error = true;
+        return 0;
+    }
+
+    map->dso[idx].refcnt += 1;
+    return dl_get_handle(map, idx);
+}
+
+// Lookup `symname` in the global scope: all objects of `map` in order, the
+// vDSO and the dynamic linker itself.
+static void* lookup_global(const LinkMap* map, const char* symname, uint32_t ver) {
+    void* addr = 0;
+    for (unsigned i = 0; i < map->len && addr == 0; ++i) {
+        addr = lookup_sym(&gLoader, &map->dso[i], symname, ver);
+    }
+    if (addr == 0) {
+        addr = lookup_vdso(symname);
+    }
+    if (addr == 0) {
+        addr = lookup_builtin(symname);
+    }
+    return addr;
+}
+
+static void* dl_sym(void* handle, const char* name) {
+    LinkMap* map = &gDl.map;
+
+    void* addr = 0;
+    if (handle == RTLD_DEFAULT) {
+        // Deferred dependencies are part of the global scope.
+        addr = lookup_global(map, name, 0 /* ver */);
+        while (addr == 0 && lazy_load_next(map)) {
+            addr = lookup_global(map, name, 0 /* ver */);
+        }
+    } else {
+        DlHandle* h = handle;
+        addr = sym_cache_get(h, name);
+        if (addr == 0) {
+            addr = lookup_local(map, h->idx, name);
+            if (addr) {
+                sym_cache_put(h, name, addr);
+            }
+        }
+    }
+
+    if (addr == 0) {
+        fmt(gDl.error, sizeof(gDl.error), "dlsym: symbol '%s' not found", name);
+        gDl.has_error = true;
+    }
+    return addr;
+}
+
+static int dl_close(void* handle) {
+    LinkMap* map = &gDl.map;
+
+    const DlHandle* h = handle;
+    if (h == 0 || map->dso[h->idx].refcnt == 0) {
+        fmt(gDl.error, sizeof(gDl.error), "dlclose: invalid handle");
+        gDl.has_error = true;
+        return -1;
+    }
+
+    dl_release(map, h->idx);
+    dl_unload(map);
+    return 0;
+}
+
+// Hot swap.
+//
+// `dlreplace` replaces a loaded object with a new version of it without
+// restarting the process:
+//
+//   1. Map the new version and load its dependencies not loaded yet.
+//   2. Put it into the link map slot of the old version, such that its own
+//      references bind to itself, and resolve its relocations.
+//   3. Find all `R_X86_64_JUMP_SLOT` and `R_X86_64_GLOB_DAT` entries of the
+//      other objects (and the PLT profiler slots) bound into the old image and
+//      compute their new values. Fails without changing any entry if the new
+//      version doesn't provide one of the symbols.
+//   4. Run the initializers of the new version.
+//   5. Rewrite the collected entries. Each entry is an aligned 8 byte store,
+//      callers see either the old or the new function but never a torn
+//      address. This is the only step racing with running code, it doesn't
+//      look up symbols or allocate.
+//
+// Threads may still execute in the old image (or hold pointers into it), hence
+// it is only finalized and unmapped by `dlquiesce`, which the program calls at
+// a quiescent point.
+//
+// Not rebound are `R_X86_64_64` relocations into the old image (eg function
+// pointers in data) and addresses obtained by `dlsym` earlier, the `dlsym`
+// caches are flushed. The state of the old version is not transferred, except
+// for the TLS block, which the new version takes over and hence must keep the
+// TLS layout.
+
+// An entry rebound by `dl_replace`.
+typedef struct {
+    uint64_t* slot;  // Address of the GOT entry or PLT profiler slot target.
+    uint64_t value;  // New value.
+} GotUpdate;
+
+typedef struct {
+    GotUpdate* updates;  // (allocated)
+    uint32_t len;        // Number of `updates`.
+    uint32_t cap;        // Capacity of `updates`.
+} GotUpdates;
+
+static void got_updates_add(GotUpdates* u, uint64_t* slot, uint64_t value) {
+    if (u->len == u->cap) {
+        u->cap = u->cap ? u->cap * 2 : 64;
+        GotUpdate* updates = alloc(sizeof(GotUpdate) * u->cap);
+        if (u->updates) {
+            memcpy(updates, u->updates, sizeof(GotUpdate) * u->len);
+            dealloc(u->updates);
+        }
+        u->updates = updates;
+    }
+    u->updates[u->len++] = (GotUpdate){slot, value};
+}
+
+// Collect the entries of all objects of `map` except `idx` bound into the
+// range `[start, end)` of the old image, with the address of the same symbol
+// in the object at link map index `idx`.
+// Returns the name of the first symbol not provided by `idx` or 0.
+static const char* got_updates_collect(const LinkMap* map, uint32_t idx, uint64_t start, uint64_t end, GotUpdates* u) {
+    const Dso* dso = &map->dso[idx];
+    for (unsigned i = 0; i < map->len; ++i) {
+        const Dso* user = &map->dso[i];
+        for (uint64_t relocidx = 0; relocidx < get_num_relocs(user) && i != idx; ++relocidx) {
+            const Elf64Rela* reloc = get_any_reloca(user, relocidx);
+            const unsigned reloctype = ELF64_R_TYPE(reloc->info);
+            uint64_t* slot = (uint64_t*)(user->base + reloc->offset);
+            if ((reloctype != R_X86_64_JUMP_SLOT && reloctype != R_X86_64_GLOB_DAT) || *slot < start || *slot >= end) {
+                continue;
+            }
+            const uint64_t symidx = ELF64_R_SYM(reloc->info);
+            const char* symname = get_str(user, get_sym(user, symidx)->name);
+            void* addr = lookup_sym(&gLoader, dso, symname, get_sym_version(user, symidx));
+            if (addr == 0) {
+                return symname;
+            }
+            got_updates_add(u, slot, (uint64_t)addr);
+        }
+    }
+
+    // Profiled GOT entries point to a thunk, which jumps to the slot target.
+    for (ProfRegion* region = gProf.regions; region; region = region->next) {
+        for (unsigned i = 0; i < region->nslots; ++i) {
+            ProfSlot* slot = &region->slots[i];
+            if (slot->target < start || slot->target >= end) {
+                continue;
+            }
+            void* addr = lookup_sym(&gLoader, dso, slot->symname, 0 /* ver */);
+            if (addr == 0) {
+                return slot->symname;
+            }
+            got_updates_add(u, &slot->target, (uint64_t)addr);
+        }
+    }
+    return 0;
+}
+
+static void* dl_replace(void* handle, const char* file) {
+    LinkMap* map = &gDl.map;
+
+    const DlHandle* h = handle;
+    if (h == 0 || h->idx == 0 || map->dso[h->idx].refcnt == 0) {
+        fmt(gDl.error, sizeof(gDl.error), "dlreplace: invalid handle");
+        gDl.has_error = true;
+        return 0;
+    }
+    const uint32_t idx = h->idx;
+
+    dir_index_invalidate();
+    const char* path = find_library(file, &gDl.prog_search, gDl.ld_library_path);
+    Dso dso;
+    const bool mapped = path && map_object(&gLoader, path, &dso);
+    if (path && path != file) {
+        dealloc((void*)path);
+    }
+    if (!mapped) {
+        fmt(gDl.error, sizeof(gDl.error), "dlreplace: '%s' not found or not a shared object", file);
+        gDl.has_error = true;
+        return 0;
+    }
+
+    // The new version takes over the TLS block of the old one.
+    const Elf64Phdr* tls = get_tls_phdr(&dso);
+    const Elf64Phdr* old_tls = get_tls_phdr(&map->dso[idx]);
+    if (tls && (old_tls == 0 || tls->memsz > old_tls->memsz || tls->align > old_tls->align)) {
+        unmap_object(&dso);
+        fmt(gDl.error, sizeof(gDl.error), "dlreplace: TLS block of '%s' doesn't fit", file);
+        gDl.has_error = true;
+        return 0;
+    }
+
+    // Objects loaded for the new version are unloaded again on failure, as
+    // they are not referenced yet. `dl_load` sets the error.
+    bool failed = false;
+    dso.deps = dso.needed_len ? alloc(sizeof(uint32_t) * dso.needed_len) : 0;
+    for (unsigned n = 0; n < dso.needed_len && !failed; ++n) {
+        const char* name = get_str(&dso, dso.needed[n]);
+        int dep = find_object_by_name(map, name);
+        if (dep == -1) {
+            dep = dl_load(map, name, "dlreplace");
+        }
+        failed = dep == -1;
+        dso.deps[n] = dep;
+    }
+
+    const Dso old = map->dso[idx];
+    GotUpdates updates = {0};
+    if (!failed) {
+        debug_begin(RT_ADD);
+        dso.name = strdup(old.name);
+        dso.refcnt = old.refcnt;
+        dso.handle = old.handle;
+        dso.tls_modid = tls ? old.tls_modid : 0;
+        dso.tls_offset = tls ? old.tls_offset : 0;
+        map->dso[idx] = dso;
+        const char* missing = resolve_relocs(&map->dso[idx], map, 0 /* cache */);
+        if (missing) {
+            fmt(gDl.error, sizeof(gDl.error), "dlreplace: undefined symbol '%s' in '%s'", missing, file);
+        } else {
+            setup_got(&map->dso[idx]);
+
+            uint64_t start, end;
+            get_load_span(&old, &start, &end);
+            missing = got_updates_collect(map, idx, start, end, &updates);
+            if (missing) {
+                fmt(gDl.error, sizeof(gDl.error), "dlreplace: symbol '%s' not provided by '%s'", missing, file);
+            }
+        }
+        if (missing) {
+            map->dso[idx] = old;
+            failed = true;
+        }
+        debug_end(map);
+    }
+
+    if (failed) {
+        if (dso.deps) {
+            dealloc(dso.deps);
+        }
+        if (dso.name != dso.path) {
+            dealloc((void*)dso.name);
+        }
+        unmap_object(&dso);
+        if (updates.updates) {
+            dealloc(updates.updates);
+        }
+        dl_unload(map);
+        gDl.has_error = true;
+        return 0;
+    }
+
+    // Move the references of the old version on its dependencies over to the
+    // new version.
+    for (unsigned n = 0; n < dso.needed_len; ++n) {
+        map->dso[dso.deps[n]].refcnt += 1;
+    }
+    for (unsigned n = 0; n < old.needed_len; ++n) {
+        dl_release(map, old.deps[n]);
+    }
+    init(&map->dso[idx]);
+
+    // Rebind the callers of the old image.
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    DYNLD_PROBE2(swap_start, map->dso[idx].name, map->dso[idx].base);
+    for (uint32_t i = 0; i < updates.len; ++i) {
+        __atomic_store_n(updates.updates[i].slot, updates.updates[i].value, __ATOMIC_RELEASE);
+    }
+    DYNLD_PROBE2(swap_end, map->dso[idx].name, updates.len);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (!gQuiet) {
+        pfmt("Replaced %s (base %p -> %p), rebound %d entries in %ld ns\n", old.name, old.base, map->dso[idx].base, updates.len,
+             (t1.tv_sec - t0.tv_sec) * 1000000000l + (t1.tv_nsec - t0.tv_nsec));
+    }
+    if (updates.updates) {
+        dealloc(updates.updates);
+    }
+
+    // Cached `dlsym` results may point into the old image.
+    for (unsigned i = 0; i < map->len; ++i) {
+        if (map->dso[i].handle) {
+            sym_cache_clear(map->dso[i].handle);
+        }
+    }
+
+    // Retire the old image, the handle and TLS block belong to the new
+    // version now.
+    if (gDl.retired_len == gDl.retired_cap) {
+        gDl.retired_cap = gDl.retired_cap ? gDl.retired_cap * 2 : 4;
+        Dso* retired = alloc(sizeof(Dso) * gDl.retired_cap);
+        if (gDl.retired) {
+            memcpy(retired, gDl.retired, sizeof(Dso) * gDl.retired_len);
+            dealloc(gDl.retired);
+        }
+        gDl.retired = retired;
+    }
+    Dso* retired = &gDl.retired[gDl.retired_len++];
+    *retired = old;
+    retired->handle = 0;
+    retired->tls_modid = tls ? 0 : old.tls_modid;
+    return handle;
+}
+
+static int dl_quiesce() {
+    LinkMap* map = &gDl.map;
+
+    const int len = gDl.retired_len;
+    for (uint32_t i = 0; i < gDl.retired_len; ++i) {
+        fini(&gDl.retired[i]);
+        dl_free_object(&gDl.retired[i]);
+    }
+    gDl.retired_len = 0;
+
+    // Dependencies only referenced by the replaced images.
+    dl_unload(map);
+    return len;
+}
+
+static const char* dl_error() {
+    if (!gDl.has_error) {
+        return 0;
+    }
+    gDl.has_error = false;
+    return gDl.error;
+}
+
+// Symbols provided by the dynamic linker itself (see `dynld.h`).
+//
+// The addresses in the table are subject to `R_X86_64_RELATIVE` relocations,
+// processed by `relocate_self` on startup.
+typedef struct {
+    const char* name;
+    void* addr;
+} Builtin;
+
+static const Builtin gBuiltins[] = {
+    {"dlopen", (void*)&dl_open},
+    {"dlsym", (void*)&dl_sym},
+    {"dlclose", (void*)&dl_close},
+    {"dlerror", (void*)&dl_error},
+    {"dlreplace", (void*)&dl_replace},
+    {"dlquiesce", (void*)&dl_quiesce},
+    {"__tls_get_addr", (void*)&tls_get_addr},
+};
+
+static void* lookup_builtin(const char* symname) {
+    for (unsigned i = 0; i < sizeof(gBuiltins) / sizeof(gBuiltins[0]); ++i) {
+        if (strcmp(symname, gBuiltins[i].name) == 0) {
+            return gBuiltins[i].addr;
+        }
+    }
+    return 0;
+}
+
+// }}}
+// {{{ Lazy Dependency Loading
+
+static bool lazy_load_next(LinkMap* map) {
+    if (gLazy.next == gLazy.len) {
+        return false;
+    }
+    const uint64_t needed = gLazy.needed[gLazy.next++];
+    const char* name = get_str(&map->dso[0], needed);
+
+    // The dependency may have been loaded by `dlopen` in the meantime.
+    int idx = find_object_by_name(map, name);
+    if (idx == -1) {
+        idx = dl_load(map, name, "lazy load");
+    }
+    ERROR_ON(idx == -1, "%s!", gDl.error);
+
+    // Record the dependency of the main program, it holds a reference until
+    // exit.
+    Dso* prog = &map->dso[0];
+    uint64_t* needed_grown = alloc(sizeof(uint64_t) * (prog->needed_len + 1));
+    uint32_t* deps_grown = alloc(sizeof(uint32_t) * (prog->needed_len + 1));
+    if (prog->needed_len) {
+        memcpy(needed_grown, prog->needed, sizeof(uint64_t) * prog->needed_len);
+        memcpy(deps_grown, prog->deps, sizeof(uint32_t) * prog->needed_len);
+        dealloc(prog->needed);
+        dealloc(prog->deps);
+    }
+    needed_grown[prog->needed_len] = needed;
+    deps_grown[prog->needed_len] = idx;
+    prog->needed = needed_grown;
+    prog->deps = deps_grown;
+    prog->needed_len += 1;
+    map->dso[idx].refcnt += 1;
+    return true;
+}
+
+// Called by `dynresolve_entry` with the GOT[1] entry (base address) of the
+// calling object and the index of the `R_X86_64_JUMP_SLOT` relocation in its
+// PLT table. The relocation is patched and the function address returned.
+//
+// `used`  Force to emit code for function (only referenced from asm).
+__attribute__((used)) static void* dynresolve(uint64_t got1, uint64_t reloc_idx) {
+    LinkMap* map = &gDl.map;
+
+    int idx = -1;
+    for (unsigned i = 0; i < map->len && idx == -1; ++i) {
+        idx = (uint64_t)map->dso[i].base == got1 ? (int)i : -1;
+    }
+    ERROR_ON(idx == -1, "dynresolve: No object at base 0x%lx!", got1);
+
+    const Elf64Rela* reloc = get_pltreloca(&map->dso[idx], reloc_idx);
+    const uint64_t symidx = ELF64_R_SYM(reloc->info);
+    const char* symname = get_str(&map->dso[idx], get_sym(&map->dso[idx], symidx)->name);
+    const uint32_t ver = get_sym_version(&map->dso[idx], symidx);
+
+    DYNLD_PROBE1(lazy_bind, symname);
+    void* symaddr = lookup_global(map, symname, ver);
+    while (symaddr == 0 && lazy_load_next(map)) {
+        symaddr = lookup_global(map, symname, ver);
+    }
+    ERROR_ON(symaddr == 0, "Failed lookup symbol %s while binding lazily!", symname);
+
+    // Loading dependencies may have moved the link map.
+    const Dso* dso = &map->dso[idx];
+    if (!gQuiet) {
+        pfmt("Bound reloc %s to %p (base %p)\n", symname, symaddr, dso->base);
+    }
+
+    // A profiled GOT entry points to a thunk, which entered the PLT through
+    // its slot target. The slot target is bound instead, such that later
+    // calls are still counted.
+    ProfSlot* slot = prof_find_slot(*(uint64_t*)(dso->base + reloc->offset));
+    if (slot) {
+        slot->target = (uint64_t)symaddr;
+    } else {
+        patch_reloc(dso, reloc, symaddr);
+    }
+    return symaddr;
+}
+
+// }}}
+// {{{ Zygote
+
+// Zygote mode (fork-server).
+//
+// Each start of a program repeats loading the dependencies, resolving the
+// relocations and running the initializers. If `DYNLD_ZYGOTE` is set to a
+// socket path, the dynamic linker does all of that once and then serves
+// launch requests (see `zygote.h`) on a Unix socket instead of running the
+// program. For each request it forks, and the child transfers control to the
+// program with the arguments, environment and standard file descriptors of
+// the request. Launching a program then costs a single `fork`.
+
+enum {
+    // Backlog of pending connections on the zygote socket.
+    ZYGOTE_BACKLOG = 64,
+};
+
+// Build a new process context block (SystemV ABI layout, see
+// `get_systemv_descriptor`) from the strings of the request `buf` of `len`
+// bytes and the auxiliary vector of `sysv`.
+DL_INIT static const uint64_t* zygote_prctx(const uint8_t* buf, uint64_t len, const SystemVDescriptor* sysv) {
+    ERROR_ON(len < sizeof(ZygoteRequest), "Zygote request truncated!");
+    const ZygoteRequest* req = (const ZygoteRequest*)buf;
+    const uint64_t strc = (uint64_t)req->argc + req->envc;
+
+    unsigned auxc = 0;
+    for (const Auxv64Entry* auxvp = sysv->auxvv; auxvp->tag != AT_NULL; ++auxvp) {
+        ++auxc;
+    }
+
+    // argc | argv[argc] 0 | envv[envc] 0 | auxv[auxc] AT_NULL
+    uint64_t* prctx = alloc(sizeof(uint64_t) * (1 + strc + 2 + 2 * (auxc + 1)));
+    prctx[0] = req->argc;
+
+    // The strings stay in `buf`, only pointers are stored.
+    uint64_t* slot = prctx + 1;
+    uint64_t off = sizeof(ZygoteRequest);
+    for (uint64_t i = 0; i < strc; ++i) {
+        ERROR_ON(off >= len, "Zygote request truncated!");
+        *slot++ = (uint64_t)(buf + off);
+        while (off < len && buf[off] != '\0') {
+            ++off;
+        }
+        ERROR_ON(off == len, "Zygote request string not terminated!");
+        ++off;
+
+        if (i + 1 == req->argc) {
+            *slot++ = 0;
+        }
+    }
+    if (req->argc == 0) {
+        *slot++ = 0;
+    }
+    *slot++ = 0;
+
+    memcpy(slot, sysv->auxvv, sizeof(Auxv64Entry) * (auxc + 1));
+    return prctx;
+}
+
+// Serve a single launch request on the connection `conn` in the forked child.
+// Returns the process context block for the program.
+DL_INIT static const uint64_t* zygote_child(int conn, const SystemVDescriptor* sysv) {
+    uint8_t* buf = alloc(ZYGOTE_MAX_REQUEST);
+    ZygoteFds ctrl;
+    memset(&ctrl, 0 /* byte */, sizeof(ctrl));
+
+    struct iovec iov = {buf, ZYGOTE_MAX_REQUEST};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    const ssize_t len = recvmsg(conn, &msg, 0 /* flags */);
+    ERROR_ON(len < 0, "Failed to receive zygote request!");
+    ERROR_ON(msg.msg_controllen < sizeof(ctrl.hdr) + sizeof(ctrl.fds) || ctrl.hdr.cmsg_level != SOL_SOCKET ||
+                 ctrl.hdr.cmsg_type != SCM_RIGHTS || ctrl.hdr.cmsg_len != sizeof(ctrl.hdr) + sizeof(ctrl.fds),
+             "Zygote request without standard file descriptors!");
+
+    // Install the standard file descriptors of the request. The connection
+    // is kept open (close-on-exec) until the program exits.
+    for (int fd = 0; fd < ZYGOTE_NUM_FDS; ++fd) {
+        ERROR_ON(dup2(ctrl.fds[fd], fd) != fd, "Failed to install file descriptor %d!", fd);
+        if (ctrl.fds[fd] >= ZYGOTE_NUM_FDS) {
+            close(ctrl.fds[fd]);
+        }
+    }
+
+    return zygote_prctx(buf, len, sysv);
+}
+
+// Listen on the Unix socket `path` and fork a child for each launch request.
+//
+// Only returns in the forked children, with the process context block of the
+// request.
+DL_INIT static const uint64_t* zygote_serve(const char* path, const SystemVDescriptor* sysv) {
+    struct sockaddr_un addr;
+    ERROR_ON(!zygote_addr(&addr, path), "Zygote socket path '%s' too long!", path);
+
+    const int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 /* protocol */);
+    ERROR_ON(sock < 0, "Failed to create zygote socket!");
+    // Remove a stale socket of a previous zygote.
+    unlink(path);
+    ERROR_ON(bind(sock, &addr, sizeof(addr)) != 0, "Failed to bind zygote socket '%s'!", path);
+    ERROR_ON(listen(sock, ZYGOTE_BACKLOG) != 0, "Failed to listen on zygote socket '%s'!", path);
+
+    while (true) {
+        const int conn = accept4(sock, 0 /* addr */, 0 /* addrlen */, SOCK_CLOEXEC);
+        ERROR_ON(conn < 0, "Failed to accept on zygote socket '%s'!", path);
+
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(sock);
+            return zygote_child(conn, sysv);
+        }
+        close(conn);
+
+        // Reap exited children.
+        while (wait4(-1 /* any child */, 0 /* wstatus */, WNOHANG, 0 /* rusage */) > 0) {
+        }
+    }
+}
+
+// }}}
+// {{{ Reclaim
+
+// Memory of the dynamic linker which is only needed until the handoff to the
+// user program:
+//   - The scratch arena (see `Scratch`), always unmapped at the handoff.
+//   - The text of the startup code in the `dl_init_text` section (see
+//     `DL_INIT`). The pages are file backed and unmodified, hence they are
+//     faulted in from the page cache should the code run again. `dl_entry`
+//     and `reclaim` stay outside of the section, as returning into a released
+//     page would fault in its neighbours as well (fault-around).
+//   - The stack pages below the current frame, touched by the startup but not
+//     yet by the user program.
+// The runtime core used for lazy binding and the `dlopen` API stays resident,
+// as does its bookkeeping allocated with `alloc`.
+//
+// Releasing the text and stack pages is opt-in via `DYNLD_RECLAIM=1`, which
+// also reports the resident set size saved.
+
+// Bounds of the `dl_init_text` section (defined by the static linker).
+extern const uint8_t __start_dl_init_text[] __attribute__((visibility("hidden")));
+extern const uint8_t __stop_dl_init_text[] __attribute__((visibility("hidden")));
+
+// Get the resident set size of the process in pages (0 if unknown).
+static uint64_t get_rss_pages() {
+    const int fd = open("/proc/self/statm", O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    char buf[128];
+    const long len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    buf[len > 0 ? len : 0] = '\0';
+
+    // Fields: size resident shared text lib data dt
+    const char* c = buf;
+    while (*c && *c != ' ') {
+        ++c;
+    }
+    uint64_t rss = 0;
+    for (++c; *c >= '0' && *c <= '9'; ++c) {
+        rss = rss * 10 + (*c - '0');
+    }
+    return rss;
+}
+
+// Release the resident stack pages below the frame of this function, keeping
+// one page for the frames of the syscalls.
+//
+// Not inlined, such that all frames of the callers are above its frame.
+__attribute__((noinline)) static void reclaim_stack() {
+    const uint64_t end = ((uint64_t)__builtin_frame_address(0) & ~(PAGE_SIZE - 1)) - PAGE_SIZE;
+    uint64_t start = end;
+    unsigned char vec = 0;
+    while (mincore((void*)(start - PAGE_SIZE), PAGE_SIZE, &vec) == 0 && (vec & 1)) {
+        start -= PAGE_SIZE;
+    }
+    if (start < end) {
+        madvise((void*)start, end - start, MADV_DONTNEED);
+    }
+}
+
+static void reclaim(const SystemVDescriptor* sysv) {
+    const char* env = get_env(sysv, "DYNLD_RECLAIM");
+    if (env == 0 || strcmp(env, "1") != 0) {
+        scratch_leave();
+        return;
+    }
+    const uint64_t rss = get_rss_pages();
+
+    scratch_leave();
+    const uint64_t text_start = align_up((uint64_t)__start_dl_init_text, PAGE_SIZE);
+    const uint64_t text_end = (uint64_t)__stop_dl_init_text & ~(PAGE_SIZE - 1);
+    if (text_start < text_end) {
+        madvise((void*)text_start, text_end - text_start, MADV_DONTNEED);
+    }
+    reclaim_stack();
+
+    const uint64_t rss_after = get_rss_pages();
+    if (!gQuiet) {
+        pfmt("Reclaimed %ld KiB at handoff (RSS %ld KiB -> %ld KiB)\n", (rss - rss_after) * PAGE_SIZE / 1024, rss * PAGE_SIZE / 1024,
+             rss_after * PAGE_SIZE / 1024);
+    }
+}
+
+// }}}
+// {{{ Self Relocation
+
+// ELF header of the dynamic linker itself (defined by the static linker).
+//
+// Like `_DYNAMIC` it is `hidden` and hence addressed PC relative, which makes
+// it usable before the dynamic linker is relocated.
+extern const Elf64Ehdr __ehdr_start __attribute__((visibility("hidden")));
+
+// Apply the relocations of the dynamic linker itself.
+//
+// The dynamic linker is linked as static PIE, hence its only relocations are
+// `R_X86_64_RELATIVE` relocations of initialized pointers (eg `gBuiltins`).
+// This runs first in `dl_entry` before any global is accessed, it must only
+// use the stack and PC relative addresses.
+//
+// Afterwards the `PT_GNU_RELRO` segment is made read-only.
+DL_INIT static void relocate_self() {
+    uint8_t* base = (uint8_t*)&__ehdr_start;
+
+    uint64_t rela = 0;
+    uint64_t relasz = 0;
+    for (const Elf64Dyn* dyn = _DYNAMIC; dyn->tag != DT_NULL; ++dyn) {
+        if (dyn->tag == DT_RELA) {
+            rela = dyn->val;
+        } else if (dyn->tag == DT_RELASZ) {
+            relasz = dyn->val;
+        } else if (dyn->tag == DT_RELAENT) {
+            ERROR_ON(dyn->val != sizeof(Elf64Rela), "Elf64Rela size miss-match!");
+        }
+    }
+
+    const Elf64Rela* relocs = (const Elf64Rela*)(base + rela);
+    for (uint64_t i = 0; i < relasz / sizeof(Elf64Rela); ++i) {
+        ERROR_ON(ELF64_R_TYPE(relocs[i].info) != R_X86_64_RELATIVE, "Unsupported relocation type %d in dynld.so!",
+                 ELF64_R_TYPE(relocs[i].info));
+        *(uint64_t*)(base + relocs[i].offset) = (uint64_t)(base + relocs[i].addend);
+    }
+
+    const Elf64Phdr* phdr = (const Elf64Phdr*)(base + __ehdr_start.phoff);
+    for (unsigned i = 0; i < __ehdr_start.phnum; ++i) {
+        if (phdr[i].type == PT_GNU_RELRO) {
+            const uint64_t start = phdr[i].vaddr & ~(PAGE_SIZE - 1);
+            const uint64_t end = (phdr[i].vaddr + phdr[i].memsz) & ~(PAGE_SIZE - 1);
+            if (end > start) {
+                mprotect(base + start, end - start, PROT_READ);
+            }
+        }
+    }
+}
+
+// }}}
+// {{{ Dynamic Linker Entrypoint
+
+void dl_entry(const uint64_t* prctx) {
+    // Process the own relocations before touching any global.
+    relocate_self();
+
+    // Temporaries of the startup are allocated from the scratch arena, which
+    // is released at the handoff (see `reclaim`).
+    scratch_enter();
+
+    // Parse SystemV ABI block.
+    const SystemVDescriptor sysv_desc = get_systemv_descriptor(prctx);
+
+    // Ensure hard-coded page size value is correct.
+    ERROR_ON(sysv_desc.auxv[AT_PAGESZ] != PAGE_SIZE, "Hard-coded PAGE_SIZE miss-match!");
+
+    // Detect CPU features for IFUNC resolvers.
+    loader_init(&gLoader, sysv_desc.auxv[AT_HWCAP], sysv_desc.auxv[AT_HWCAP2]);
+
+    // Decode the vDSO mapped by the Kernel.
+    vdso_init(&sysv_desc);
+
+    // Initialize dso handle for user program but extracting necesarry
+    // information from `AUXV` and the `PHDR`.
+    const Dso dso_prog = get_prog_dso(&sysv_desc);
+
+    // Setup the prelink cache (opt-in via `DYNLD_CACHE`).
+    PrelinkCache cache = cache_init(&sysv_desc, &dso_prog);
+
+    // Search paths of the main program, also used by `dlopen`.
+    gDl.prog_search.origin = sysv_desc.auxv[AT_EXECFN] ? dirname((const char*)sysv_desc.auxv[AT_EXECFN]) : ".";
+    gDl.prog_search.rpath = dso_prog.dynamic[DT_RPATH] ? get_str(&dso_prog, dso_prog.dynamic[DT_RPATH]) : 0;
+    gDl.prog_search.runpath = dso_prog.dynamic[DT_RUNPATH] ? get_str(&dso_prog, dso_prog.dynamic[DT_RUNPATH]) : 0;
+    gDl.ld_library_path = get_env(&sysv_desc, "LD_LIBRARY_PATH");
+
+    // Defer dependencies only called through the PLT (opt-in via
+    // `DYNLD_LAZY=1`).
+    lazy_init(&sysv_desc, &cache);
+
+    // Load dependencies and setup LinkMap.
+    //
+    // All direct and indirect dependencies of the user program are loaded
+    // breadth-first and mapped into a single region right below the dynamic
+    // linker. The resulting link map has the following order:
+    //   main -> direct deps -> indirect deps ...
+    // The link map determines the symbol lookup order. It is kept in `gDl`
+    // to load further objects with `dlopen` at runtime.
+    LinkMap* map = &gDl.map;
+    const uint8_t* region = load_dependencies(map, &dso_prog, &gDl.prog_search, &sysv_desc, &cache);
+    gDl.hint = region ? region : (const uint8_t*)sysv_desc.auxv[AT_BASE];
+
+    // Setup the static TLS area with the TLS blocks of the main program and
+    // its dependencies and install the thread pointer.
+    tls_layout(map, 0 /* first */);
+    tls_setup(&sysv_desc);
+
+    // Track the pages dirtied by relocations (opt-in via `DYNLD_RELOC_STATS`).
+    reloc_stats_init(&sysv_desc, map);
+    const char* quiet = get_env(&sysv_desc, "DYNLD_QUIET");
+    gQuiet = quiet && strcmp(quiet, "1") == 0;
+    const char* reloc_order = get_env(&sysv_desc, "DYNLD_RELOC_ORDER");
+    gRelocByPage = reloc_order && strcmp(reloc_order, "page") == 0;
+
+    // Resolve relocations of the dependencies and the main program
+    // (dependencies first).
+    //
+    // On a prelink cache hit the relocated pages are already mapped in from
+    // the cache, otherwise the relocated pages are recorded in the cache.
+    //
+    // With direct binding (opt-in via `DYNLD_DIRECT`) symbols are looked up in
+    // their recorded provider first, changed providers are written back.
+    if (!cache.hit) {
+        direct_init(&sysv_desc, map);
+        direct_load(map);
+        for (unsigned i = 0; i < map->len; ++i) {
+            const char* missing = resolve_relocs(&map->dso[map->order[i]], map, &cache);
+            ERROR_ON(missing, "Failed lookup symbol %s while resolving relocations!", missing);
+        }
+        cache_store(&cache, map->dso, map->len);
+        direct_store(map);
+    }
+    tls_init_blocks(map, 0 /* first */, gTls.tp);
+
+    // Redirect imported function calls to profiling thunks (opt-in via
+    // `DYNLD_PROFILE`). The GOT entries are read back, hence this works on a
+    // prelink cache hit as well.
+    prof_init(&sysv_desc);
+    prof_install(map, 0 /* first */);
+
+    // Publish the loaded objects to debuggers before running any code of
+    // them.
+    debug_init(&sysv_desc, &map->dso[0]);
+    debug_end(map);
+
+    // Setup global offset table (GOT).
+    //
+    // This installs a dynamic resolve handler, which is only called for
+    // functions provided by deferred dependencies (see `gLazy`), as all other
+    // relocations are resolved before transferring control to the user
+    // program. Initializers may already call such functions.
+    for (unsigned i = 0; i < map->len; ++i) {
+        setup_got(&map->dso[i]);
+    }
+
+    // Initialize dependencies and the main program (dependencies first).
+    for (unsigned i = 0; i < map->len; ++i) {
+        init(&map->dso[map->order[i]]);
+    }
+
+    // In zygote mode only the forked children continue here, with the
+    // process context block of their launch request.
+    const char* zygote = get_env(&sysv_desc, "DYNLD_ZYGOTE");
+    if (zygote) {
+        prctx = zygote_serve(zygote, &sysv_desc);
+    }
+
+    // Write the perf map (opt-in via `DYNLD_PERF_MAP`).
+    perf_map_init(&sysv_desc);
+    perf_map_write(map, 0 /* first */);
+    reloc_stats_store(map);
+
+    // Release the memory only needed for the startup.
+    reclaim(&sysv_desc);
+
+    // Transfer control to user program.
+    //
+    // The process context block is passed as argument, such that the user
+    // program can access its arguments, environment and auxiliary vector.
+    DYNLD_PROBE1(entry, map->dso[0].entry);
+    map->dso[0].entry(prctx);
+
+    // Finalize main program and dependencies, including objects loaded by
+    // `dlopen` and not closed (reverse initialization order).
+    for (unsigned i = map->len; i > 0; --i) {
+        fini(&map->dso[map->order[i - 1]]);
+    }
+    prof_store();
 
     _exit(0);
 }
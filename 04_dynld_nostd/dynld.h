@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#pragma once
+
+// API provided by `dynld.so` to the programs and shared libraries it loads.
+//
+// The functions are not defined by any shared library, `dynld.so` resolves
+// references to them to its own implementation. They are declared `weak`, such
+// that programs can check if they are provided (eg when started by a different
+// dynamic linker).
+// Programs must be linked with `-Wl,-z,dynamic-undefined-weak`, otherwise the
+// static linker resolves the undefined weak references to `0`.
+
+#include <stdint.h>
+
+// dlopen - mode:
+#define RTLD_LAZY   0x1  // Accepted, all symbols are bound at load time.
+#define RTLD_NOW    0x2
+#define RTLD_NOLOAD 0x4  // Don't load the object, only return a handle if already loaded.
+
+// dlsym - handle:
+#define RTLD_DEFAULT ((void*)0)  // Search the global scope.
+
+// Load the shared library `file` and its dependencies if not loaded yet and
+// return a handle for it. Returns a handle for the main program if `file`
+// is 0. Returns 0 on error, see `dlerror`.
+//
+// Each successful `dlopen` must be paired with a `dlclose`.
+void* dlopen(const char* file, int mode) __attribute__((weak));
+
+// Get the address of the symbol `name` in the object `handle` or its
+// dependencies. Returns 0 if not found, see `dlerror`.
+void* dlsym(void* handle, const char* name) __attribute__((weak));
+
+// Drop a reference on the object `handle`. Once all references are dropped
+// the object is finalized and unmapped, as are dependencies which are not
+// referenced anymore. Returns 0 on success.
+int dlclose(void* handle) __attribute__((weak));
+
+// Replace the object `handle` by the shared library `file`, eg a patched
+// version of it, without restarting the process. The new version is relocated
+// against the loaded objects and initialized, then the GOT entries of all
+// other objects bound into the old version are rebound to it. Returns
+// `handle`, which refers to the new version, or 0 on error (nothing is
+// replaced), see `dlerror`.
+//
+// The old version stays mapped until `dlquiesce` is called.
+void* dlreplace(void* handle, const char* file) __attribute__((weak));
+
+// Finalize and unmap the old versions of the objects replaced by `dlreplace`.
+// Must only be called when no thread executes in or references the old
+// versions anymore. Returns the number of unmapped objects.
+int dlquiesce(void) __attribute__((weak));
+
+// Get a description of the last error or 0 if there was no error since the
+// last call.
+const char* dlerror(void) __attribute__((weak));
+
+// IFUNC resolver - CPU features usable by the process:
+#define DYNLD_CPU_SSE2     0x01
+#define DYNLD_CPU_SSE42    0x02
+#define DYNLD_CPU_POPCNT   0x04
+#define DYNLD_CPU_AVX      0x08
+#define DYNLD_CPU_AVX2     0x10
+#define DYNLD_CPU_BMI2     0x20
+#define DYNLD_CPU_AVX512F  0x40
+#define DYNLD_CPU_AVX512BW 0x80
+
+// CPU feature information passed to IFUNC resolvers.
+//
+// Features requiring OS support (AVX, AVX-512) are only reported in `usable`
+// if the Kernel saves the corresponding register state (XCR0).
+typedef struct {
+    uint64_t hwcap;       // `AT_HWCAP` auxiliary vector entry.
+    uint64_t hwcap2;      // `AT_HWCAP2` auxiliary vector entry.
+    uint32_t cpuid1_ecx;  // CPUID leaf 1 ECX.
+    uint32_t cpuid1_edx;  // CPUID leaf 1 EDX.
+    uint32_t cpuid7_ebx;  // CPUID leaf 7 sub-leaf 0 EBX.
+    uint32_t cpuid7_ecx;  // CPUID leaf 7 sub-leaf 0 ECX.
+    uint32_t usable;      // `DYNLD_CPU_*` bits.
+    uint32_t level;       // x86-64 micro-architecture level (1 baseline, 2-4 for x86-64-v2 to x86-64-v4).
+} DynldCpuFeatures;
+
+// Resolver of an IFUNC symbol (`__attribute__((ifunc("resolver")))`).
+//
+// It is called once when the symbol is bound at load time and returns the
+// address of the implementation to use. Resolvers not taking arguments are
+// compatible.
+typedef void* (*DynldIfuncResolver)(uint64_t hwcap, const DynldCpuFeatures* cpu);
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include <io.h>
+
+#include <stdint.h>
+
+// Program of the lazy dependency loading example (`DYNLD_LAZY=1`), standing in
+// for a tool linking many libraries of which a single run only calls a few.
+//
+// `libgreet.so` is always loaded on startup, as it has thread local storage.
+// `liblazy.so` and `libbig.so` are only called through the PLT, hence they are
+// deferred until their first call:
+//   lazy        Calls neither of them.
+//   lazy 1      Calls `lazy_sum` of `liblazy.so`.
+//   lazy 1 2    Calls `big_fn_000` of `libbig.so` as well.
+
+extern const char* get_greet();
+extern long lazy_sum(long a, long b, long c, long d, long e, long f);
+extern int big_fn_000();
+
+void _start(const uint64_t* prctx) {
+    const uint64_t argc = prctx[0];
+
+    pfmt("get_greet() -> %s\n", get_greet());
+    if (argc > 1) {
+        pfmt("lazy_sum(1, 2, 3, 4, 5, 6) -> %d\n", lazy_sum(1, 2, 3, 4, 5, 6));
+        pfmt("lazy_sum(6, 5, 4, 3, 2, 1) -> %d\n", lazy_sum(6, 5, 4, 3, 2, 1));
+    }
+    if (argc > 2) {
+        pfmt("big_fn_000() -> %d\n", big_fn_000());
+    }
+}
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+// Synthetic large shared library for the relocation order benchmark (see
+// `reloc_bench.c`).
+//
+// It exports 64 functions and holds 1024 (local) tables, each with a pointer
+// to every function. The functions are preemptible, hence each pointer is an
+// `R_X86_64_64` relocation against the function symbol (65536 in total).
+// The static linker sorts these relocations by symbol, such that applying
+// them in table order writes one entry of every table for each symbol and
+// sweeps through all 128 table pages 64 times.
+//
+// Only the functions are exported, as `find_sym` scans all dynamic symbols.
+// The relocations can't be made symbol free, as the static linker sorts
+// `R_X86_64_RELATIVE` relocations by target, ie in page order already.
+
+// Expand `m(<prefix><n>)` for 64 distinct suffixes `n`.
+#define F4(m, p)  m(p##0) m(p##1) m(p##2) m(p##3)
+#define F16(m, p) F4(m, p##0) F4(m, p##1) F4(m, p##2) F4(m, p##3)
+#define F64(m, p) F16(m, p##0) F16(m, p##1) F16(m, p##2) F16(m, p##3)
+
+// Expand `m(<prefix><n>)` for 1024 distinct suffixes `n` (separate macros, as
+// macros are not expanded again within their own expansion).
+#define T4(m, p)    m(p##0) m(p##1) m(p##2) m(p##3)
+#define T16(m, p)   T4(m, p##0) T4(m, p##1) T4(m, p##2) T4(m, p##3)
+#define T64(m, p)   T16(m, p##0) T16(m, p##1) T16(m, p##2) T16(m, p##3)
+#define T256(m, p)  T64(m, p##0) T64(m, p##1) T64(m, p##2) T64(m, p##3)
+#define T1024(m, p) T256(m, p##0) T256(m, p##1) T256(m, p##2) T256(m, p##3)
+
+#define BIG_FN(n) \
+    int big_fn##n() { return __COUNTER__; }
+#define BIG_REF(n) &big_fn##n,
+#define BIG_TABLE(n) \
+    __attribute__((used)) static int (*const big_tbl##n[])() = {F64(BIG_REF, _)};
+
+F64(BIG_FN, _)
+T1024(BIG_TABLE, _)
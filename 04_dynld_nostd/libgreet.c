@@ -4,11 +4,19 @@
 
 #include <io.h>
 
+#include "dynld.h"
+
 int gCalled = 0;
 
+// Thread local variable -> generates TLS relocations (R_X86_64_DTPMOD64) for
+// references from this library (general-dynamic model via `__tls_get_addr`)
+// and (R_X86_64_TPOFF64) for references from the main program (initial-exec).
+__thread int gGreetCalls = 0;
+
 const char* get_greet() {
     // Reference global variable -> generates RELA relocation (R_X86_64_GLOB_DAT).
     ++gCalled;
+    ++gGreetCalls;
     return "Hello from libgreet.so!";
 }
 
@@ -18,6 +26,25 @@ const char* get_greet2() {
     return "Hello 2 from libgreet.so!";
 }
 
+static const char* get_greet_avx2() {
+    return "Hello from the AVX2 variant of libgreet.so!";
+}
+
+static const char* get_greet_generic() {
+    return "Hello from the generic variant of libgreet.so!";
+}
+
+// Resolver of the indirect function `get_greet_isa`, run by the dynamic linker
+// when binding the symbol.
+static const char* (*resolve_greet_isa(uint64_t hwcap, const DynldCpuFeatures* cpu))() {
+    (void)hwcap;
+    return (cpu->usable & DYNLD_CPU_AVX2) ? get_greet_avx2 : get_greet_generic;
+}
+
+// Indirect function -> references from the main program are bound to the
+// implementation selected by the resolver (STT_GNU_IFUNC).
+const char* get_greet_isa() __attribute__((ifunc("resolve_greet_isa")));
+
 // Definition of `static` function which is referenced from the `INIT` dynamic
 // section entry -> generates R_X86_64_RELATIVE relocation.
 __attribute__((constructor)) static void libinit() {
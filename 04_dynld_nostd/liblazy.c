@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include <io.h>
+
+// Library only called through the PLT by `lazy`, hence it is deferred with
+// lazy dependency loading (`DYNLD_LAZY=1`) until `lazy_sum` is called.
+
+__attribute__((constructor)) static void lazyinit() {
+    pfmt("liblazy.so: lazyinit\n");
+}
+
+// All integer argument registers are used, they must survive binding the
+// function on its first call.
+long lazy_sum(long a, long b, long c, long d, long e, long f) {
+    return a + b + c + d + e + f;
+}
@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+// Shared library loaded at runtime by `dlfail` with `dlopen`.
+//
+// It depends on `libnowhere.so`, which is only present when linking, hence
+// loading it fails.
+
+const char* get_missing_greet() {
+    return "Hello from libmissing.so!";
+}
@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include <io.h>
+
+// Shared library loaded at runtime by `main` with `dlopen`.
+//
+// It depends on `libgreet.so`, which is already loaded with `main` and is
+// therefore shared instead of being loaded a second time.
+
+extern const char* get_greet();
+
+// Thread local variable of an object loaded at runtime, its TLS block is taken
+// from the static TLS surplus -> generates TLS relocation (R_X86_64_DTPMOD64)
+// without symbol (local-dynamic model).
+static __thread int tPluginCalls = 10;
+
+const char* get_plugin_greet() {
+    // Call function from libgreet.so -> generates PLT relocations (R_X86_64_JUMP_SLOT).
+    pfmt("libplugin.so: %s\n", get_greet());
+    pfmt("libplugin.so: tPluginCalls = %d\n", ++tPluginCalls);
+    return "Hello from libplugin.so!";
+}
+
+__attribute__((constructor)) static void plugininit() {
+    pfmt("libplugin.so: plugininit\n");
+}
+
+__attribute__((destructor)) static void pluginfini() {
+    pfmt("libplugin.so: pluginfini\n");
+}
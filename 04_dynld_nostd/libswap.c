@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include <io.h>
+
+// Library replaced at runtime by `swap` with `dlreplace`.
+//
+// It is built twice, `libswap.so` (version 1) is loaded with `swap` and
+// `libswap-v2.so` (`-DSWAP_VERSION=2`) is the patched version replacing it.
+
+#ifndef SWAP_VERSION
+#define SWAP_VERSION 1
+#endif
+
+// Reference from this library -> generates RELA relocation (R_X86_64_GLOB_DAT),
+// which the new version binds to its own definition.
+int gSwapVersion = SWAP_VERSION;
+
+// The TLS block is taken over by the new version, the count of calls
+// continues.
+static __thread int tSwapCalls = 0;
+
+const char* swap_greet() {
+    pfmt("libswap.so: v%d, call %d\n", gSwapVersion, ++tSwapCalls);
+#if SWAP_VERSION == 1
+    return "Hello from libswap.so!";
+#else
+    return "Hello from the patched libswap.so!";
+#endif
+}
+
+__attribute__((constructor)) static void swapinit() {
+    pfmt("libswap.so: v%d swapinit\n", SWAP_VERSION);
+}
+
+__attribute__((destructor)) static void swapfini() {
+    pfmt("libswap.so: v%d swapfini\n", SWAP_VERSION);
+}
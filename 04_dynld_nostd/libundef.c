@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+// Shared library loaded at runtime by `dlfail` with `dlopen`.
+//
+// It calls a function which no object defines, hence loading it fails.
+
+extern int undefined_fn();
+
+int call_undefined_fn() {
+    // Call undefined function -> generates PLT relocation (R_X86_64_JUMP_SLOT)
+    // which can't be resolved.
+    return undefined_fn();
+}
@@ -0,0 +1,825 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include "loader.h"
+
+#include <alloc.h>
+#include <common.h>
+
+#include "sdt.h"
+
+// {{{ Loader
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+    asm volatile("cpuid" : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3]) : "a"(leaf), "c"(subleaf));
+}
+
+void loader_init(Loader* ld, uint64_t hwcap, uint64_t hwcap2) {
+    memset(ld, 0 /* byte */, sizeof(*ld));
+    DynldCpuFeatures* cpu = &ld->cpu;
+
+    uint32_t regs[4];
+    cpuid(0, 0, regs);
+    const uint32_t max_leaf = regs[0];
+
+    cpu->hwcap = hwcap;
+    cpu->hwcap2 = hwcap2;
+
+    cpuid(1, 0, regs);
+    cpu->cpuid1_ecx = regs[2];
+    cpu->cpuid1_edx = regs[3];
+    if (max_leaf >= 7) {
+        cpuid(7, 0, regs);
+        cpu->cpuid7_ebx = regs[1];
+        cpu->cpuid7_ecx = regs[2];
+    }
+
+    // Register state enabled by the Kernel (XCR0), only readable if OSXSAVE is set.
+    uint64_t xcr0 = 0;
+    if (cpu->cpuid1_ecx & (1u << 27)) {
+        uint32_t lo, hi;
+        asm volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = ((uint64_t)hi << 32) | lo;
+    }
+    const bool ymm = (xcr0 & 0x06) == 0x06;          // SSE and AVX state.
+    const bool zmm = ymm && (xcr0 & 0xe0) == 0xe0;  // Opmask and ZMM state.
+
+    cpu->usable |= (cpu->cpuid1_edx & (1u << 26)) ? DYNLD_CPU_SSE2 : 0;
+    cpu->usable |= (cpu->cpuid1_ecx & (1u << 20)) ? DYNLD_CPU_SSE42 : 0;
+    cpu->usable |= (cpu->cpuid1_ecx & (1u << 23)) ? DYNLD_CPU_POPCNT : 0;
+    cpu->usable |= (cpu->cpuid1_ecx & (1u << 28)) && ymm ? DYNLD_CPU_AVX : 0;
+    cpu->usable |= (cpu->cpuid7_ebx & (1u << 5)) && ymm ? DYNLD_CPU_AVX2 : 0;
+    cpu->usable |= (cpu->cpuid7_ebx & (1u << 8)) ? DYNLD_CPU_BMI2 : 0;
+    cpu->usable |= (cpu->cpuid7_ebx & (1u << 16)) && zmm ? DYNLD_CPU_AVX512F : 0;
+    cpu->usable |= (cpu->cpuid7_ebx & (1u << 30)) && zmm ? DYNLD_CPU_AVX512BW : 0;
+
+    // Micro-architecture level as defined by the x86-64 psABI, used to select
+    // library variants (see `search_dirs` in `dynld.c`).
+    cpuid(0x80000000, 0, regs);
+    uint32_t ext_ecx = 0;
+    if (regs[0] >= 0x80000001) {
+        cpuid(0x80000001, 0, regs);
+        ext_ecx = regs[2];
+    }
+    const uint32_t ecx = cpu->cpuid1_ecx;
+    const uint32_t ebx7 = cpu->cpuid7_ebx;
+    // CMPXCHG16B, LAHF/SAHF, POPCNT, SSE3, SSE4.1, SSE4.2, SSSE3.
+    const bool v2 = (ecx & (1u << 13)) && (ext_ecx & (1u << 0)) && (ecx & (1u << 23)) && (ecx & (1u << 0)) && (ecx & (1u << 19)) &&
+                    (ecx & (1u << 20)) && (ecx & (1u << 9));
+    // AVX, AVX2, BMI1, BMI2, F16C, FMA, LZCNT, MOVBE, OSXSAVE.
+    const bool v3 = v2 && ymm && (ecx & (1u << 28)) && (ebx7 & (1u << 5)) && (ebx7 & (1u << 3)) && (ebx7 & (1u << 8)) &&
+                    (ecx & (1u << 29)) && (ecx & (1u << 12)) && (ext_ecx & (1u << 5)) && (ecx & (1u << 22));
+    // AVX512F, AVX512BW, AVX512CD, AVX512DQ, AVX512VL.
+    const bool v4 = v3 && zmm && (ebx7 & (1u << 16)) && (ebx7 & (1u << 30)) && (ebx7 & (1u << 28)) && (ebx7 & (1u << 17)) &&
+                    (ebx7 & (1u << 31));
+    cpu->level = v4 ? 4 : (v3 ? 3 : (v2 ? 2 : 1));
+}
+
+void loader_fini(Loader* ld) {
+    VersionTable* vt = &ld->versions;
+    for (uint32_t i = 0; i < vt->len; ++i) {
+        dealloc((void*)vt->names[i]);
+    }
+    if (vt->names) {
+        dealloc(vt->names);
+        dealloc(vt->hashes);
+        dealloc(vt->buckets);
+    }
+    memset(vt, 0 /* byte */, sizeof(*vt));
+}
+
+void* call_ifunc_resolver(const Loader* ld, const uint8_t* resolver) {
+    return ((DynldIfuncResolver)resolver)(ld->cpu.hwcap, &ld->cpu);
+}
+
+// }}}
+// {{{ Dso
+
+static void version_insert(VersionTable* vt, uint32_t id) {
+    uint32_t b = vt->hashes[id - 1] & (vt->nbuckets - 1);
+    while (vt->buckets[b]) {
+        b = (b + 1) & (vt->nbuckets - 1);
+    }
+    vt->buckets[b] = id;
+}
+
+// Get the version id of the version `name` with the ELF hash `hash`.
+static uint32_t version_intern(Loader* ld, const char* name, uint32_t hash) {
+    VersionTable* vt = &ld->versions;
+    for (uint32_t b = hash & (vt->nbuckets - 1); vt->nbuckets && vt->buckets[b]; b = (b + 1) & (vt->nbuckets - 1)) {
+        const uint32_t id = vt->buckets[b];
+        if (vt->hashes[id - 1] == hash && strcmp(vt->names[id - 1], name) == 0) {
+            return id;
+        }
+    }
+
+    if (vt->len == vt->cap) {
+        vt->cap = vt->cap ? vt->cap * 2 : 16;
+        const char** names = alloc(sizeof(const char*) * vt->cap);
+        uint32_t* hashes = alloc(sizeof(uint32_t) * vt->cap);
+        if (vt->names) {
+            memcpy(names, vt->names, sizeof(const char*) * vt->len);
+            memcpy(hashes, vt->hashes, sizeof(uint32_t) * vt->len);
+            dealloc(vt->names);
+            dealloc(vt->hashes);
+        }
+        vt->names = names;
+        vt->hashes = hashes;
+
+        // Rebuild hash table with a load factor <= 0.5.
+        if (vt->buckets) {
+            dealloc(vt->buckets);
+        }
+        vt->nbuckets = 2 * vt->cap;
+        vt->buckets = alloc(sizeof(uint32_t) * vt->nbuckets);
+        memset(vt->buckets, 0, sizeof(uint32_t) * vt->nbuckets);
+        for (uint32_t id = 1; id <= vt->len; ++id) {
+            version_insert(vt, id);
+        }
+    }
+
+    // Names are copied, objects are unmapped again by `dlclose`.
+    const size_t len = strlen(name) + 1;
+    char* copy = alloc(len);
+    memcpy(copy, name, len);
+    vt->names[vt->len] = copy;
+    vt->hashes[vt->len] = hash;
+    vt->len += 1;
+    version_insert(vt, vt->len);
+    return vt->len;
+}
+
+// Translate the version definitions `verdef` and requirements `verneed`
+// (offsets from the base address, 0 if none) of `dso` into the table of
+// version ids by version index (`dso->vers`).
+//
+// The base version definition (the object itself) and `VER_NDX_GLOBAL` map to
+// 0, such that unversioned definitions match any reference.
+static void decode_versions(Loader* ld, Dso* dso, uint64_t verdef, uint64_t verneed) {
+    const char* strtab = (const char*)(dso->base + dso->dynamic[DT_STRTAB]);
+
+    // Find highest version index.
+    uint32_t max_ndx = VER_NDX_GLOBAL;
+    for (const uint8_t* p = verdef ? dso->base + verdef : 0; p; p = ((const Elf64Verdef*)p)->next ? p + ((const Elf64Verdef*)p)->next : 0) {
+        const Elf64Verdef* vd = (const Elf64Verdef*)p;
+        max_ndx = vd->ndx > max_ndx ? vd->ndx : max_ndx;
+    }
+    for (const uint8_t* p = verneed ? dso->base + verneed : 0; p; p = ((const Elf64Verneed*)p)->next ? p + ((const Elf64Verneed*)p)->next : 0) {
+        const Elf64Verneed* vn = (const Elf64Verneed*)p;
+        const uint8_t* a = p + vn->aux;
+        for (unsigned i = 0; i < vn->cnt; ++i, a += ((const Elf64Vernaux*)a)->next) {
+            const uint32_t ndx = ((const Elf64Vernaux*)a)->other & VERSYM_NDX_MASK;
+            max_ndx = ndx > max_ndx ? ndx : max_ndx;
+        }
+    }
+
+    dso->vers_len = max_ndx + 1;
+    dso->vers = alloc(sizeof(uint32_t) * dso->vers_len);
+    memset(dso->vers, 0, sizeof(uint32_t) * dso->vers_len);
+
+    for (const uint8_t* p = verdef ? dso->base + verdef : 0; p; p = ((const Elf64Verdef*)p)->next ? p + ((const Elf64Verdef*)p)->next : 0) {
+        const Elf64Verdef* vd = (const Elf64Verdef*)p;
+        if (!(vd->flags & VER_FLG_BASE) && vd->cnt > 0) {
+            const Elf64Verdaux* vda = (const Elf64Verdaux*)(p + vd->aux);
+            dso->vers[vd->ndx] = version_intern(ld, strtab + vda->name, vd->hash);
+        }
+    }
+    for (const uint8_t* p = verneed ? dso->base + verneed : 0; p; p = ((const Elf64Verneed*)p)->next ? p + ((const Elf64Verneed*)p)->next : 0) {
+        const Elf64Verneed* vn = (const Elf64Verneed*)p;
+        const uint8_t* a = p + vn->aux;
+        for (unsigned i = 0; i < vn->cnt; ++i, a += ((const Elf64Vernaux*)a)->next) {
+            const Elf64Vernaux* vna = (const Elf64Vernaux*)a;
+            dso->vers[vna->other & VERSYM_NDX_MASK] = version_intern(ld, strtab + vna->name, vna->hash);
+        }
+    }
+}
+
+void decode_dynamic(Loader* ld, Dso* dso, uint64_t dynoff) {
+    const Elf64Dyn* dynamic = (const Elf64Dyn*)(dso->base + dynoff);
+    dso->dyn = (Elf64Dyn*)dynamic;
+
+    // Count `DT_NEEDED` entries to allocate the dependency list.
+    for (const Elf64Dyn* dyn = dynamic; dyn->tag != DT_NULL; ++dyn) {
+        if (dyn->tag == DT_NEEDED) {
+            dso->needed_len += 1;
+        }
+    }
+    dso->needed = dso->needed_len ? alloc(sizeof(uint64_t) * dso->needed_len) : 0;
+
+    // Decode `.dynamic` section of the `dso`.
+    unsigned needed_idx = 0;
+    uint64_t verdef = 0;
+    uint64_t verneed = 0;
+    for (const Elf64Dyn* dyn = dynamic; dyn->tag != DT_NULL; ++dyn) {
+        if (dyn->tag == DT_NEEDED) {
+            dso->needed[needed_idx++] = dyn->val;
+        } else if (dyn->tag < DT_MAX_CNT) {
+            dso->dynamic[dyn->tag] = dyn->val;
+        } else if (dyn->tag == DT_VERSYM) {
+            dso->versym = (const uint16_t*)(dso->base + dyn->val);
+        } else if (dyn->tag == DT_VERDEF) {
+            verdef = dyn->val;
+        } else if (dyn->tag == DT_VERNEED) {
+            verneed = dyn->val;
+        }
+    }
+
+    // Check for string table entries.
+    ERROR_ON(dso->dynamic[DT_STRTAB] == 0, "DT_STRTAB missing in dynamic section!");
+    ERROR_ON(dso->dynamic[DT_STRSZ] == 0, "DT_STRSZ missing in dynamic section!");
+
+    // Check for symbol table entries.
+    ERROR_ON(dso->dynamic[DT_SYMTAB] == 0, "DT_SYMTAB missing in dynamic section!");
+    ERROR_ON(dso->dynamic[DT_SYMENT] == 0, "DT_SYMENT missing in dynamic section!");
+    ERROR_ON(dso->dynamic[DT_SYMENT] != sizeof(Elf64Sym), "ELf64Sym size miss-match!");
+
+    // Check for SystemV hash table. We only support SystemV hash tables
+    // `DT_HASH`, not gnu hash tables `DT_GNU_HASH`.
+    ERROR_ON(dso->dynamic[DT_HASH] == 0, "DT_HASH missing in dynamic section!");
+
+    if (dso->versym) {
+        decode_versions(ld, dso, verdef, verneed);
+    }
+}
+
+uint64_t get_num_dynsyms(const Dso* dso) {
+    ERROR_ON(dso->dynamic[DT_HASH] == 0, "DT_HASH missing in dynamic section!");
+
+    // Get SystemV hash table.
+    const uint32_t* hashtab = (const uint32_t*)(dso->base + dso->dynamic[DT_HASH]);
+
+    // SystemV hash table layout:
+    //   nbucket
+    //   nchain
+    //   bucket[nbuckets]
+    //   chain[nchains]
+    //
+    // From the SystemV ABI - Dynamic Linking - Hash Table:
+    //   Both `bucket` and `chain` hold symbol table indexes. Chain
+    //   table entries parallel the symbol table. The number of symbol
+    //   table entries should equal `nchain`.
+    return hashtab[1];
+}
+
+const char* get_str(const Dso* dso, uint64_t idx) {
+    ERROR_ON(dso->dynamic[DT_STRSZ] < idx, "String table indexed out-of-bounds!");
+    return (const char*)(dso->base + dso->dynamic[DT_STRTAB] + idx);
+}
+
+const Elf64Sym* get_sym(const Dso* dso, uint64_t idx) {
+    ERROR_ON(get_num_dynsyms(dso) < idx, "Symbol table index out-of-bounds!");
+    return (const Elf64Sym*)(dso->base + dso->dynamic[DT_SYMTAB]) + idx;
+}
+
+const Elf64Rela* get_pltreloca(const Dso* dso, uint64_t idx) {
+    ERROR_ON(dso->dynamic[DT_PLTRELSZ] < sizeof(Elf64Rela) * idx, "PLT relocation table indexed out-of-bounds!");
+    return (const Elf64Rela*)(dso->base + dso->dynamic[DT_JMPREL]) + idx;
+}
+
+const Elf64Rela* get_reloca(const Dso* dso, uint64_t idx) {
+    ERROR_ON(dso->dynamic[DT_RELASZ] < sizeof(Elf64Rela) * idx, "RELA relocation table indexed out-of-bounds!");
+    return (const Elf64Rela*)(dso->base + dso->dynamic[DT_RELA]) + idx;
+}
+
+uint64_t get_num_relocs(const Dso* dso) {
+    return dso->dynamic[DT_RELASZ] / sizeof(Elf64Rela) + dso->dynamic[DT_PLTRELSZ] / sizeof(Elf64Rela);
+}
+
+const Elf64Rela* get_any_reloca(const Dso* dso, uint64_t idx) {
+    const uint64_t nrela = dso->dynamic[DT_RELASZ] / sizeof(Elf64Rela);
+    return idx < nrela ? get_reloca(dso, idx) : get_pltreloca(dso, idx - nrela);
+}
+
+void get_load_span(const Dso* dso, uint64_t* start, uint64_t* end) {
+    *start = (uint64_t)-1;
+    *end = 0;
+    for (unsigned i = 0; i < dso->phnum; ++i) {
+        const Elf64Phdr* ph = &dso->phdr[i];
+        if (ph->type == PT_LOAD) {
+            *start = ph->vaddr < *start ? ph->vaddr : *start;
+            *end = ph->vaddr + ph->memsz > *end ? ph->vaddr + ph->memsz : *end;
+        }
+    }
+    *start = (uint64_t)dso->base + (*start & ~(PAGE_SIZE - 1));
+    *end = (uint64_t)dso->base + align_up(*end, PAGE_SIZE);
+}
+
+// }}}
+// {{{ Symbol lookup
+
+uint32_t get_sym_version(const Dso* dso, uint64_t symidx) {
+    if (dso->versym == 0) {
+        return 0;
+    }
+    const uint32_t ndx = dso->versym[symidx] & VERSYM_NDX_MASK;
+    return ndx < dso->vers_len ? dso->vers[ndx] : 0;
+}
+
+// Check if the definition of the dynamic symbol `symidx` of `dso` matches
+// a reference to the version id `ver`.
+//
+// A versioned reference matches the definition of the same version or an
+// unversioned definition. An unversioned reference (0) matches the default
+// version (`sym@@VER`) or an unversioned definition, but no hidden versions
+// (`sym@VER`).
+static bool match_version(const Dso* dso, uint64_t symidx, uint32_t ver) {
+    if (dso->versym == 0) {
+        return true;
+    }
+    const uint32_t def = get_sym_version(dso, symidx);
+    if (ver == 0) {
+        return !(dso->versym[symidx] & VERSYM_HIDDEN);
+    }
+    return def == ver || def == 0;
+}
+
+// Perform naive lookup for global symbol definition.
+//
+// For simplicity this lookup doesn't use the hash table (`DT_HASH` |
+// `DT_GNU_HASH`) but rather iterates of the dynamic symbol table. Using the
+// hash table doesn't change the lookup result, however it yields better
+// performance for large symbol tables.
+//
+// `dso`          A handle to the dso which dynamic symbol table should be searched.
+// `symname`     Name of the symbol to look up.
+// `ver`         Version id of the symbol to look up (0 for the default version).
+// `tls`         Look up thread local (`STT_TLS`) instead of object, function
+//               or indirect function (`STT_GNU_IFUNC`) symbols.
+const Elf64Sym* find_sym(const Dso* dso, const char* symname, uint32_t ver, bool tls) {
+    for (unsigned i = 0; i < get_num_dynsyms(dso); ++i) {
+        const Elf64Sym* sym = get_sym(dso, i);
+        const unsigned type = ELF64_ST_TYPE(sym->info);
+
+        if ((tls ? type == STT_TLS : (type == STT_OBJECT || type == STT_FUNC || type == STT_GNU_IFUNC)) &&
+            (ELF64_ST_BIND(sym->info) == STB_GLOBAL || ELF64_ST_BIND(sym->info) == STB_WEAK) && sym->shndx != SHN_UNDEF) {
+            if (strcmp(symname, get_str(dso, sym->name)) == 0 && match_version(dso, i, ver)) {
+                return sym;
+            }
+        }
+    }
+    return 0;
+}
+
+// Indirect functions are bound to the implementation selected by their
+// resolver, hence the resolver runs each time the symbol is bound.
+void* lookup_sym(const Loader* ld, const Dso* dso, const char* symname, uint32_t ver) {
+    const Elf64Sym* sym = find_sym(dso, symname, ver, false /* tls */);
+    if (sym == 0) {
+        DYNLD_PROBE2(lookup_miss, dso->name, symname);
+        return 0;
+    }
+    if (ELF64_ST_TYPE(sym->info) == STT_GNU_IFUNC) {
+        return call_ifunc_resolver(ld, dso->base + sym->value);
+    }
+    return dso->base + sym->value;
+}
+
+void* lookup_scope(const Loader* ld, const Dso* scope, unsigned len, const char* symname, uint32_t ver) {
+    void* symaddr = 0;
+    for (unsigned i = 0; i < len && symaddr == 0; ++i) {
+        symaddr = lookup_sym(ld, &scope[i], symname, ver);
+    }
+    return symaddr;
+}
+
+// }}}
+// {{{ Map
+
+const char* check_ehdr(const Elf64Ehdr* ehdr) {
+    // Check ELF magic.
+    if (ehdr->ident[EI_MAG0] != '\x7f' || ehdr->ident[EI_MAG1] != 'E' || ehdr->ident[EI_MAG2] != 'L' || ehdr->ident[EI_MAG3] != 'F') {
+        return "has a wrong ELF magic value";
+    }
+    // Check ELF header size.
+    if (ehdr->ehsize != sizeof(Elf64Ehdr)) {
+        return "has a wrong Elf64Ehdr size";
+    }
+    // Check for 64bit ELF.
+    if (ehdr->ident[EI_CLASS] != ELFCLASS64) {
+        return "is not 64bit ELF";
+    }
+    // Check for OS ABI, objects using GNU extensions (eg indirect functions) are marked as GNU OS ABI.
+    if (ehdr->ident[EI_OSABI] != ELFOSABI_SYSV && ehdr->ident[EI_OSABI] != ELFOSABI_GNU) {
+        return "is not built for SysV OS ABI";
+    }
+    // Check ELF type.
+    if (ehdr->type != ET_DYN) {
+        return "is not a dynamic library";
+    }
+    // Check for Phdr.
+    if (ehdr->phnum == 0) {
+        return "has no Phdr";
+    }
+    // Check PHDR header size.
+    if (ehdr->phentsize != sizeof(Elf64Phdr)) {
+        return "has a wrong Elf64Phdr size";
+    }
+    return 0;
+}
+
+void map_segments(const Elf64Phdr* phdr, uint16_t phnum, int fd, uint8_t* base, const char* path) {
+    // Map in all `PT_LOAD` segments from the `dependency`.
+    for (unsigned i = 0; i < phnum; ++i) {
+        const Elf64Phdr* p = &phdr[i];
+        if (p->type != PT_LOAD) {
+            continue;
+        }
+
+        // Page align start & end address.
+        uint64_t addr_start = p->vaddr & ~(PAGE_SIZE - 1);
+        uint64_t addr_end = (p->vaddr + p->memsz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        // Page aligned end address of the part backed by the file.
+        uint64_t file_end = (p->vaddr + p->filesz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+        // Page align file offset.
+        uint64_t off = p->offset & ~(PAGE_SIZE - 1);
+
+        // Compute segment permissions.
+        uint32_t prot = (p->flags & PF_X ? PROT_EXEC : 0) | (p->flags & PF_R ? PROT_READ : 0) | (p->flags & PF_W ? PROT_WRITE : 0);
+
+        // Mmap segment.
+        ERROR_ON(mmap(base + addr_start, file_end - addr_start, prot, MAP_PRIVATE | MAP_FIXED, fd, off) != base + addr_start,
+                 "Failed to map `PT_LOAD` section %d for dependency '%s'.", i, path);
+
+        // From the SystemV ABI - Program Headers:
+        //   If the segment’s memorysize (memsz) is larger than the file size (filesz), the "extra" bytes are defined to hold the value
+        //   `0` and to follow the segment’s initialized are
+        //
+        // This is typically used by the `.bss` section.
+        // The tail of the last file backed page is cleared, the pages after
+        // it are mapped anonymous as they may lie beyond the end of the file.
+        if (p->memsz > p->filesz) {
+            const uint64_t zero_end = p->vaddr + p->memsz < file_end ? p->vaddr + p->memsz : file_end;
+            memset(base + p->vaddr + p->filesz, 0 /* byte */, zero_end - (p->vaddr + p->filesz) /*len*/);
+        }
+        if (addr_end > file_end) {
+            ERROR_ON(mmap(base + file_end, addr_end - file_end, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1 /* fd */,
+                          0 /* file offset */) != base + file_end,
+                     "Failed to map `.bss` of `PT_LOAD` section %d for dependency '%s'.", i, path);
+        }
+    }
+}
+
+const char* decode_layout(const Elf64Phdr* phdr, uint16_t phnum, ObjectLayout* layout) {
+    uint64_t start = (uint64_t)-1;
+    uint64_t end = 0;
+    memset(layout, 0 /* byte */, sizeof(*layout));
+    layout->align = PAGE_SIZE;
+    for (unsigned i = 0; i < phnum; ++i) {
+        const Elf64Phdr* p = &phdr[i];
+        if (p->type == PT_DYNAMIC) {
+            // Offset to `.dynamic` section.
+            layout->dynoff = p->vaddr;
+            layout->dynsz = p->filesz;
+        } else if (p->type == PT_LOAD) {
+            // Find start & end address.
+            if (p->vaddr < start) {
+                start = p->vaddr;
+            }
+            if (p->vaddr + p->memsz > end) {
+                end = p->vaddr + p->memsz;
+            }
+            // Find largest segment alignment.
+            if (p->align > layout->align) {
+                layout->align = p->align;
+            }
+        }
+    }
+    if (end == 0) {
+        return "has no PT_LOAD segments";
+    }
+    if (layout->dynoff == 0) {
+        return "has no PT_DYNAMIC segment";
+    }
+
+    // Align start address to the next lower page boundary.
+    layout->start = start & ~(PAGE_SIZE - 1);
+    // Align end address to the next higher page boundary.
+    layout->end = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    return 0;
+}
+
+uint8_t* reserve_region(uint64_t len, uint64_t align, const uint8_t* below, uint8_t* fixed) {
+    // Reserve an additional `align` bytes to be able to align the start of the
+    // region if the Kernel chooses the address.
+    const uint64_t reserve_len = len + align - PAGE_SIZE;
+
+    uint8_t* map = MAP_FAILED;
+    if (fixed) {
+        map = mmap(fixed, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1 /* fd */, 0 /* file offset */);
+        if (map == MAP_FAILED) {
+            return 0;
+        }
+        if (map != fixed) {
+            munmap(map, len);
+            return 0;
+        }
+    } else if ((uint64_t)below > reserve_len) {
+        uint8_t* addr = (uint8_t*)(((uint64_t)below - reserve_len) & ~(align - 1));
+        map = mmap(addr, reserve_len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1 /* fd */, 0 /* file offset */);
+        // Kernels before v4.17 treat an unknown flag as hint only.
+        if (map != MAP_FAILED && map != addr) {
+            munmap(map, reserve_len);
+            map = MAP_FAILED;
+        }
+    }
+    if (map == MAP_FAILED) {
+        map = mmap(0 /* addr */, reserve_len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1 /* fd */, 0 /* file offset */);
+    }
+    ERROR_ON(map == MAP_FAILED, "Failed to mmap %ld bytes of address space!\n", len);
+
+    // Align the region and give back the unused head and tail.
+    uint8_t* region = (uint8_t*)align_up((uint64_t)map, align);
+    if (region != map) {
+        munmap(map, region - map);
+    }
+    if (!fixed && map + reserve_len != region + len) {
+        munmap(region + len, (map + reserve_len) - (region + len));
+    }
+    return region;
+}
+
+void map_dso(Loader* ld, Dso* dso, int fd, uint8_t* base, uint64_t dynoff) {
+    dso->base = base;
+    DYNLD_PROBE2(map_start, dso->name, base);
+    map_segments(dso->phdr, dso->phnum, fd, base, dso->path);
+    DYNLD_PROBE2(map_end, dso->name, base);
+    decode_dynamic(ld, dso, dynoff);
+}
+
+bool map_object(Loader* ld, const char* path, Dso* dso) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    memset(dso, 0 /* byte */, sizeof(*dso));
+
+    struct stat st;
+    ERROR_ON(fstat(fd, &st) != 0, "Failed to stat '%s'!", path);
+    dso->id = get_file_id(&st);
+
+    Elf64Ehdr ehdr;
+    if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr) || check_ehdr(&ehdr) != 0) {
+        close(fd);
+        return false;
+    }
+
+    const uint64_t phdrsz = sizeof(Elf64Phdr) * ehdr.phnum;
+    Elf64Phdr* phdr = alloc(phdrsz);
+    ObjectLayout layout;
+    if (pread(fd, phdr, phdrsz, ehdr.phoff) != (ssize_t)phdrsz || decode_layout(phdr, ehdr.phnum, &layout) != 0) {
+        dealloc(phdr);
+        close(fd);
+        return false;
+    }
+    dso->phdr = phdr;
+    dso->phnum = ehdr.phnum;
+
+    uint8_t* region = reserve_region(layout.end - layout.start, layout.align, 0 /* below */, 0 /* fixed */);
+
+    const size_t path_len = strlen(path) + 1;
+    char* path_copy = alloc(path_len);
+    memcpy(path_copy, path, path_len);
+    dso->path = path_copy;
+    dso->name = path_copy;
+    dso->map_start = region;
+    dso->map_len = layout.end - layout.start;
+    map_dso(ld, dso, fd, region - layout.start, layout.dynoff);
+    close(fd);
+    return true;
+}
+
+void unmap_object(Dso* dso) {
+    munmap(dso->map_start, dso->map_len);
+    dealloc((void*)dso->phdr);
+    dealloc((void*)dso->path);
+    if (dso->vers) {
+        dealloc(dso->vers);
+    }
+    if (dso->needed) {
+        dealloc(dso->needed);
+    }
+    memset(dso, 0 /* byte */, sizeof(*dso));
+}
+
+// }}}
+// {{{ Relocation
+
+uint64_t get_reloc_value(const Elf64Rela* reloc, const void* symaddr) {
+    // The addend of base relative relocations is already part of `symaddr`.
+    return ELF64_R_TYPE(reloc->info) == R_X86_64_64 ? (uint64_t)symaddr + reloc->addend : (uint64_t)symaddr;
+}
+
+void patch_reloc(const Dso* dso, const Elf64Rela* reloc, const void* symaddr) {
+    const unsigned reloctype = ELF64_R_TYPE(reloc->info);
+
+    // Perform relocation according to relocation type.
+    switch (reloctype) {
+        case R_X86_64_GLOB_DAT:  /* GOT entry for data objects. */
+        case R_X86_64_JUMP_SLOT: /* PLT entry. */
+        case R_X86_64_64:        /* 64bit relocation (non-lazy). */
+        case R_X86_64_RELATIVE:  /* DSO base relative relocation. */
+        case R_X86_64_IRELATIVE: /* DSO base relative indirect function. */
+            // Patch storage unit of relocation with absolute address of the symbol.
+            *(uint64_t*)(dso->base + reloc->offset) = get_reloc_value(reloc, symaddr);
+            break;
+        case R_X86_64_COPY: /* Reference to global variable in shared ELF file. */
+            // Copy initial value of variable into relocation address.
+            memcpy(dso->base + reloc->offset, symaddr, get_sym(dso, ELF64_R_SYM(reloc->info))->size);
+            break;
+        default:
+            ERROR_ON(true, "Unsupported relocation type %d!\n", reloctype);
+    }
+}
+
+void relocate(const Loader* ld, const Dso* dso, const Elf64Rela* reloc, const RelocScope* scope) {
+    // Get symbol referenced by relocation.
+    const uint64_t symidx = ELF64_R_SYM(reloc->info);
+    const Elf64Sym* sym = get_sym(dso, symidx);
+    const char* symname = get_str(dso, sym->name);
+
+    // Get relocation type.
+    const unsigned reloctype = ELF64_R_TYPE(reloc->info);
+
+    if (reloctype == R_X86_64_DTPMOD64 || reloctype == R_X86_64_DTPOFF64 || reloctype == R_X86_64_TPOFF64) {
+        ERROR_ON(scope->resolve_tls == 0, "Unsupported relocation type %d in '%s'!", reloctype, dso->name);
+        scope->resolve_tls(scope, dso, reloc);
+        return;
+    }
+
+    // Find symbol address.
+    void* symaddr = 0;
+    if (reloctype == R_X86_64_RELATIVE) {
+        // Symbols address is computed by re-basing the relative address based
+        // on the DSOs base address.
+        symaddr = (void*)(dso->base + reloc->addend);
+    } else if (reloctype == R_X86_64_IRELATIVE) {
+        // Address of a local indirect function, selected by running the
+        // resolver at the base relative address.
+        symaddr = call_ifunc_resolver(ld, dso->base + reloc->addend);
+    } else if (scope->lookup) {
+        symaddr = scope->lookup(scope, dso, reloc, symname, get_sym_version(dso, symidx));
+    } else {
+        // Special handling of `R_X86_64_COPY` relocations.
+        //
+        // The `R_X86_64_COPY` relocation type is used in the main program when
+        // it references an object provided by a shared library (eg extern
+        // declared variable).
+        // The static linker will still allocate storage for the external
+        // object in the main programs `.bss` section and any reference to the
+        // object from the main program are resolved by the static linker to
+        // the location in the `.bss` section directly (relative addressing).
+        // During runtime, when resolving the `R_X86_64_COPY` relocation, the
+        // dynamic linker will copy the initial value from the shared library
+        // that actually provides the objects symbol into the location of the
+        // main program. References to the object by other shared library are
+        // resolved to the location in the main programs `.bss` section.
+        //
+        // LinkMap:        Relocs:
+        //
+        // main program    { sym: foo, type: R_X86_64_COPY }
+        //      |
+        //      v
+        //    libso        { sym: foo, type: R_X86_64_GLOB_DAT }
+        //                 // Also `foo` is defined in `libso`.
+        //
+        //                                         libso
+        //                                         +-----------+
+        //                                         | .text     |
+        //       main prog                         |           |  ref
+        //       +-----------+                     | ... [foo] |--+
+        //       | .text     |   R_X86_64_GLOB_DAT |           |  |
+        //  ref  |           |   Patch address of  +-----------+  |
+        //    +--| ... [foo] |   foo in .got.      | .got      |  |
+        //    |  |           | +------------------>| foo:      |<-+
+        //    |  +-----------+ |                   |           |
+        //    |  | .bss      | |                   +-----------+
+        //    |  |           | /                   | .data     |
+        //    +->| foo: ...  |<--------------------| foo: ...  |
+        //       |           | R_X86_64_COPY       |           |
+        //       +-----------+ Copy initial value. +-----------+
+        //
+        // The handling of `R_X86_64_COPY` relocation assumes that the main
+        // program is always the first entry in the scope.
+        const unsigned first = reloctype == R_X86_64_COPY ? 1 : 0;
+        if (scope->len > first) {
+            symaddr = lookup_scope(ld, scope->dsos + first, scope->len - first, symname, get_sym_version(dso, symidx));
+        }
+    }
+
+    if (symaddr == 0 && scope->unresolved && scope->unresolved(scope, dso, reloc, symname)) {
+        return;
+    }
+    ERROR_ON(symaddr == 0 && ELF64_ST_BIND(sym->info) != STB_WEAK, "Failed lookup symbol %s while resolving relocations!", symname);
+
+    patch_reloc(dso, reloc, symaddr);
+    if (scope->resolved) {
+        scope->resolved(scope, dso, reloc, symname, symaddr);
+    }
+}
+
+// Maximal number of relocations of the next page prefetched.
+#define RELOC_PREFETCH_MAX 16
+
+// Resolve all relocations of `dso` except `R_X86_64_IRELATIVE` page by page.
+//
+// The static linker sorts relocations by type and symbol, hence applying them
+// in table order jumps between distant GOT, data and vtable pages. Instead the
+// relocations are bucketed by their target page first (stable counting sort,
+// relocations of one page keep the table order) and applied page by page.
+// When starting a page, the targets and symbol entries of the relocations of
+// the next page are prefetched.
+static void relocate_by_page(const Loader* ld, const Dso* dso, const RelocScope* scope) {
+    const uint64_t nrelocs = get_num_relocs(dso);
+    if (nrelocs == 0) {
+        return;
+    }
+    uint64_t start, end;
+    get_load_span(dso, &start, &end);
+    const uint64_t npages = (end - start) / PAGE_SIZE;
+
+    // The (typically larger) array of relocations is allocated first, such
+    // that the first-fit allocator hands out the same blocks again when
+    // relocating the next object.
+    const Elf64Rela** sorted = alloc(sizeof(Elf64Rela*) * nrelocs);
+
+    // Count the relocations of page `p` in `bucket[p + 1]`, such that
+    // `bucket[p]` is the start of page `p` after the prefix sum.
+    uint32_t* bucket = alloc(sizeof(uint32_t) * (npages + 1));
+    memset(bucket, 0 /* byte */, sizeof(uint32_t) * (npages + 1));
+    uint64_t nsorted = 0;
+    for (uint64_t i = 0; i < nrelocs; ++i) {
+        const Elf64Rela* reloc = get_any_reloca(dso, i);
+        if (ELF64_R_TYPE(reloc->info) == R_X86_64_IRELATIVE) {
+            continue;
+        }
+        const uint64_t page = ((uint64_t)dso->base + reloc->offset - start) / PAGE_SIZE;
+        ERROR_ON(page >= npages, "Relocation target 0x%lx of '%s' out of the loaded segments!", reloc->offset, dso->name);
+        bucket[page + 1] += 1;
+        nsorted += 1;
+    }
+    for (uint64_t p = 1; p <= npages; ++p) {
+        bucket[p] += bucket[p - 1];
+    }
+
+    for (uint64_t i = 0; i < nrelocs; ++i) {
+        const Elf64Rela* reloc = get_any_reloca(dso, i);
+        if (ELF64_R_TYPE(reloc->info) != R_X86_64_IRELATIVE) {
+            const uint64_t page = ((uint64_t)dso->base + reloc->offset - start) / PAGE_SIZE;
+            sorted[bucket[page]++] = reloc;
+        }
+    }
+
+    // Apply page by page, `bucket[p]` is the end of page `p` now.
+    uint64_t idx = 0;
+    for (uint64_t p = 0; p < npages; ++p) {
+        const uint64_t page_end = bucket[p];
+        if (idx == page_end) {
+            continue;
+        }
+        for (uint64_t n = page_end; n < nsorted && n < page_end + RELOC_PREFETCH_MAX; ++n) {
+            const uint64_t symidx = ELF64_R_SYM(sorted[n]->info);
+            __builtin_prefetch(dso->base + sorted[n]->offset, 1 /* write */);
+            if (symidx) {
+                __builtin_prefetch(get_sym(dso, symidx));
+            }
+        }
+        for (; idx < page_end; ++idx) {
+            relocate(ld, dso, sorted[idx], scope);
+        }
+    }
+
+    dealloc(sorted);
+    dealloc(bucket);
+}
+
+// Resolve relocations from the PLT & RELA tables.
+//
+// `R_X86_64_IRELATIVE` relocations are resolved in a second pass, as their
+// resolvers may access data which is subject to the other relocations.
+void relocate_object(const Loader* ld, const Dso* dso, const RelocScope* scope) {
+    DYNLD_PROBE2(reloc_start, dso->name, dso->base);
+    for (unsigned pass = 0; pass < 2; ++pass) {
+        const bool irelative = pass == 1;
+        if (!irelative && scope->by_page) {
+            relocate_by_page(ld, dso, scope);
+            continue;
+        }
+
+        // Resolve all relocations in table order, first from the RELA table
+        // found in `dso`, there is typically one relocation per undefined
+        // dynamic object symbol (eg global variables). Then from the PLT jump
+        // table, there is typically one relocation per undefined dynamic
+        // function symbol.
+        for (uint64_t relocidx = 0; relocidx < get_num_relocs(dso); ++relocidx) {
+            const Elf64Rela* reloc = get_any_reloca(dso, relocidx);
+            if ((ELF64_R_TYPE(reloc->info) == R_X86_64_IRELATIVE) == irelative) {
+                relocate(ld, dso, reloc, scope);
+            }
+        }
+    }
+    DYNLD_PROBE2(reloc_end, dso->name, dso->base);
+}
+
+// }}}
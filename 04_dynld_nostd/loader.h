@@ -0,0 +1,238 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#pragma once
+
+// Core of the dynamic linker (`libdynld.a`).
+//
+// Decoding, mapping, symbol lookup and relocation of a single shared object,
+// independent of the process startup in `dynld.c`. All state shared between
+// objects lives in an explicit `Loader` context, such that the core can also
+// be driven in-process (see `test/loader_checker.cc` and
+// `test/loader_bench.cc`).
+//
+// Errors are fatal (`ERROR_ON`) unless noted otherwise.
+
+#include <elf.h>
+#include <syscalls.h>
+
+#include "dynld.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum {
+    // Hard-coded page size.
+    // We assert against the `AT_PAGESZ` auxiliary vector entry.
+    PAGE_SIZE = 4096,
+};
+
+// Identity of a file, changes if the file is replaced or modified.
+typedef struct {
+    uint64_t dev;         // Device of the file.
+    uint64_t ino;         // Inode of the file.
+    uint64_t size;        // Size of the file.
+    uint64_t mtime_sec;   // Modification time of the file (seconds).
+    uint64_t mtime_nsec;  // Modification time of the file (nanoseconds).
+} FileId;
+
+static inline FileId get_file_id(const struct stat* st) {
+    FileId id;
+    id.dev = st->st_dev;
+    id.ino = st->st_ino;
+    id.size = st->st_size;
+    id.mtime_sec = st->st_mtime_sec;
+    id.mtime_nsec = st->st_mtime_nsec;
+    return id;
+}
+
+static inline uint64_t align_up(uint64_t val, uint64_t align) {
+    return (val + align - 1) & ~(align - 1);
+}
+
+// Handle returned by `dlopen` (see `DlHandle` in `dynld.c`).
+typedef struct DlHandle DlHandle;
+
+typedef struct {
+    uint8_t* base;                 // Base address.
+    void (*entry)();               // Entry function.
+    const Elf64Phdr* phdr;         // Program headers.
+    uint16_t phnum;                // Number of program headers.
+    uint64_t dynamic[DT_MAX_CNT];  // `.dynamic` section entries.
+    Elf64Dyn* dyn;                 // `.dynamic` section.
+    uint64_t* needed;              // Shared object dependencies (`DT_NEEDED` entries, allocated).
+    uint32_t needed_len;           // Number of `DT_NEEDED` entries (SO dependencies).
+    uint32_t* deps;                // Link map index of each `DT_NEEDED` entry (allocated).
+    const char* name;              // Name the object was requested with (0 for the main program).
+    const char* path;              // Path of the object file (allocated, 0 for the main program).
+    FileId id;                     // Identity of the object file.
+    uint8_t* map_start;            // Start of the address range reserved for the object (0 for the main program).
+    uint64_t map_len;              // Length of the address range reserved for the object.
+    uint32_t refcnt;               // Number of references by `dlopen` and by dependent objects.
+    DlHandle* handle;              // Handle returned by `dlopen` (allocated, 0 if none).
+    uint64_t tls_modid;            // TLS module id (0 if the object has no `PT_TLS` segment).
+    uint64_t tls_offset;           // Offset of the TLS block below the thread pointer.
+    const uint16_t* versym;        // Version index of each dynamic symbol (`DT_VERSYM`, 0 if unversioned).
+    uint32_t* vers;                // Version id by version index (allocated, see `decode_versions`).
+    uint32_t vers_len;             // Number of entries in `vers`.
+    uint32_t* direct;              // Provider of each dynamic symbol (allocated, 0 if disabled, see `DirectProvider`).
+} Dso;
+
+// Interned symbol version names.
+//
+// Each distinct version name gets a version id (starting at 1, 0 denotes no
+// version). Version definitions and requirements of each object are
+// translated to version ids once when the object is decoded (see
+// `decode_versions`), matching versions during symbol lookup is then an
+// integer compare.
+typedef struct {
+    const char** names;  // Version name by version id - 1 (allocated).
+    uint32_t* hashes;    // ELF hash of the version name by version id - 1 (allocated).
+    uint32_t len;        // Number of interned versions.
+    uint32_t cap;        // Capacity of `names` and `hashes`.
+    uint32_t* buckets;   // Hash table of version ids, `0` marks an empty bucket (allocated).
+    uint32_t nbuckets;   // Number of buckets (power of two).
+} VersionTable;
+
+// Context shared by all objects decoded, mapped and relocated together.
+typedef struct {
+    DynldCpuFeatures cpu;   // CPU features passed to IFUNC resolvers.
+    VersionTable versions;  // Version ids of all decoded objects.
+} Loader;
+
+// Initialize `ld` and detect the CPU features via CPUID and the
+// `AT_HWCAP`/`AT_HWCAP2` auxiliary vector entries.
+void loader_init(Loader* ld, uint64_t hwcap, uint64_t hwcap2);
+
+// Release the resources of `ld`. Objects decoded with `ld` must not be used
+// for symbol lookup afterwards.
+void loader_fini(Loader* ld);
+
+// Run the IFUNC resolver at `resolver` and return the selected implementation.
+void* call_ifunc_resolver(const Loader* ld, const uint8_t* resolver);
+
+// Decode the `.dynamic` section at `dynoff` of `dso`, which is mapped at
+// `dso->base`.
+void decode_dynamic(Loader* ld, Dso* dso, uint64_t dynoff);
+
+uint64_t get_num_dynsyms(const Dso* dso);
+const char* get_str(const Dso* dso, uint64_t idx);
+const Elf64Sym* get_sym(const Dso* dso, uint64_t idx);
+const Elf64Rela* get_pltreloca(const Dso* dso, uint64_t idx);
+const Elf64Rela* get_reloca(const Dso* dso, uint64_t idx);
+
+// Get the number of relocations in the RELA and the PLT tables of `dso`.
+uint64_t get_num_relocs(const Dso* dso);
+
+// Get relocation `idx` of the RELA table followed by the PLT table of `dso`.
+const Elf64Rela* get_any_reloca(const Dso* dso, uint64_t idx);
+
+// Get the page aligned address range spanned by the `PT_LOAD` segments of
+// `dso`.
+void get_load_span(const Dso* dso, uint64_t* start, uint64_t* end);
+
+// Get the version id of the dynamic symbol `symidx` of `dso` (0 if unversioned).
+uint32_t get_sym_version(const Dso* dso, uint64_t symidx);
+
+// Find the definition of the global symbol `symname` with the version id
+// `ver` (0 for the default version) in `dso`, or of the thread local symbol if
+// `tls` is set. Returns 0 if not defined by `dso`.
+const Elf64Sym* find_sym(const Dso* dso, const char* symname, uint32_t ver, bool tls);
+
+// Lookup global symbol and return address if symbol was found.
+void* lookup_sym(const Loader* ld, const Dso* dso, const char* symname, uint32_t ver);
+
+// Lookup global symbol in the objects `scope` in order.
+void* lookup_scope(const Loader* ld, const Dso* scope, unsigned len, const char* symname, uint32_t ver);
+
+// Validate the ELF header `ehdr` of a shared object.
+// Returns a description of the first problem found (eg "is not 64bit ELF"),
+// or 0 if `ehdr` is valid.
+const char* check_ehdr(const Elf64Ehdr* ehdr);
+
+// Map all `PT_LOAD` segments of the `phdr` of the open file `fd` at `base`.
+//
+// The address space at `base` must already be reserved.
+void map_segments(const Elf64Phdr* phdr, uint16_t phnum, int fd, uint8_t* base, const char* path);
+
+// Layout of the `PT_LOAD` segments and the `.dynamic` section of an object,
+// relative to a base address of 0.
+typedef struct {
+    uint64_t start;   // Page aligned start address of all `PT_LOAD` segments.
+    uint64_t end;     // Page aligned end address of all `PT_LOAD` segments.
+    uint64_t align;   // Maximal alignment of all `PT_LOAD` segments (at least `PAGE_SIZE`).
+    uint64_t dynoff;  // Offset to the `.dynamic` section from the base address.
+    uint64_t dynsz;   // Size of the `.dynamic` section.
+} ObjectLayout;
+
+// Decode the `layout` of a shared object from its program headers.
+// Returns a description of the problem if the `PT_LOAD` or `PT_DYNAMIC`
+// segments are missing, or 0 on success.
+const char* decode_layout(const Elf64Phdr* phdr, uint16_t phnum, ObjectLayout* layout);
+
+// Reserve `len` bytes of `PROT_NONE` address space aligned to `align`.
+//
+// The region is placed right below `below` (if not 0) with
+// `MAP_FIXED_NOREPLACE`, if that range is already in use the Kernel chooses
+// the address.
+// If `fixed` is not 0 the region is placed exactly at `fixed` instead, in that
+// case 0 is returned if the range is in use.
+uint8_t* reserve_region(uint64_t len, uint64_t align, const uint8_t* below, uint8_t* fixed);
+
+// Map the `PT_LOAD` segments `dso->phdr` of the open file `fd` at `base` and
+// decode the `.dynamic` section at `dynoff`.
+//
+// The address space of the segments must already be reserved (see
+// `reserve_region`).
+void map_dso(Loader* ld, Dso* dso, int fd, uint8_t* base, uint64_t dynoff);
+
+// Map the shared object `path` at an address chosen by the Kernel and decode
+// it into `dso`, without loading its dependencies.
+// Returns `false` if the file can't be opened or is not a shared object.
+bool map_object(Loader* ld, const char* path, Dso* dso);
+
+// Unmap `dso` mapped by `map_object` and release its resources.
+void unmap_object(Dso* dso);
+
+// Get the value the target of `reloc` is patched with for the resolved symbol
+// address `symaddr`: S + A for `R_X86_64_64` and S for the other types (the
+// addend of base relative relocations is already part of `symaddr`).
+uint64_t get_reloc_value(const Elf64Rela* reloc, const void* symaddr);
+
+// Patch the target of `reloc` of `dso` with the resolved symbol address
+// `symaddr` according to the relocation type.
+void patch_reloc(const Dso* dso, const Elf64Rela* reloc, const void* symaddr);
+
+// Symbol lookup scope and hooks of the dynamic linker driving the relocation
+// of an object (see `relocate`). Hooks which are 0 are not called.
+typedef struct RelocScope RelocScope;
+struct RelocScope {
+    const Dso* dsos;  // Objects searched for symbols in order.
+    unsigned len;     // Number of objects in `dsos`.
+    bool by_page;     // Apply the relocations in target page order (see `relocate_object`).
+    void* ctx;        // Context of the hooks.
+
+    // Lookup the symbol `symname` with the version id `ver` referenced by
+    // `reloc` of `dso` instead of searching `dsos`. Returns 0 if not found.
+    void* (*lookup)(const RelocScope* scope, const Dso* dso, const Elf64Rela* reloc, const char* symname, uint32_t ver);
+    // Resolve the thread local relocation `reloc` of `dso`. Thread local
+    // relocations are not supported without this hook.
+    void (*resolve_tls)(const RelocScope* scope, const Dso* dso, const Elf64Rela* reloc);
+    // Handle `reloc` of `dso` whose symbol `symname` was not found. Returns
+    // `true` if handled, else undefined weak symbols resolve to `0` and
+    // undefined non-weak symbols are an error.
+    bool (*unresolved)(const RelocScope* scope, const Dso* dso, const Elf64Rela* reloc, const char* symname);
+    // Called after `reloc` of `dso` was patched with `symaddr`.
+    void (*resolved)(const RelocScope* scope, const Dso* dso, const Elf64Rela* reloc, const char* symname, const void* symaddr);
+};
+
+// Resolve the relocation `reloc` of `dso` in `scope` and patch its target.
+//
+// Without a `lookup` hook, symbols are looked up in `scope->dsos` in order,
+// `R_X86_64_COPY` relocations skip the first object (the main program
+// itself).
+void relocate(const Loader* ld, const Dso* dso, const Elf64Rela* reloc, const RelocScope* scope);
+
+// Resolve all relocations of `dso` in `scope` (see `relocate`).
+void relocate_object(const Loader* ld, const Dso* dso, const RelocScope* scope);
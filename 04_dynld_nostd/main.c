@@ -3,19 +3,94 @@
 // Copyright (c) 2020, Johannes Stoelp <dev@memzero.de>
 
 #include <io.h>
+#include <syscalls.h>
+
+#include "dynld.h"
+
+#include <stdint.h>
 
 // API of `libgreet.so`.
 extern const char* get_greet();
 extern const char* get_greet2();
+extern const char* get_greet_isa();
 extern int gCalled;
+extern __thread int gGreetCalls;
+
+// Thread local variable of the main program -> accessed relative to the
+// thread pointer without relocation (local-exec model).
+static __thread int tMainCalls = 40;
+
+static const char* isa_avx512() {
+    return "avx512";
+}
+
+static const char* isa_avx2() {
+    return "avx2";
+}
+
+static const char* isa_baseline() {
+    return "baseline";
+}
 
-void _start() {
+static const char* (*resolve_isa(uint64_t hwcap, const DynldCpuFeatures* cpu))() {
+    (void)hwcap;
+    if (cpu->usable & DYNLD_CPU_AVX512F) {
+        return isa_avx512;
+    }
+    return (cpu->usable & DYNLD_CPU_AVX2) ? isa_avx2 : isa_baseline;
+}
+
+// Local indirect function -> generates IRELATIVE relocation (R_X86_64_IRELATIVE).
+static const char* isa() __attribute__((ifunc("resolve_isa")));
+
+// `prctx` is the process context block passed by the dynamic linker (SystemV
+// ABI layout: argc, argv, envp, auxv).
+void _start(const uint64_t* prctx) {
     pfmt("Running _start() @ %s\n", __FILE__);
 
+    const uint64_t argc = prctx[0];
+    const char** argv = (const char**)(prctx + 1);
+    for (uint64_t i = 1; i < argc; ++i) {
+        pfmt("argv[%d] = %s\n", i, argv[i]);
+    }
+
     // Call function from libgreet.so -> generates PLT relocations (R_X86_64_JUMP_SLOT).
     pfmt("get_greet()  -> %s\n", get_greet());
     pfmt("get_greet2() -> %s\n", get_greet2());
 
+    // Call indirect functions, bound to the implementation for this CPU.
+    pfmt("get_greet_isa() -> %s\n", get_greet_isa());
+    pfmt("isa() -> %s\n", isa());
+
+    // Read the clock and the current CPU via the vDSO (no system call) if the
+    // dynamic linker resolved the vDSO functions.
+    struct timespec ts;
+    unsigned cpu = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    getcpu(&cpu, 0 /* node */);
+    pfmt("vdso: %s (cpu %d)\n", __vdso_clock_gettime ? "yes" : "no", cpu);
+
     // Reference global variable from libgreet.so -> generates RELA relocation (R_X86_64_COPY).
     pfmt("libgreet.so called %d times\n", gCalled);
+
+    // Access thread local variables of the main program and libgreet.so.
+    ++tMainCalls;
+    pfmt("tls: tMainCalls = %d, gGreetCalls = %d\n", tMainCalls, gGreetCalls);
+
+    // Load libplugin.so at runtime, if provided by the dynamic linker.
+    if (dlopen) {
+        void* plugin = dlopen("libplugin.so", RTLD_NOW);
+        if (plugin == 0) {
+            pfmt("dlopen failed: %s\n", dlerror());
+            return;
+        }
+
+        const char* (*get_plugin_greet)() = dlsym(plugin, "get_plugin_greet");
+        if (get_plugin_greet) {
+            pfmt("get_plugin_greet() -> %s\n", get_plugin_greet());
+        } else {
+            pfmt("dlsym failed: %s\n", dlerror());
+        }
+        dlclose(plugin);
+    }
 }
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include <common.h>
+#include <fmt.h>
+#include <io.h>
+#include <syscalls.h>
+
+#include <stdbool.h>
+
+// Launch latency and dTLB misses of a `dynld.so` linked program with the
+// relocations applied in table order compared to page order
+// (`DYNLD_RELOC_ORDER=page`).
+//
+//   reloc_bench <prog> [iterations]
+//
+// The dTLB misses are counted with `perf_event_open` for the user space of
+// the launched programs (inherited counters of the benchmark process), they
+// are reported as unavailable if the Kernel doesn't permit the counters.
+// The programs are launched with `DYNLD_QUIET=1`, such that tracing each
+// relocation doesn't dominate, and their output is discarded.
+//
+// Each symbol relocation of `libbig.so` still scans its dynamic symbols,
+// hence the launch latency mostly measures symbol lookup. The order itself
+// is measured in-process with memoized lookups by `../test/loader_bench`.
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    ERROR_ON(clock_gettime(CLOCK_MONOTONIC, &ts) != 0, "Failed to read CLOCK_MONOTONIC!");
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t parse_num(const char* str) {
+    uint64_t num = 0;
+    for (; *str >= '0' && *str <= '9'; ++str) {
+        num = num * 10 + (*str - '0');
+    }
+    return num;
+}
+
+// Start `prog` with `envp` and stdout/stderr redirected to `devnull` and wait
+// for it to exit.
+static void launch(const char* prog, const char** envp, int devnull) {
+    const pid_t pid = fork();
+    ERROR_ON(pid < 0, "Failed to fork!");
+    if (pid == 0) {
+        dup2(devnull, 1);
+        dup2(devnull, 2);
+        const char* argv[] = {prog, 0};
+        execve(prog, (char* const*)argv, (char* const*)envp);
+        _exit(1);
+    }
+    ERROR_ON(wait4(pid, 0 /* wstatus */, 0 /* options */, 0 /* rusage */) != pid, "Failed to wait for %s!", prog);
+}
+
+// Open a counter of dTLB misses of operation `op` of this process and the
+// processes forked afterwards. Returns -1 if not permitted.
+static int open_dtlb_counter(uint64_t op) {
+    struct perf_event_attr attr;
+    memset(&attr, 0 /* byte */, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | op << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    attr.flags = PERF_ATTR_FLAG_INHERIT | PERF_ATTR_FLAG_EXCLUDE_KERNEL | PERF_ATTR_FLAG_EXCLUDE_HV;
+    return perf_event_open(&attr, 0 /* pid */, -1 /* cpu */, -1 /* group_fd */, 0 /* flags */);
+}
+
+static uint64_t read_counter(int fd) {
+    uint64_t val = 0;
+    if (fd < 0 || read(fd, &val, sizeof(val)) != sizeof(val)) {
+        return 0;
+    }
+    return val;
+}
+
+typedef struct {
+    const char** envp;      // Environment of the launched program.
+    uint64_t ns;            // Total launch time.
+    uint64_t load_misses;   // dTLB load misses.
+    uint64_t store_misses;  // dTLB store misses.
+} Result;
+
+// Launch `prog` once with the environment of `res` and accumulate the
+// launch time and dTLB misses in `res`.
+static void run(const char* prog, Result* res, int devnull, const int counters[2]) {
+    const uint64_t load_start = read_counter(counters[0]);
+    const uint64_t store_start = read_counter(counters[1]);
+    const uint64_t start = now_ns();
+    launch(prog, res->envp, devnull);
+    res->ns += now_ns() - start;
+    res->load_misses += read_counter(counters[0]) - load_start;
+    res->store_misses += read_counter(counters[1]) - store_start;
+}
+
+static void report(const char* name, const Result* res, uint64_t iters, bool have_counters) {
+    if (have_counters) {
+        pfmt("  %s: %ld us/launch, %ld dTLB load misses/launch, %ld dTLB store misses/launch\n", name, res->ns / iters / 1000,
+             res->load_misses / iters, res->store_misses / iters);
+    } else {
+        pfmt("  %s: %ld us/launch, dTLB misses n/a\n", name, res->ns / iters / 1000);
+    }
+}
+
+void entry(const uint64_t* prctx) {
+    const uint64_t argc = *prctx;
+    const char** argv = (const char**)(prctx + 1);
+    const char** envv = (const char**)(argv + argc + 1);
+
+    ERROR_ON(argc < 2, "Usage: %s <prog> [iterations]", argv[0]);
+    const char* prog = argv[1];
+    const uint64_t iters = argc > 2 ? parse_num(argv[2]) : 100;
+    ERROR_ON(iters == 0, "Invalid number of iterations!");
+
+    const int devnull = open("/dev/null", O_RDWR);
+    ERROR_ON(devnull < 0, "Failed to open /dev/null!");
+
+    uint64_t envc = 0;
+    while (envv[envc]) {
+        ++envc;
+    }
+
+    const int counters[2] = {open_dtlb_counter(PERF_COUNT_HW_CACHE_OP_READ), open_dtlb_counter(PERF_COUNT_HW_CACHE_OP_WRITE)};
+    const bool have_counters = counters[0] >= 0 && counters[1] >= 0;
+
+    // Environment of the benchmark extended by the relocation order.
+    const char* table_envv[envc + 3];
+    const char* page_envv[envc + 3];
+    memcpy(table_envv, envv, sizeof(const char*) * envc);
+    memcpy(page_envv, envv, sizeof(const char*) * envc);
+    table_envv[envc] = "DYNLD_RELOC_ORDER=table";
+    page_envv[envc] = "DYNLD_RELOC_ORDER=page";
+    table_envv[envc + 1] = page_envv[envc + 1] = "DYNLD_QUIET=1";
+    table_envv[envc + 2] = page_envv[envc + 2] = 0;
+
+    Result table = {table_envv, 0, 0, 0};
+    Result page = {page_envv, 0, 0, 0};
+
+    // Warm up the page cache.
+    launch(prog, table_envv, devnull);
+
+    // Alternate both orders, such that noise affects both alike.
+    for (uint64_t i = 0; i < iters; ++i) {
+        run(prog, &table, devnull, counters);
+        run(prog, &page, devnull, counters);
+    }
+
+    pfmt("%s: %ld launches\n", prog, iters);
+    report("table order", &table, iters, have_counters);
+    report("page order ", &page, iters, have_counters);
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#pragma once
+
+#include <stdint.h>
+
+// Static tracepoints (USDT) in the format of systemtap's `sys/sdt.h`.
+//
+// Each probe is a single `nop` at the probe site, described by an entry in the
+// non-allocated `.note.stapsdt` section:
+//   - Address of the probe site and of `_.stapsdt.base` (to detect prelinking).
+//   - Semaphore address (always 0, probes are not guarded).
+//   - Provider, name and argument specification (eg `8@%rdi 8@-16(%rbp)`).
+// Tools like `perf probe sdt_dynld:<name>` or bpftrace (`usdt:...:dynld:<name>`)
+// replace the `nop` with a breakpoint, hence disabled probes cost a `nop`.
+//
+// As the note section is not allocated, the static linker resolves its
+// addresses and no dynamic relocations are emitted (see `dynld.so` Makefile
+// target). All arguments are passed as 64 bit unsigned values.
+
+#define SDT_PROVIDER "dynld"
+
+// clang-format off
+#define SDT_NOTE(name, args)                                                   \
+    "990: nop\n\t"                                                             \
+    ".pushsection .note.stapsdt, \"\", \"note\"\n\t"                           \
+    ".balign 4\n\t"                                                            \
+    ".4byte 992f-991f, 994f-993f, 3\n\t"                                       \
+    "991: .asciz \"stapsdt\"\n\t"                                              \
+    "992: .balign 4\n\t"                                                       \
+    "993: .8byte 990b\n\t"                                                     \
+    ".8byte _.stapsdt.base\n\t"                                                \
+    ".8byte 0\n\t"                                                             \
+    ".asciz \"" SDT_PROVIDER "\"\n\t"                                          \
+    ".asciz \"" #name "\"\n\t"                                                 \
+    ".asciz \"" args "\"\n\t"                                                  \
+    "994: .balign 4\n\t"                                                       \
+    ".popsection\n\t"                                                          \
+    ".ifndef _.stapsdt.base\n\t"                                               \
+    ".pushsection .stapsdt.base, \"aG\", \"progbits\", .stapsdt.base, comdat\n\t" \
+    ".weak _.stapsdt.base\n\t"                                                 \
+    ".hidden _.stapsdt.base\n\t"                                               \
+    "_.stapsdt.base: .space 1\n\t"                                             \
+    ".size _.stapsdt.base, 1\n\t"                                              \
+    ".popsection\n\t"                                                          \
+    ".endif"
+// clang-format on
+
+#define SDT_ARG(a) "nor"((uint64_t)(a))
+
+#define DYNLD_PROBE0(name) asm volatile(SDT_NOTE(name, "") ::)
+#define DYNLD_PROBE1(name, a1) asm volatile(SDT_NOTE(name, "8@%0") ::SDT_ARG(a1))
+#define DYNLD_PROBE2(name, a1, a2) asm volatile(SDT_NOTE(name, "8@%0 8@%1") ::SDT_ARG(a1), SDT_ARG(a2))
+#define DYNLD_PROBE3(name, a1, a2, a3) asm volatile(SDT_NOTE(name, "8@%0 8@%1 8@%2") ::SDT_ARG(a1), SDT_ARG(a2), SDT_ARG(a3))
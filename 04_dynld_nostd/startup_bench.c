@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include <common.h>
+#include <fmt.h>
+#include <io.h>
+#include <syscalls.h>
+
+#include <stdbool.h>
+
+// Launch latency of programs started by different builds of the dynamic
+// linker, eg `main` (`dynld.so`, -O0) against `main-release`
+// (`dynld-release.so`, -O2 and LTO).
+//
+//   startup_bench <iterations> [VAR=VALUE] <prog>...
+//
+// The programs are launched in turns, such that noise affects all of them
+// alike. They are launched with `DYNLD_QUIET=1`, such that tracing each
+// relocation doesn't dominate, and their output is discarded. A `VAR=VALUE`
+// argument adds the environment variable for the next program only, eg
+// `startup_bench 100 ./lazy DYNLD_LAZY=1 ./lazy`.
+
+enum {
+    // Maximal number of programs to compare.
+    MAX_PROGS = 8,
+};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    ERROR_ON(clock_gettime(CLOCK_MONOTONIC, &ts) != 0, "Failed to read CLOCK_MONOTONIC!");
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t parse_num(const char* str) {
+    uint64_t num = 0;
+    for (; *str >= '0' && *str <= '9'; ++str) {
+        num = num * 10 + (*str - '0');
+    }
+    return num;
+}
+
+// Start `prog` with `envp` and stdout/stderr redirected to `devnull` and wait
+// for it to exit.
+static void launch(const char* prog, const char** envp, int devnull) {
+    const pid_t pid = fork();
+    ERROR_ON(pid < 0, "Failed to fork!");
+    if (pid == 0) {
+        dup2(devnull, 1);
+        dup2(devnull, 2);
+        const char* argv[] = {prog, 0};
+        execve(prog, (char* const*)argv, (char* const*)envp);
+        _exit(1);
+    }
+    int wstatus = 0;
+    ERROR_ON(wait4(pid, &wstatus, 0 /* options */, 0 /* rusage */) != pid, "Failed to wait for %s!", prog);
+    ERROR_ON(wstatus != 0, "%s failed with status 0x%x!", prog, wstatus);
+}
+
+void entry(const uint64_t* prctx) {
+    const uint64_t argc = *prctx;
+    const char** argv = (const char**)(prctx + 1);
+    const char** envv = (const char**)(argv + argc + 1);
+
+    ERROR_ON(argc < 3, "Usage: %s <iterations> [VAR=VALUE] <prog>...", argv[0]);
+    const uint64_t iters = parse_num(argv[1]);
+    ERROR_ON(iters == 0, "Invalid number of iterations!");
+
+    // Programs and the environment variable added for each (0 if none).
+    const char* progs[MAX_PROGS];
+    const char* vars[MAX_PROGS];
+    uint64_t nprogs = 0;
+    const char* var = 0;
+    for (uint64_t i = 2; i < argc; ++i) {
+        bool is_var = false;
+        for (const char* c = argv[i]; *c && !is_var; ++c) {
+            is_var = *c == '=';
+        }
+        if (is_var) {
+            var = argv[i];
+            continue;
+        }
+        ERROR_ON(nprogs == MAX_PROGS, "At most %d programs supported!", MAX_PROGS);
+        progs[nprogs] = argv[i];
+        vars[nprogs++] = var;
+        var = 0;
+    }
+    ERROR_ON(nprogs == 0, "Usage: %s <iterations> [VAR=VALUE] <prog>...", argv[0]);
+
+    const int devnull = open("/dev/null", O_RDWR);
+    ERROR_ON(devnull < 0, "Failed to open /dev/null!");
+
+    // Environment of the benchmark extended by `DYNLD_QUIET=1` and the
+    // variable of the launched program.
+    uint64_t envc = 0;
+    while (envv[envc]) {
+        ++envc;
+    }
+    const char* envp[envc + 3];
+    memcpy(envp, envv, sizeof(const char*) * envc);
+    envp[envc] = "DYNLD_QUIET=1";
+
+    // Warm up the page cache.
+    for (uint64_t p = 0; p < nprogs; ++p) {
+        envp[envc + 1] = vars[p];
+        envp[envc + 2] = 0;
+        launch(progs[p], envp, devnull);
+    }
+
+    uint64_t ns[MAX_PROGS] = {0};
+    for (uint64_t i = 0; i < iters; ++i) {
+        for (uint64_t p = 0; p < nprogs; ++p) {
+            envp[envc + 1] = vars[p];
+            envp[envc + 2] = 0;
+            const uint64_t start = now_ns();
+            launch(progs[p], envp, devnull);
+            ns[p] += now_ns() - start;
+        }
+    }
+
+    pfmt("%ld launches\n", iters);
+    for (uint64_t p = 0; p < nprogs; ++p) {
+        pfmt("  %s%s%s: %ld us/launch\n", vars[p] ? vars[p] : "", vars[p] ? " " : "", progs[p], ns[p] / iters / 1000);
+    }
+}
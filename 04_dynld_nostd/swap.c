@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include <io.h>
+
+#include "dynld.h"
+
+#include <stdint.h>
+
+// Program of the hot swap example, `libswap.so` is replaced by
+// `libswap-v2.so` while the program runs (see `dlreplace`).
+
+extern const char* swap_greet();
+
+void _start(const uint64_t* prctx) {
+    (void)prctx;
+
+    // Call function from libswap.so -> generates PLT relocations (R_X86_64_JUMP_SLOT).
+    pfmt("swap_greet() -> %s\n", swap_greet());
+    if (dlreplace == 0) {
+        return;
+    }
+
+    void* swap = dlopen("libswap.so", RTLD_NOLOAD);
+    if (swap == 0 || dlreplace(swap, "libswap-v2.so") == 0) {
+        pfmt("dlreplace failed: %s\n", dlerror());
+        return;
+    }
+
+    // The same PLT entry calls the new version now, the old version is still
+    // mapped until the quiescent point.
+    pfmt("swap_greet() -> %s\n", swap_greet());
+    pfmt("dlquiesce() -> %d\n", dlquiesce());
+    pfmt("swap_greet() -> %s\n", swap_greet());
+
+    // A library without the called function can't replace it.
+    if (dlreplace(swap, "libgreet.so") == 0) {
+        pfmt("dlreplace failed: %s\n", dlerror());
+    }
+    dlclose(swap);
+}
@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#pragma once
+
+#include <common.h>
+#include <syscalls.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Protocol of the zygote mode of `dynld.so` (`DYNLD_ZYGOTE=<socket path>`).
+//
+// A launch request is a single `SOCK_SEQPACKET` message consisting of a
+// `ZygoteRequest` header followed by `argc` argument strings and `envc`
+// environment strings, each `\0` terminated. The file descriptors to use as
+// stdin, stdout and stderr of the launched program are passed as `SCM_RIGHTS`
+// ancillary data (`ZygoteFds`).
+//
+// The zygote closes the connection once the launched program exits.
+
+enum {
+    // Maximal size of a request message.
+    ZYGOTE_MAX_REQUEST = 64 * 1024,
+    // Number of file descriptors passed with a request (stdin, stdout, stderr).
+    ZYGOTE_NUM_FDS = 3,
+};
+
+typedef struct {
+    uint32_t argc;  // Number of argument strings.
+    uint32_t envc;  // Number of environment strings.
+} ZygoteRequest;
+
+// Ancillary data of a request.
+typedef struct {
+    struct cmsghdr hdr;
+    int fds[ZYGOTE_NUM_FDS];
+} ZygoteFds;
+
+// Fill in the socket address for the zygote socket `path`.
+// Returns `false` if `path` is too long.
+static inline bool zygote_addr(struct sockaddr_un* addr, const char* path) {
+    memset(addr, 0 /* byte */, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    for (unsigned i = 0; i < sizeof(addr->sun_path); ++i) {
+        addr->sun_path[i] = path[i];
+        if (path[i] == '\0') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Request the zygote listening on `path` to launch the program with the `0`
+// terminated lists `argv` and `envp` and the standard file descriptors `fds`.
+//
+// Returns the connection to the zygote or -1 on error. The connection is
+// closed by the zygote once the launched program exits (see `zygote_wait`).
+static inline int zygote_request(const char* path, const char* const* argv, const char* const* envp, const int fds[ZYGOTE_NUM_FDS]) {
+    static uint8_t buf[ZYGOTE_MAX_REQUEST];
+
+    // Serialize request.
+    ZygoteRequest* req = (ZygoteRequest*)buf;
+    req->argc = 0;
+    req->envc = 0;
+    uint64_t len = sizeof(ZygoteRequest);
+    for (unsigned l = 0; l < 2; ++l) {
+        for (const char* const* str = l == 0 ? argv : envp; *str; ++str) {
+            for (const char* c = *str;; ++c) {
+                if (len == sizeof(buf)) {
+                    return -1;
+                }
+                buf[len++] = *c;
+                if (*c == '\0') {
+                    break;
+                }
+            }
+            if (l == 0) {
+                req->argc += 1;
+            } else {
+                req->envc += 1;
+            }
+        }
+    }
+
+    struct sockaddr_un addr;
+    if (!zygote_addr(&addr, path)) {
+        return -1;
+    }
+    const int conn = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 /* protocol */);
+    if (conn < 0) {
+        return -1;
+    }
+    if (connect(conn, &addr, sizeof(addr)) != 0) {
+        close(conn);
+        return -1;
+    }
+
+    ZygoteFds ctrl;
+    memset(&ctrl, 0 /* byte */, sizeof(ctrl));
+    ctrl.hdr.cmsg_len = sizeof(ctrl.hdr) + sizeof(ctrl.fds);
+    ctrl.hdr.cmsg_level = SOL_SOCKET;
+    ctrl.hdr.cmsg_type = SCM_RIGHTS;
+    memcpy(ctrl.fds, fds, sizeof(ctrl.fds));
+
+    struct iovec iov = {buf, len};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    if (sendmsg(conn, &msg, 0 /* flags */) != (ssize_t)len) {
+        close(conn);
+        return -1;
+    }
+    return conn;
+}
+
+// Wait until the program launched via the connection `conn` exits and close
+// the connection.
+static inline void zygote_wait(int conn) {
+    uint8_t byte;
+    while (read(conn, &byte, sizeof(byte)) > 0) {
+    }
+    close(conn);
+}
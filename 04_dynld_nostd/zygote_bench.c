@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include <common.h>
+#include <fmt.h>
+
+#include "zygote.h"
+
+// Launch latency of a `dynld.so` linked program via `fork` + `execve`
+// compared to launching it through a `dynld.so` zygote.
+//
+//   zygote_bench <prog> [iterations]
+//
+// The output of the launched programs is discarded.
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    ERROR_ON(clock_gettime(CLOCK_MONOTONIC, &ts) != 0, "Failed to read CLOCK_MONOTONIC!");
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t parse_num(const char* str) {
+    uint64_t num = 0;
+    for (; *str >= '0' && *str <= '9'; ++str) {
+        num = num * 10 + (*str - '0');
+    }
+    return num;
+}
+
+// Start `prog` with `envp` and stdout/stderr redirected to `devnull`.
+static pid_t spawn(const char* prog, const char** envp, int devnull) {
+    const pid_t pid = fork();
+    ERROR_ON(pid < 0, "Failed to fork!");
+    if (pid == 0) {
+        dup2(devnull, 1);
+        dup2(devnull, 2);
+        const char* argv[] = {prog, 0};
+        execve(prog, (char* const*)argv, (char* const*)envp);
+        _exit(1);
+    }
+    return pid;
+}
+
+void entry(const uint64_t* prctx) {
+    const uint64_t argc = *prctx;
+    const char** argv = (const char**)(prctx + 1);
+    const char** envv = (const char**)(argv + argc + 1);
+
+    ERROR_ON(argc < 2, "Usage: %s <prog> [iterations]", argv[0]);
+    const char* prog = argv[1];
+    const uint64_t iters = argc > 2 ? parse_num(argv[2]) : 1000;
+    ERROR_ON(iters == 0, "Invalid number of iterations!");
+
+    const int devnull = open("/dev/null", O_RDWR);
+    ERROR_ON(devnull < 0, "Failed to open /dev/null!");
+
+    // Environment of the zygote, the environment of the benchmark extended
+    // by `DYNLD_ZYGOTE`.
+    char zygote_env[128];
+    fmt(zygote_env, sizeof(zygote_env), "DYNLD_ZYGOTE=/tmp/dynld-zygote-bench.%d", getpid());
+    const char* path = zygote_env + sizeof("DYNLD_ZYGOTE=") - 1;
+
+    uint64_t envc = 0;
+    while (envv[envc]) {
+        ++envc;
+    }
+    const char* zenvv[envc + 2];
+    memcpy(zenvv, envv, sizeof(const char*) * envc);
+    zenvv[envc] = zygote_env;
+    zenvv[envc + 1] = 0;
+
+    // Start the zygote and wait until it accepts requests.
+    const pid_t zygote = spawn(prog, zenvv, devnull);
+    const int fds[ZYGOTE_NUM_FDS] = {devnull, devnull, devnull};
+    const char* pargv[] = {prog, 0};
+    int conn = -1;
+    for (unsigned retry = 0; conn < 0 && retry < 1000000; ++retry) {
+        conn = zygote_request(path, pargv, envv, fds);
+    }
+    ERROR_ON(conn < 0, "Zygote '%s' didn't come up!", path);
+    zygote_wait(conn);
+
+    // Launch via `fork` + `execve`.
+    const uint64_t exec_start = now_ns();
+    for (uint64_t i = 0; i < iters; ++i) {
+        const pid_t pid = spawn(prog, envv, devnull);
+        ERROR_ON(wait4(pid, 0 /* wstatus */, 0 /* options */, 0 /* rusage */) != pid, "Failed to wait for %s!", prog);
+    }
+    const uint64_t exec_ns = now_ns() - exec_start;
+
+    // Launch via the zygote.
+    const uint64_t zygote_start = now_ns();
+    for (uint64_t i = 0; i < iters; ++i) {
+        conn = zygote_request(path, pargv, envv, fds);
+        ERROR_ON(conn < 0, "Failed to send launch request to zygote '%s'!", path);
+        zygote_wait(conn);
+    }
+    const uint64_t zygote_ns = now_ns() - zygote_start;
+
+    kill(zygote, SIGTERM);
+    wait4(zygote, 0 /* wstatus */, 0 /* options */, 0 /* rusage */);
+    unlink(path);
+
+    pfmt("%s: %ld launches\n", prog, iters);
+    pfmt("  fork + execve : %ld us/launch\n", exec_ns / iters / 1000);
+    pfmt("  zygote        : %ld us/launch\n", zygote_ns / iters / 1000);
+}
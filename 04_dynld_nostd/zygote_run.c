@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include <common.h>
+
+#include "zygote.h"
+
+// Launch a program through a `dynld.so` zygote.
+//
+//   zygote_run <socket> <arg0> [args..]
+//
+// The program is launched with the arguments `arg0 args..`, the environment
+// and the standard file descriptors of `zygote_run` and `zygote_run` waits
+// until the program exits.
+void entry(const uint64_t* prctx) {
+    const uint64_t argc = *prctx;
+    const char** argv = (const char**)(prctx + 1);
+    const char** envv = (const char**)(argv + argc + 1);
+
+    ERROR_ON(argc < 3, "Usage: %s <socket> <arg0> [args..]", argv[0]);
+
+    const int fds[ZYGOTE_NUM_FDS] = {0, 1, 2};
+    const int conn = zygote_request(argv[1], argv + 2, envv, fds);
+    ERROR_ON(conn < 0, "Failed to send launch request to zygote '%s'!", argv[1]);
+
+    zygote_wait(conn);
+}
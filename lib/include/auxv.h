@@ -27,7 +27,16 @@
 #define AT_EUID    12 /* [val] Effective user id of process */
 #define AT_GID     13 /* [val] Real group id of process */
 #define AT_EGID    14 /* [val] Effective user id of process */
-#define AT_MAX_CNT 15
+#define AT_HWCAP   16 /* [val] Machine dependent hints about processor capabilities (x86_64: CPUID.1:EDX) */
+#define AT_RANDOM  25 /* [ptr] Address of 16 random bytes */
+#define AT_HWCAP2  26 /* [val] Extension of AT_HWCAP (x86_64: ring 3 MONITOR/MWAIT, FSGSBASE) */
+#define AT_EXECFN  31 /* [ptr] Pathname used to execute the user program */
+#define AT_SYSINFO_EHDR 33 /* [ptr] Address of the ELF header of the vDSO */
+#define AT_MAX_CNT 34
+
+// AT_HWCAP2 - bits (x86_64):
+#define HWCAP2_RING3MWAIT 0x1
+#define HWCAP2_FSGSBASE   0x2
 
 typedef struct {
     uint64_t tag;
@@ -7,15 +7,16 @@
 #include "io.h"
 #include "syscalls.h"
 
-#define ERROR_ON(cond, fmt, ...)                                        \
-    do {                                                                \
-        if ((cond)) {                                                   \
-            efmt("%s:%d " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__); \
-            _exit(1);                                                   \
-        }                                                               \
+#define ERROR_ON(cond, fmt, ...)                                              \
+    do {                                                                      \
+        if (__builtin_expect(!!(cond), 0)) {                                  \
+            error_exit("%s:%d " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__); \
+        }                                                                     \
     } while (0)
 
 
 void* memset(void* s, int c, size_t n);
 void* memcpy(void* d, const void* s, size_t n);
-
+int memcmp(const void* s1, const void* s2, size_t n);
+int strcmp(const char* s1, const char* s2);
+size_t strlen(const char* s);
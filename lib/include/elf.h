@@ -29,6 +29,7 @@
 
 // indent[EI_OSABI]
 #define ELFOSABI_SYSV 0
+#define ELFOSABI_GNU  3 /* SysV with GNU extensions (eg STT_GNU_IFUNC) */
 
 // Objec file `type`.
 #define ET_NONE 0
@@ -65,6 +66,7 @@ typedef struct {
 #define PT_TLS     7 /* Thread local storage */
 
 #define PT_GNU_EH_FRAME 0x6474e550 /* [x86-64] stack unwinding tables */
+#define PT_GNU_RELRO    0x6474e552 /* Read-only after relocation */
 #define PT_LOPROC       0x70000000
 #define PT_HIPROC       0x7fffffff
 
@@ -116,7 +118,15 @@ typedef struct {
 #define DT_FINI_ARRAY   26 /* [ptr] Address of array of termination functions */
 #define DT_INIT_ARRAYSZ 27 /* [val] Size in bytes of the initialization array */
 #define DT_FINI_ARRAYSZ 28 /* [val] Size in bytes of the termination array */
-#define DT_MAX_CNT      29
+#define DT_RUNPATH      29 /* [val] Library search path */
+#define DT_MAX_CNT      30
+
+// Symbol versioning (GNU extension), outside of the `DT_MAX_CNT` range.
+#define DT_VERSYM     0x6ffffff0 /* [ptr] Address of the version index table, parallel to the symbol table */
+#define DT_VERDEF     0x6ffffffc /* [ptr] Address of the version definitions */
+#define DT_VERDEFNUM  0x6ffffffd /* [val] Number of version definitions */
+#define DT_VERNEED    0x6ffffffe /* [ptr] Address of the version requirements */
+#define DT_VERNEEDNUM 0x6fffffff /* [val] Number of version requirements */
 
 typedef struct {
     uint64_t tag;
@@ -139,6 +149,49 @@ typedef struct {
     uint64_t size;   //
 } Elf64Sym;
 
+/// -----------------
+/// Symbol Versioning
+/// -----------------
+
+// Version definition (`DT_VERDEF`), entries are chained by `next`.
+typedef struct {
+    uint16_t version;  // Version of the structure (1).
+    uint16_t flags;    // Version flags (VER_FLG_*).
+    uint16_t ndx;      // Version index, referenced by `DT_VERSYM` entries.
+    uint16_t cnt;      // Number of `Elf64Verdaux` entries, the first one names the version.
+    uint32_t hash;     // ELF hash of the version name.
+    uint32_t aux;      // Offset to the first `Elf64Verdaux` entry.
+    uint32_t next;     // Offset to the next `Elf64Verdef` entry (0 if last).
+} Elf64Verdef;
+
+typedef struct {
+    uint32_t name;  // Version name (index into string table).
+    uint32_t next;  // Offset to the next `Elf64Verdaux` entry (0 if last).
+} Elf64Verdaux;
+
+// Version requirement (`DT_VERNEED`) of one dependency, entries are chained by `next`.
+typedef struct {
+    uint16_t version;  // Version of the structure (1).
+    uint16_t cnt;      // Number of `Elf64Vernaux` entries.
+    uint32_t file;     // Name of the dependency (index into string table).
+    uint32_t aux;      // Offset to the first `Elf64Vernaux` entry.
+    uint32_t next;     // Offset to the next `Elf64Verneed` entry (0 if last).
+} Elf64Verneed;
+
+typedef struct {
+    uint32_t hash;   // ELF hash of the version name.
+    uint16_t flags;  // Version flags (VER_FLG_*).
+    uint16_t other;  // Version index, referenced by `DT_VERSYM` entries.
+    uint32_t name;   // Version name (index into string table).
+    uint32_t next;   // Offset to the next `Elf64Vernaux` entry (0 if last).
+} Elf64Vernaux;
+
+#define VER_FLG_BASE    0x1    /* Version definition of the object itself */
+#define VER_NDX_LOCAL   0      /* Symbol is local */
+#define VER_NDX_GLOBAL  1      /* Symbol is global and unversioned */
+#define VERSYM_HIDDEN   0x8000 /* Symbol is hidden (non-default version, `sym@VER`) */
+#define VERSYM_NDX_MASK 0x7fff
+
 #define ELF64_ST_BIND(i) ((i) >> 4)
 #define ELF64_ST_TYPE(i) ((i)&0xf)
 
@@ -150,6 +203,8 @@ typedef struct {
 #define STT_NOTYPE 0 /* No type. */
 #define STT_OBJECT 1 /* Data Object. */
 #define STT_FUNC   2 /* Function entry point. */
+#define STT_TLS    6 /* Thread local data object, value is the offset in the TLS block. */
+#define STT_GNU_IFUNC 10 /* Indirect function, value is the address of its resolver. */
 
 // Special Section Indicies.
 #define SHN_UNDEF 0     /* Undefined section. */
@@ -179,3 +234,7 @@ typedef struct {
 #define R_X86_64_GLOB_DAT  6 /* Address affected by relocation: `base + offset` */
 #define R_X86_64_JUMP_SLOT 7 /* Address affected by relocation: `base + offset` */
 #define R_X86_64_RELATIVE  8 /* Relative address *`base + offset` = `base + addend` */
+#define R_X86_64_DTPMOD64  16 /* Module ID of the TLS block containing the symbol */
+#define R_X86_64_DTPOFF64  17 /* Offset of the symbol in its TLS block */
+#define R_X86_64_TPOFF64   18 /* Offset of the symbol from the thread pointer (static TLS) */
+#define R_X86_64_IRELATIVE 37 /* Address returned by the resolver at `base + addend` */
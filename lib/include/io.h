@@ -6,3 +6,9 @@
 
 int pfmt(const char* fmt, ...);
 int efmt(const char* fmt, ...);
+
+// Print the formatted message to stderr and exit the process with status 1.
+//
+// Out of line and `cold`, such that the error paths of `ERROR_ON` checks are
+// moved away from the hot code.
+__attribute__((noreturn)) __attribute__((cold)) void error_exit(const char* fmt, ...);
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t, ...
 #include <sys/types.h>  // ssize_t, off_t, ...
 
 extern int dynld_errno;
@@ -14,14 +15,55 @@ extern int dynld_errno;
 //   read(2)
 //   ...
 
-#define O_RDONLY 00
+#define O_RDONLY    00
+#define O_WRONLY    01
+#define O_RDWR      02
+#define O_APPEND    02000
+#define O_DIRECTORY 0200000
+#define AT_FDCWD    -100
 int open(const char* path, int flags);
+int creat(const char* path, mode_t mode);
 int close(int fd);
+int rename(const char* oldpath, const char* newpath);
+int unlink(const char* path);
+
+struct dirent64 {
+    ino_t d_ino;
+    off_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+// dirent64 - types:
+#define DT_DIR 4
+ssize_t getdents64(int fd, void* dirp, size_t count);
 
 #define F_OK 0
 #define R_OK 4
 int access(const char* path, int mode);
 
+struct stat {
+    dev_t st_dev;
+    ino_t st_ino;
+    nlink_t st_nlink;
+    mode_t st_mode;
+    uid_t st_uid;
+    gid_t st_gid;
+    int __pad0;
+    dev_t st_rdev;
+    off_t st_size;
+    blksize_t st_blksize;
+    blkcnt_t st_blocks;
+    long st_atime_sec;
+    long st_atime_nsec;
+    long st_mtime_sec;
+    long st_mtime_nsec;
+    long st_ctime_sec;
+    long st_ctime_nsec;
+    long __unused[3];
+};
+int fstat(int fd, struct stat* statbuf);
+
 ssize_t write(int fd, const void* buf, size_t count);
 ssize_t read(int fd, void* buf, size_t count);
 ssize_t pread(int fd, void* buf, size_t count, off_t offset);
@@ -32,12 +74,213 @@ ssize_t pread(int fd, void* buf, size_t count, off_t offset);
 #define PROT_WRITE 0x2
 #define PROT_EXEC  0x4
 // mmap - flags:
-#define MAP_PRIVATE   0x2
-#define MAP_ANONYMOUS 0x20
-#define MAP_FIXED     0x10
+#define MAP_SHARED          0x1
+#define MAP_PRIVATE         0x2
+#define MAP_ANONYMOUS       0x20
+#define MAP_FIXED           0x10
+#define MAP_NORESERVE       0x4000
+#define MAP_POPULATE        0x8000
+#define MAP_FIXED_NOREPLACE 0x100000
 // mmap - ret:
 #define MAP_FAILED ((void*)-1)
 void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset);
 int munmap(void* addr, size_t length);
+int mprotect(void* addr, size_t length, int prot);
+int mincore(void* addr, size_t length, unsigned char* vec);
+// madvise - advice:
+#define MADV_DONTNEED 4
+int madvise(void* addr, size_t length, int advice);
+
+// io_uring - see io_uring_setup(2), io_uring_enter(2).
+struct io_sqring_offsets {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t flags;
+    uint32_t dropped;
+    uint32_t array;
+    uint32_t resv1;
+    uint64_t user_addr;
+};
+
+struct io_cqring_offsets {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t overflow;
+    uint32_t cqes;
+    uint32_t flags;
+    uint32_t resv1;
+    uint64_t user_addr;
+};
+
+struct io_uring_params {
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    uint32_t flags;
+    uint32_t sq_thread_cpu;
+    uint32_t sq_thread_idle;
+    uint32_t features;
+    uint32_t wq_fd;
+    uint32_t resv[3];
+    struct io_sqring_offsets sq_off;
+    struct io_cqring_offsets cq_off;
+};
+
+struct io_uring_sqe {
+    uint8_t opcode;     // Operation (IORING_OP_*).
+    uint8_t flags;      // IOSQE_* flags.
+    uint16_t ioprio;    // I/O priority.
+    int32_t fd;         // File descriptor to do I/O on.
+    uint64_t off;       // File offset.
+    uint64_t addr;      // Buffer address or path.
+    uint32_t len;       // Buffer length or mode.
+    uint32_t op_flags;  // Operation specific flags (eg open flags).
+    uint64_t user_data;  // Passed back in the completion entry.
+    uint64_t __pad[3];
+};
+
+struct io_uring_cqe {
+    uint64_t user_data;  // `user_data` of the submission entry.
+    int32_t res;         // Result of the operation.
+    uint32_t flags;
+};
+
+// io_uring - mmap offsets:
+#define IORING_OFF_SQ_RING 0x0ULL
+#define IORING_OFF_SQES    0x10000000ULL
+// io_uring - features:
+#define IORING_FEAT_SINGLE_MMAP 0x1
+// io_uring - enter flags:
+#define IORING_ENTER_GETEVENTS 0x1
+// io_uring - opcodes:
+#define IORING_OP_OPENAT 18
+#define IORING_OP_READ   22
+
+int io_uring_setup(uint32_t entries, struct io_uring_params* p);
+int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags);
+
+// socket - see socket(2), unix(7), cmsg(3).
+#define AF_UNIX        1
+#define SOCK_SEQPACKET 5
+#define SOCK_CLOEXEC   02000000
+#define SOL_SOCKET     1
+#define SCM_RIGHTS     1
+struct sockaddr_un {
+    unsigned short sun_family;
+    char sun_path[108];
+};
+struct iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+struct msghdr {
+    void* msg_name;
+    uint32_t msg_namelen;
+    struct iovec* msg_iov;
+    size_t msg_iovlen;
+    void* msg_control;
+    size_t msg_controllen;
+    int msg_flags;
+};
+struct cmsghdr {
+    size_t cmsg_len;
+    int cmsg_level;
+    int cmsg_type;
+};
+int socket(int domain, int type, int protocol);
+int bind(int fd, const struct sockaddr_un* addr, uint32_t addrlen);
+int listen(int fd, int backlog);
+int accept4(int fd, struct sockaddr_un* addr, uint32_t* addrlen, int flags);
+int connect(int fd, const struct sockaddr_un* addr, uint32_t addrlen);
+ssize_t sendmsg(int fd, const struct msghdr* msg, int flags);
+ssize_t recvmsg(int fd, struct msghdr* msg, int flags);
+
+int dup2(int oldfd, int newfd);
+
+// clock_gettime - clocks:
+#define CLOCK_REALTIME  0
+#define CLOCK_MONOTONIC 1
+int clock_gettime(int clockid, struct timespec* tp);
+int gettimeofday(struct timeval* tv, void* tz);
+int getcpu(unsigned* cpu, unsigned* node);
+
+// vDSO - see vdso(7).
+//
+// Functions provided by the Kernel in the vDSO, resolved by the dynamic linker
+// (`dynld.so`). `clock_gettime`, `gettimeofday` and `getcpu` call them if
+// available and fall back to the system call otherwise (eg static programs).
+// Programs must be linked with `-Wl,-z,dynamic-undefined-weak`, otherwise the
+// static linker resolves the undefined weak references to `0`.
+int __vdso_clock_gettime(int clockid, struct timespec* tp) __attribute__((weak));
+int __vdso_gettimeofday(struct timeval* tv, void* tz) __attribute__((weak));
+int __vdso_getcpu(unsigned* cpu, unsigned* node, void* cache) __attribute__((weak));
+
+// wait4 - options:
+#define WNOHANG 1
+// kill - signals:
+#define SIGKILL 9
+#define SIGTERM 15
+pid_t fork(void);
+int execve(const char* path, char* const argv[], char* const envp[]);
+pid_t wait4(pid_t pid, int* wstatus, int options, void* rusage);
+int kill(pid_t pid, int sig);
+pid_t getpid(void);
+
+// arch_prctl - code:
+#define ARCH_SET_FS 0x1002
+int arch_prctl(int code, unsigned long addr);
+
+// perf_event_open - see perf_event_open(2), only the leading fields of
+// `struct perf_event_attr` (`PERF_ATTR_SIZE_VER0`) are provided.
+struct perf_event_attr {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    uint64_t sample_period;
+    uint64_t sample_type;
+    uint64_t read_format;
+    uint64_t flags;  // `PERF_ATTR_FLAG_*` bits.
+    uint32_t wakeup_events;
+    uint32_t bp_type;
+    uint64_t config1;
+};
+// perf_event_open - type:
+#define PERF_TYPE_HARDWARE 0
+#define PERF_TYPE_HW_CACHE 3
+// perf_event_open - config (`PERF_TYPE_HW_CACHE`: id | op << 8 | result << 16):
+#define PERF_COUNT_HW_CACHE_DTLB          3
+#define PERF_COUNT_HW_CACHE_OP_READ       0
+#define PERF_COUNT_HW_CACHE_OP_WRITE      1
+#define PERF_COUNT_HW_CACHE_RESULT_ACCESS 0
+#define PERF_COUNT_HW_CACHE_RESULT_MISS   1
+// perf_event_open - flags:
+#define PERF_ATTR_FLAG_DISABLED       (1ull << 0)
+#define PERF_ATTR_FLAG_INHERIT        (1ull << 1)
+#define PERF_ATTR_FLAG_EXCLUDE_KERNEL (1ull << 5)
+#define PERF_ATTR_FLAG_EXCLUDE_HV     (1ull << 6)
+int perf_event_open(struct perf_event_attr* attr, pid_t pid, int cpu, int group_fd, unsigned long flags);
+
+// futex - see futex(2), op:
+#define FUTEX_WAIT         0
+#define FUTEX_WAKE         1
+#define FUTEX_WAIT_PRIVATE 128
+#define FUTEX_WAKE_PRIVATE 129
+long futex(uint32_t* uaddr, int op, uint32_t val, const struct timespec* timeout);
+
+// clone - see clone(2), threads are created with `thread_create` (see `thread.h`).
+#define CLONE_VM             0x00000100
+#define CLONE_FS             0x00000200
+#define CLONE_FILES          0x00000400
+#define CLONE_SIGHAND        0x00000800
+#define CLONE_THREAD         0x00010000
+#define CLONE_SYSVSEM        0x00040000
+#define CLONE_PARENT_SETTID  0x00100000
+#define CLONE_CHILD_CLEARTID 0x00200000
+
+int sched_yield(void);
 
+// Exit the process (all threads, `exit_group`).
 void _exit(int status);
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Threads and synchronization primitives on top of `clone` and `futex`.
+//
+// Threads share the thread pointer (`%fs`) of the thread creating them, hence
+// they must not access thread local variables. `alloc`/`dealloc` and
+// `dynld_errno` are not thread safe, threads should only use memory allocated
+// up front.
+
+// {{{ Thread
+
+typedef struct {
+    uint32_t tid;         // Thread id, cleared by the Kernel when the thread exits (futex).
+    uint8_t* stack;       // Stack mapping including the guard page.
+    size_t stack_len;     // Length of the stack mapping.
+    void (*fn)(void*);    // Thread function.
+    void* arg;            // Argument of `fn`.
+} Thread;
+
+enum {
+    // Stack size of threads created with `thread_create` (without guard page).
+    THREAD_STACK_SIZE = 256 * 1024,
+};
+
+// Start a thread running `fn(arg)`, it exits when `fn` returns.
+// Returns `false` if the thread could not be created.
+bool thread_create(Thread* t, void (*fn)(void*), void* arg);
+
+// Wait for the thread `t` to exit and release its stack.
+void thread_join(Thread* t);
+
+// Get the number of CPUs the process may run on.
+uint32_t thread_num_cpus(void);
+
+// }}}
+// {{{ Mutex
+
+// Mutex with three states (0 unlocked, 1 locked, 2 locked with waiters), only
+// unlocking a mutex with waiters enters the Kernel.
+typedef struct {
+    uint32_t state;
+} Mutex;
+
+#define MUTEX_INIT {0}
+
+void mutex_lock(Mutex* m);
+bool mutex_trylock(Mutex* m);
+void mutex_unlock(Mutex* m);
+
+// }}}
+// {{{ Condition Variable
+
+typedef struct {
+    uint32_t seq;  // Incremented by each signal (futex).
+} Cond;
+
+#define COND_INIT {0}
+
+// Unlock `m`, wait for a signal and lock `m` again. Spurious wakeups are
+// possible, the caller must re-check its predicate.
+void cond_wait(Cond* c, Mutex* m);
+void cond_signal(Cond* c);
+void cond_broadcast(Cond* c);
+
+// }}}
+// {{{ Barrier
+
+typedef struct {
+    uint32_t count;    // Number of threads to wait for.
+    uint32_t waiting;  // Number of threads waiting in the current generation.
+    uint32_t gen;      // Generation, incremented when all threads arrived (futex).
+} Barrier;
+
+void barrier_init(Barrier* b, uint32_t count);
+
+// Wait until `count` threads called `barrier_wait`. Returns `true` in exactly
+// one of the threads (the last one to arrive).
+bool barrier_wait(Barrier* b);
+
+// }}}
+// {{{ Thread Pool
+
+// Range of loop iterations `[lo, hi)`.
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} PoolRange;
+
+enum {
+    // Capacity of the deque of each worker (power of two).
+    POOL_DEQUE_CAP = 256,
+};
+
+// Chase-Lev work-stealing deque, the owner pushes and pops at `bottom`,
+// other workers steal at `top`.
+typedef struct {
+    int64_t top;                        // Next range to steal.
+    int64_t bottom;                     // Next free slot.
+    PoolRange ring[POOL_DEQUE_CAP];     // Ranges by index modulo `POOL_DEQUE_CAP`.
+} __attribute__((aligned(64))) PoolDeque;
+
+typedef void (*PoolFn)(void* ctx, uint64_t lo, uint64_t hi);
+
+typedef struct {
+    uint32_t nworkers;    // Number of workers including the calling thread (worker 0).
+    Thread* threads;      // Threads of workers 1..nworkers-1 (allocated).
+    PoolDeque* deques;    // Deque by worker (mapped).
+    size_t deques_len;    // Length of the `deques` mapping.
+
+    // Current job.
+    PoolFn fn;            // Loop body.
+    void* ctx;            // Argument of `fn`.
+    uint64_t grain;       // Ranges up to `grain` iterations are not split.
+    uint64_t remaining;   // Iterations not yet run.
+    uint32_t epoch;       // Incremented per job and on shutdown (futex).
+    uint32_t active;      // Workers not yet done with the current job (futex).
+    bool stop;            // Workers exit on the next epoch.
+} Pool;
+
+// Start a pool with `nworkers` workers including the calling thread, or one
+// worker per CPU if `nworkers` is 0.
+void pool_init(Pool* p, uint32_t nworkers);
+
+// Stop the workers and release the resources of `p`.
+void pool_fini(Pool* p);
+
+// Run `fn(ctx, lo, hi)` over disjoint ranges covering `[begin, end)` on all
+// workers and return once all iterations ran.
+//
+// Ranges are split in halves down to `grain` iterations; the halves are pushed
+// to the deque of the splitting worker, idle workers steal the largest (oldest)
+// ranges from other workers. Must only be called by the thread which created
+// the pool.
+void pool_parallel_for(Pool* p, uint64_t begin, uint64_t end, uint64_t grain, PoolFn fn, void* ctx);
+
+// }}}
@@ -52,7 +52,7 @@ void* alloc(unsigned size) {
     // that matches the requested size.
     current = gHead;
     while (current) {
-        if (current->mFree && current->mSize < size) {
+        if (current->mFree && current->mSize >= size) {
             current->mFree = 0;
             return (void*)(current + 1);
         };
@@ -9,11 +9,14 @@
 #endif
 
 void* memset(void* s, int c, size_t n) {
+    // `rep stosb` advances the destination register, hence don't let it
+    // clobber `s` which is returned.
+    void* d = s;
     asm volatile(
         "cld"
         "\n"
         "rep stosb"
-        : "+D"(s), "+c"(n)
+        : "+D"(d), "+c"(n)
         : "a"(c)
         : "memory");
     return s;
@@ -67,12 +70,43 @@ void* memcpy(void* d, const void* s, size_t n) {
     }
 
     // Case 2/3.
+    //
+    // `rep movsb` advances the destination register, hence copy through
+    // `dst` and return the original `d`, which optimizing compilers rely on.
+    void* dst = d;
     asm volatile(
         "cld"
         "\n"
         "rep movsb"
-        : "+D"(d), "+S"(s), "+c"(n)
+        : "+D"(dst), "+S"(s), "+c"(n)
         :
         : "memory");
     return d;
 }
+
+int memcmp(const void* s1, const void* s2, size_t n) {
+    const unsigned char* p1 = s1;
+    const unsigned char* p2 = s2;
+    for (; n; --n, ++p1, ++p2) {
+        if (*p1 != *p2) {
+            return *p1 - *p2;
+        }
+    }
+    return 0;
+}
+
+int strcmp(const char* s1, const char* s2) {
+    while (*s1 == *s2 && *s1) {
+        ++s1;
+        ++s2;
+    }
+    return *(unsigned char*)s1 - *(unsigned char*)s2;
+}
+
+size_t strlen(const char* s) {
+    size_t len = 0;
+    while (s[len]) {
+        ++len;
+    }
+    return len;
+}
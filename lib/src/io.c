@@ -48,3 +48,14 @@ int efmt(const char* fmt, ...) {
     va_end(ap);
     return ret;
 }
+
+// `used`, as it is referenced by `memcpy`, which is not subject to link time
+// optimization in the release variant (see `libcommon-release.a`).
+__attribute__((used)) void error_exit(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vdfmt(FD_STDERR, fmt, ap);
+    va_end(ap);
+    _exit(1);
+    __builtin_unreachable();
+}
@@ -23,16 +23,41 @@ int open(const char* path, int flags) {
     return syscall_ret(ret);
 }
 
+int creat(const char* path, mode_t mode) {
+    long ret = syscall2(__NR_creat, path, mode);
+    return syscall_ret(ret);
+}
+
 int close(int fd) {
     long ret = syscall1(__NR_close, fd);
     return syscall_ret(ret);
 }
 
+int rename(const char* oldpath, const char* newpath) {
+    long ret = syscall2(__NR_rename, oldpath, newpath);
+    return syscall_ret(ret);
+}
+
+int unlink(const char* path) {
+    long ret = syscall1(__NR_unlink, path);
+    return syscall_ret(ret);
+}
+
+ssize_t getdents64(int fd, void* dirp, size_t count) {
+    long ret = syscall3(__NR_getdents64, fd, dirp, count);
+    return syscall_ret(ret);
+}
+
 int access(const char* path, int mode) {
     long ret = syscall2(__NR_access, path, mode);
     return syscall_ret(ret);
 }
 
+int fstat(int fd, struct stat* statbuf) {
+    long ret = syscall2(__NR_fstat, fd, statbuf);
+    return syscall_ret(ret);
+}
+
 ssize_t write(int fd, const void* buf, size_t count) {
     long ret = syscall3(__NR_write, fd, buf, count);
     return syscall_ret(ret);
@@ -44,7 +69,7 @@ ssize_t read(int fd, void* buf, size_t count) {
 }
 
 ssize_t pread(int fd, void* buf, size_t count, off_t offset) {
-    long ret = syscall4(__NR_read, fd, buf, count, offset);
+    long ret = syscall4(__NR_pread64, fd, buf, count, offset);
     return syscall_ret(ret);
 }
 
@@ -58,7 +83,140 @@ int munmap(void* addr, size_t length) {
     return syscall_ret(ret);
 }
 
+int mprotect(void* addr, size_t length, int prot) {
+    long ret = syscall3(__NR_mprotect, addr, length, prot);
+    return syscall_ret(ret);
+}
+
+int mincore(void* addr, size_t length, unsigned char* vec) {
+    long ret = syscall3(__NR_mincore, addr, length, vec);
+    return syscall_ret(ret);
+}
+
+int madvise(void* addr, size_t length, int advice) {
+    long ret = syscall3(__NR_madvise, addr, length, advice);
+    return syscall_ret(ret);
+}
+
+int io_uring_setup(uint32_t entries, struct io_uring_params* p) {
+    long ret = syscall2(__NR_io_uring_setup, entries, p);
+    return syscall_ret(ret);
+}
+
+int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+    long ret = syscall6(__NR_io_uring_enter, fd, to_submit, min_complete, flags, 0 /* sig */, 0 /* sigsz */);
+    return syscall_ret(ret);
+}
+
+int socket(int domain, int type, int protocol) {
+    long ret = syscall3(__NR_socket, domain, type, protocol);
+    return syscall_ret(ret);
+}
+
+int bind(int fd, const struct sockaddr_un* addr, uint32_t addrlen) {
+    long ret = syscall3(__NR_bind, fd, addr, addrlen);
+    return syscall_ret(ret);
+}
+
+int listen(int fd, int backlog) {
+    long ret = syscall2(__NR_listen, fd, backlog);
+    return syscall_ret(ret);
+}
+
+int accept4(int fd, struct sockaddr_un* addr, uint32_t* addrlen, int flags) {
+    long ret = syscall4(__NR_accept4, fd, addr, addrlen, flags);
+    return syscall_ret(ret);
+}
+
+int connect(int fd, const struct sockaddr_un* addr, uint32_t addrlen) {
+    long ret = syscall3(__NR_connect, fd, addr, addrlen);
+    return syscall_ret(ret);
+}
+
+ssize_t sendmsg(int fd, const struct msghdr* msg, int flags) {
+    long ret = syscall3(__NR_sendmsg, fd, msg, flags);
+    return syscall_ret(ret);
+}
+
+ssize_t recvmsg(int fd, struct msghdr* msg, int flags) {
+    long ret = syscall3(__NR_recvmsg, fd, msg, flags);
+    return syscall_ret(ret);
+}
+
+int dup2(int oldfd, int newfd) {
+    long ret = syscall2(__NR_dup2, oldfd, newfd);
+    return syscall_ret(ret);
+}
+
+int clock_gettime(int clockid, struct timespec* tp) {
+    if (__vdso_clock_gettime) {
+        return syscall_ret(__vdso_clock_gettime(clockid, tp));
+    }
+    long ret = syscall2(__NR_clock_gettime, clockid, tp);
+    return syscall_ret(ret);
+}
+
+int gettimeofday(struct timeval* tv, void* tz) {
+    if (__vdso_gettimeofday) {
+        return syscall_ret(__vdso_gettimeofday(tv, tz));
+    }
+    long ret = syscall2(__NR_gettimeofday, tv, tz);
+    return syscall_ret(ret);
+}
+
+int getcpu(unsigned* cpu, unsigned* node) {
+    if (__vdso_getcpu) {
+        return syscall_ret(__vdso_getcpu(cpu, node, 0 /* cache */));
+    }
+    long ret = syscall3(__NR_getcpu, cpu, node, 0 /* cache */);
+    return syscall_ret(ret);
+}
+
+pid_t fork(void) {
+    long ret = syscall0(__NR_fork);
+    return syscall_ret(ret);
+}
+
+int execve(const char* path, char* const argv[], char* const envp[]) {
+    long ret = syscall3(__NR_execve, path, argv, envp);
+    return syscall_ret(ret);
+}
+
+pid_t wait4(pid_t pid, int* wstatus, int options, void* rusage) {
+    long ret = syscall4(__NR_wait4, pid, wstatus, options, rusage);
+    return syscall_ret(ret);
+}
+
+int kill(pid_t pid, int sig) {
+    long ret = syscall2(__NR_kill, pid, sig);
+    return syscall_ret(ret);
+}
+
+pid_t getpid(void) {
+    return syscall0(__NR_getpid);
+}
+
+int arch_prctl(int code, unsigned long addr) {
+    long ret = syscall2(__NR_arch_prctl, code, addr);
+    return syscall_ret(ret);
+}
+
+int perf_event_open(struct perf_event_attr* attr, pid_t pid, int cpu, int group_fd, unsigned long flags) {
+    long ret = syscall5(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+    return syscall_ret(ret);
+}
+
+long futex(uint32_t* uaddr, int op, uint32_t val, const struct timespec* timeout) {
+    long ret = syscall4(__NR_futex, uaddr, op, val, timeout);
+    return syscall_ret(ret);
+}
+
+int sched_yield(void) {
+    long ret = syscall0(__NR_sched_yield);
+    return syscall_ret(ret);
+}
+
 void _exit(int status) {
-    syscall1(__NR_exit, status);
+    syscall1(__NR_exit_group, status);
     __builtin_unreachable();
 }
@@ -0,0 +1,384 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include <alloc.h>
+#include <asm/unistd.h>  // __NR_*
+#include <common.h>
+#include <syscall.h>
+#include <thread.h>
+
+// {{{ Thread
+
+// Start routine of a thread created by `thread_clone`, runs on the new stack.
+//
+// Not `static`, such that the name referenced from assembly is kept with link
+// time optimization.
+__attribute__((visibility("hidden"), noreturn)) void thread_start(Thread* t);
+
+void thread_start(Thread* t) {
+    t->fn(t->arg);
+    // Exit only this thread, the Kernel clears `t->tid` and wakes `thread_join`
+    // once the stack is not used anymore.
+    syscall1(__NR_exit, 0);
+    __builtin_unreachable();
+}
+
+// Raw `clone` system call, the child starts executing on `stack` with the
+// `Thread` at the stack top as argument of `thread_start`.
+//
+//   long thread_clone(unsigned long flags, void* stack, uint32_t* parent_tid, uint32_t* child_tid);
+//
+// The child can't return into the frame of the caller, as it runs on a
+// different stack, hence the system call is done in assembly.
+long thread_clone(unsigned long flags, void* stack, uint32_t* parent_tid, uint32_t* child_tid);
+
+asm(".text\n"
+    ".global thread_clone\n"
+    ".hidden thread_clone\n"
+    ".type thread_clone, @function\n"
+    "thread_clone:\n"
+    "    mov %rcx, %r10\n"      // child_tid is the 4th system call argument.
+    "    xor %r8d, %r8d\n"      // No new thread pointer.
+    "    mov $56, %eax\n"       // __NR_clone
+    "    syscall\n"
+    "    test %rax, %rax\n"
+    "    jnz 1f\n"
+    // Child, the stack holds the `Thread` argument.
+    "    xor %ebp, %ebp\n"
+    "    pop %rdi\n"
+    "    and $-16, %rsp\n"
+    "    call thread_start\n"
+    "    hlt\n"
+    // Parent (or error).
+    "1:  ret\n"
+    ".size thread_clone, .-thread_clone\n");
+
+bool thread_create(Thread* t, void (*fn)(void*), void* arg) {
+    // The lowest page of the stack mapping is a guard page.
+    t->stack_len = THREAD_STACK_SIZE + 4096;
+    t->stack = mmap(0 /* addr */, t->stack_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1 /* fd */, 0 /* off */);
+    if (t->stack == MAP_FAILED) {
+        return false;
+    }
+    mprotect(t->stack, 4096, PROT_NONE);
+    t->fn = fn;
+    t->arg = arg;
+
+    // Pass `t` on the 16 byte aligned top of the new stack.
+    uint64_t* top = (uint64_t*)(t->stack + t->stack_len) - 2;
+    top[0] = (uint64_t)t;
+
+    const unsigned long flags = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | CLONE_SYSVSEM |
+                                CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID;
+    const long tid = thread_clone(flags, top, &t->tid, &t->tid);
+    if (tid < 0) {
+        munmap(t->stack, t->stack_len);
+        return false;
+    }
+    return true;
+}
+
+void thread_join(Thread* t) {
+    // The Kernel wakes the `CLONE_CHILD_CLEARTID` futex with a shared wake,
+    // which doesn't match a private wait.
+    for (uint32_t tid = __atomic_load_n(&t->tid, __ATOMIC_ACQUIRE); tid != 0; tid = __atomic_load_n(&t->tid, __ATOMIC_ACQUIRE)) {
+        futex(&t->tid, FUTEX_WAIT, tid, 0 /* timeout */);
+    }
+    munmap(t->stack, t->stack_len);
+}
+
+uint32_t thread_num_cpus(void) {
+    // Raw syscall, returns the size of the mask written by the Kernel (the
+    // libc wrapper of the same name returns 0 instead).
+    uint64_t mask[16];
+    const long len = syscall3(__NR_sched_getaffinity, 0 /* self */, sizeof(mask), mask);
+    if (len <= 0) {
+        return 1;
+    }
+    uint32_t cpus = 0;
+    for (unsigned i = 0; i < (unsigned)len / sizeof(uint64_t); ++i) {
+        cpus += __builtin_popcountll(mask[i]);
+    }
+    return cpus ? cpus : 1;
+}
+
+// }}}
+// {{{ Mutex
+
+void mutex_lock(Mutex* m) {
+    uint32_t c = 0;
+    if (__atomic_compare_exchange_n(&m->state, &c, 1, false /* weak */, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    // Contended, mark the mutex as having waiters before sleeping.
+    if (c != 2) {
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    }
+    while (c != 0) {
+        futex(&m->state, FUTEX_WAIT_PRIVATE, 2, 0 /* timeout */);
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+bool mutex_trylock(Mutex* m) {
+    uint32_t c = 0;
+    return __atomic_compare_exchange_n(&m->state, &c, 1, false /* weak */, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void mutex_unlock(Mutex* m) {
+    if (__atomic_exchange_n(&m->state, 0, __ATOMIC_RELEASE) == 2) {
+        futex(&m->state, FUTEX_WAKE_PRIVATE, 1, 0 /* timeout */);
+    }
+}
+
+// }}}
+// {{{ Condition Variable
+
+void cond_wait(Cond* c, Mutex* m) {
+    // A signal between unlocking `m` and sleeping changes `seq`, the futex
+    // wait then returns immediately.
+    const uint32_t seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+    mutex_unlock(m);
+    futex(&c->seq, FUTEX_WAIT_PRIVATE, seq, 0 /* timeout */);
+    mutex_lock(m);
+}
+
+void cond_signal(Cond* c) {
+    __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+    futex(&c->seq, FUTEX_WAKE_PRIVATE, 1, 0 /* timeout */);
+}
+
+void cond_broadcast(Cond* c) {
+    __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+    futex(&c->seq, FUTEX_WAKE_PRIVATE, INT32_MAX, 0 /* timeout */);
+}
+
+// }}}
+// {{{ Barrier
+
+void barrier_init(Barrier* b, uint32_t count) {
+    b->count = count;
+    b->waiting = 0;
+    b->gen = 0;
+}
+
+bool barrier_wait(Barrier* b) {
+    const uint32_t gen = __atomic_load_n(&b->gen, __ATOMIC_ACQUIRE);
+    if (__atomic_add_fetch(&b->waiting, 1, __ATOMIC_ACQ_REL) == b->count) {
+        // Threads of the next generation only arrive after `gen` changed.
+        __atomic_store_n(&b->waiting, 0, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&b->gen, 1, __ATOMIC_RELEASE);
+        futex(&b->gen, FUTEX_WAKE_PRIVATE, INT32_MAX, 0 /* timeout */);
+        return true;
+    }
+    while (__atomic_load_n(&b->gen, __ATOMIC_ACQUIRE) == gen) {
+        futex(&b->gen, FUTEX_WAIT_PRIVATE, gen, 0 /* timeout */);
+    }
+    return false;
+}
+
+// }}}
+// {{{ Thread Pool
+
+// Deque operations after Lê et al., "Correct and Efficient Work-Stealing for
+// Weak Memory Models" (PPoPP 2013). The ranges in the ring are accessed with
+// relaxed atomics, a thief may read a slot being overwritten but then fails to
+// claim it.
+
+static void range_store(PoolRange* slot, PoolRange r) {
+    __atomic_store_n(&slot->lo, r.lo, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->hi, r.hi, __ATOMIC_RELAXED);
+}
+
+static PoolRange range_load(const PoolRange* slot) {
+    PoolRange r;
+    r.lo = __atomic_load_n(&slot->lo, __ATOMIC_RELAXED);
+    r.hi = __atomic_load_n(&slot->hi, __ATOMIC_RELAXED);
+    return r;
+}
+
+// Push `r` at the bottom, returns `false` if the deque is full.
+static bool deque_push(PoolDeque* d, PoolRange r) {
+    const int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    const int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    if (b - t >= POOL_DEQUE_CAP) {
+        return false;
+    }
+    range_store(&d->ring[b & (POOL_DEQUE_CAP - 1)], r);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+// Pop the most recently pushed range (owner only).
+static bool deque_pop(PoolDeque* d, PoolRange* r) {
+    const int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        // Empty.
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    *r = range_load(&d->ring[b & (POOL_DEQUE_CAP - 1)]);
+    if (t < b) {
+        return true;
+    }
+    // Last range, race against thieves.
+    const bool won = __atomic_compare_exchange_n(&d->top, &t, t + 1, false /* weak */, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+// Steal the oldest range (any worker).
+static bool deque_steal(PoolDeque* d, PoolRange* r) {
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    const int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return false;
+    }
+    *r = range_load(&d->ring[t & (POOL_DEQUE_CAP - 1)]);
+    return __atomic_compare_exchange_n(&d->top, &t, t + 1, false /* weak */, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// Failed steal attempts of an idle worker before yielding the CPU.
+#define POOL_SPIN_YIELD 64
+
+// Split `r` down to the grain size, pushing the upper halves, and run the
+// rest. If the deque is full the range is run without splitting further.
+static void pool_run_range(Pool* p, PoolDeque* own, PoolRange r) {
+    while (r.hi - r.lo > p->grain) {
+        const uint64_t mid = r.lo + (r.hi - r.lo) / 2;
+        if (!deque_push(own, (PoolRange){mid, r.hi})) {
+            break;
+        }
+        r.hi = mid;
+    }
+    p->fn(p->ctx, r.lo, r.hi);
+    __atomic_fetch_sub(&p->remaining, r.hi - r.lo, __ATOMIC_RELEASE);
+}
+
+// Run ranges of the own deque and steal from the other workers until all
+// iterations of the current job ran.
+static void pool_work(Pool* p, uint32_t self) {
+    PoolDeque* own = &p->deques[self];
+    uint64_t seed = 0x9e3779b97f4a7c15ull * (self + 1);
+
+    PoolRange r;
+    uint32_t failed = 0;
+    while (__atomic_load_n(&p->remaining, __ATOMIC_ACQUIRE) != 0) {
+        if (deque_pop(own, &r)) {
+            pool_run_range(p, own, r);
+            continue;
+        }
+
+        // Try all other workers once, starting at a random victim.
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        bool stolen = false;
+        for (uint32_t i = 0; i < p->nworkers && !stolen; ++i) {
+            const uint32_t victim = (seed + i) % p->nworkers;
+            stolen = victim != self && deque_steal(&p->deques[victim], &r);
+        }
+        if (stolen) {
+            failed = 0;
+            pool_run_range(p, own, r);
+        } else if (++failed % POOL_SPIN_YIELD == 0) {
+            // Give the CPU to the workers holding the ranges when there are
+            // more workers than CPUs.
+            sched_yield();
+        } else {
+            __builtin_ia32_pause();
+        }
+    }
+}
+
+typedef struct {
+    Pool* pool;
+    uint32_t self;
+} PoolWorker;
+
+static void pool_worker(void* arg) {
+    Pool* p = ((PoolWorker*)arg)->pool;
+    const uint32_t self = ((PoolWorker*)arg)->self;
+
+    uint32_t seen = 0;
+    for (;;) {
+        uint32_t epoch;
+        while ((epoch = __atomic_load_n(&p->epoch, __ATOMIC_ACQUIRE)) == seen) {
+            futex(&p->epoch, FUTEX_WAIT_PRIVATE, seen, 0 /* timeout */);
+        }
+        seen = epoch;
+        if (p->stop) {
+            return;
+        }
+
+        pool_work(p, self);
+        if (__atomic_sub_fetch(&p->active, 1, __ATOMIC_RELEASE) == 0) {
+            futex(&p->active, FUTEX_WAKE_PRIVATE, 1, 0 /* timeout */);
+        }
+    }
+}
+
+// Start the next epoch and wake all workers.
+static void pool_wake(Pool* p) {
+    __atomic_fetch_add(&p->epoch, 1, __ATOMIC_RELEASE);
+    futex(&p->epoch, FUTEX_WAKE_PRIVATE, INT32_MAX, 0 /* timeout */);
+}
+
+void pool_init(Pool* p, uint32_t nworkers) {
+    memset(p, 0 /* byte */, sizeof(*p));
+    p->nworkers = nworkers ? nworkers : thread_num_cpus();
+
+    // The deques are mapped to get them cache line aligned.
+    p->deques_len = sizeof(PoolDeque) * p->nworkers;
+    p->deques = mmap(0 /* addr */, p->deques_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1 /* fd */, 0 /* off */);
+    ERROR_ON(p->deques == MAP_FAILED, "Failed to mmap deques of %d workers!", p->nworkers);
+
+    // The worker arguments are stored in the thread argument slots behind
+    // the threads.
+    p->threads = alloc((sizeof(Thread) + sizeof(PoolWorker)) * p->nworkers);
+    PoolWorker* workers = (PoolWorker*)(p->threads + p->nworkers);
+    for (uint32_t i = 1; i < p->nworkers; ++i) {
+        workers[i] = (PoolWorker){p, i};
+        ERROR_ON(!thread_create(&p->threads[i], pool_worker, &workers[i]), "Failed to create worker %d!", i);
+    }
+}
+
+void pool_fini(Pool* p) {
+    p->stop = true;
+    pool_wake(p);
+    for (uint32_t i = 1; i < p->nworkers; ++i) {
+        thread_join(&p->threads[i]);
+    }
+    dealloc(p->threads);
+    munmap(p->deques, p->deques_len);
+}
+
+void pool_parallel_for(Pool* p, uint64_t begin, uint64_t end, uint64_t grain, PoolFn fn, void* ctx) {
+    if (end <= begin) {
+        return;
+    }
+    p->fn = fn;
+    p->ctx = ctx;
+    p->grain = grain ? grain : 1;
+    p->remaining = end - begin;
+    p->active = p->nworkers - 1;
+    deque_push(&p->deques[0], (PoolRange){begin, end});
+
+    pool_wake(p);
+    pool_work(p, 0);
+
+    // Workers may still be looking for ranges, the job must not change
+    // before all of them are done.
+    for (uint32_t active = __atomic_load_n(&p->active, __ATOMIC_ACQUIRE); active != 0;
+         active = __atomic_load_n(&p->active, __ATOMIC_ACQUIRE)) {
+        futex(&p->active, FUTEX_WAIT_PRIVATE, active, 0 /* timeout */);
+    }
+}
+
+// }}}
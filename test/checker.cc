@@ -5,6 +5,7 @@
 #include "test_helper.h"
 
 extern "C" {
+#include <alloc.h>
 #include <common.h>
 #include <fmt.h>
 }
@@ -108,6 +109,31 @@ void check_memcpy() {
     }
 }
 
+void check_memcmp() {
+    unsigned char a[4] = {1, 2, 3, 4};
+    unsigned char b[4] = {1, 2, 3, 5};
+
+    ASSERT_EQ(0, memcmp(a, b, 3));
+    ASSERT_EQ(true, memcmp(a, b, 4) < 0);
+    ASSERT_EQ(true, memcmp(b, a, 4) > 0);
+    ASSERT_EQ(0, memcmp(a, b, 0));
+}
+
+void check_alloc_reuse() {
+    void* p1 = alloc(64);
+    dealloc(p1);
+
+    // Free block large enough for the request is re-used.
+    void* p2 = alloc(32);
+    ASSERT_EQ(p1, p2);
+    dealloc(p2);
+
+    // Free block too small for the request is not re-used.
+    void* p3 = alloc(128);
+    ASSERT_EQ(true, p3 != p2);
+    dealloc(p3);
+}
+
 int main() {
     TEST_INIT;
     TEST_ADD(check_dec);
@@ -121,5 +147,7 @@ int main() {
     TEST_ADD(check_exceed_len);
     TEST_ADD(check_memset);
     TEST_ADD(check_memcpy);
+    TEST_ADD(check_memcmp);
+    TEST_ADD(check_alloc_reuse);
     return TEST_RUN;
 }
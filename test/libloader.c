@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+// Shared library driven in-process through `libdynld.a` by
+// `loader_checker.cc` and `loader_bench.cc`.
+//
+// Each definition below generates a specific relocation type.
+
+#include "dynld.h"
+
+#include <stdint.h>
+
+extern int gDepValue;
+extern int get_dep_value();
+extern int gMissing __attribute__((weak));
+
+int gValue = 42;
+
+// Pointer to local data -> R_X86_64_RELATIVE.
+static int sLocal = 7;
+int* gLocalPtr = &sLocal;
+
+// Pointer to global data -> R_X86_64_64.
+int* gValuePtr = &gValue;
+
+// Pointer into global data -> R_X86_64_64 with addend.
+int gArray[4] = {10, 11, 12, 13};
+int* gArrayPtr = &gArray[1];
+
+// Pointer to an undefined weak symbol -> R_X86_64_64 resolved to 0.
+int* gMissingPtr = &gMissing;
+
+int get_value() {
+    // Reference global variables -> R_X86_64_GLOB_DAT.
+    return gValue + gDepValue;
+}
+
+int call_dep() {
+    // Call function of the dependency -> R_X86_64_JUMP_SLOT.
+    return get_dep_value();
+}
+
+int get_first() {
+    return 1;
+}
+
+static int get_isa_generic() {
+    return 1;
+}
+
+static int get_isa_sse2() {
+    return 2;
+}
+
+// Resolver receives the CPU features of the `Loader` context.
+static int (*resolve_isa(uint64_t hwcap, const DynldCpuFeatures* cpu))() {
+    (void)hwcap;
+    return (cpu->usable & DYNLD_CPU_SSE2) ? get_isa_sse2 : get_isa_generic;
+}
+
+// Indirect function -> bound to the implementation selected by the resolver.
+int get_isa() __attribute__((ifunc("resolve_isa")));
+
+int call_isa() {
+    return get_isa();
+}
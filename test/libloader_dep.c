@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+// Dependency of `libloader.so`, its definitions are found by the symbol
+// lookup through the scope passed to `relocate_object`.
+
+int gDepValue = 1000;
+
+int get_dep_value() {
+    return gDepValue;
+}
+
+// Also defined by `libloader.so`, the first object in the scope wins.
+int get_first() {
+    return 2;
+}
@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+// In-process microbenchmarks of the dynamic linker core (`libdynld.a`).
+//
+// Mapping, symbol lookup and relocation are measured over many iterations in
+// one process, instead of paying for a full `execve` per sample.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <loader.h>
+}
+
+// Synthetic library with 64 exported functions and 65536 `R_X86_64_64`
+// relocations (see `../04_dynld_nostd/libbig.c`).
+static const char* kBig = "../04_dynld_nostd/libbig.so";
+
+// Symbol addresses by symbol index, resolved once per relocation pass.
+struct LookupMemo {
+    const Loader* ld;
+    std::vector<void*> addr;
+};
+
+// Lookup hook resolving each symbol once (see `LookupMemo`), such that the
+// relocations of `libbig.so` measure applying them instead of the linear
+// symbol scan.
+static void* lookup_memo(const RelocScope* scope, const Dso*, const Elf64Rela* reloc, const char* symname, uint32_t ver) {
+    auto* memo = static_cast<LookupMemo*>(scope->ctx);
+    const uint64_t symidx = ELF64_R_SYM(reloc->info);
+    if (symidx >= memo->addr.size()) {
+        memo->addr.resize(symidx + 1);
+    }
+    if (memo->addr[symidx] == nullptr) {
+        memo->addr[symidx] = lookup_scope(memo->ld, scope->dsos, scope->len, symname, ver);
+    }
+    return memo->addr[symidx];
+}
+
+template<typename Fn>
+static void bench(const char* name, uint64_t iters, Fn fn) {
+    // Warm up.
+    fn();
+
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iters; ++i) {
+        fn();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    std::cout << name << ": " << ns / iters << " ns/op (" << iters << " iterations)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    // Scale all iteration counts, eg `./loader_bench 10`.
+    const uint64_t scale = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1;
+
+    Loader ld;
+    loader_init(&ld, 0 /* hwcap */, 0 /* hwcap2 */);
+
+    Dso big;
+    if (!map_object(&ld, kBig, &big)) {
+        std::cerr << "Failed to map " << kBig << std::endl;
+        return 1;
+    }
+
+    bench("map + unmap libbig.so", 1000 * scale, [&] {
+        Dso dso;
+        map_object(&ld, kBig, &dso);
+        unmap_object(&dso);
+    });
+
+    // The lookup scans the dynamic symbol table, the last function is the
+    // worst case of a hit.
+    volatile void* sink;
+    bench("lookup_sym hit (big_fn_063)", 100000 * scale, [&] { sink = lookup_sym(&ld, &big, "big_fn_063", 0 /* ver */); });
+    bench("lookup_sym miss", 100000 * scale, [&] { sink = lookup_sym(&ld, &big, "no_such_symbol", 0 /* ver */); });
+    (void)sink;
+
+    // Each relocation scans the dynamic symbols, which dominates the order
+    // the relocations are applied in.
+    RelocScope scope = {};
+    scope.dsos = &big;
+    scope.len = 1;
+    bench("relocate_object libbig.so (65536 relocs)", 20 * scale, [&] { relocate_object(&ld, &big, &scope); });
+    scope.by_page = true;
+    bench("relocate_object libbig.so by page (65536 relocs)", 20 * scale, [&] { relocate_object(&ld, &big, &scope); });
+
+    // With the 64 symbols resolved once per pass, the table order sweeps the
+    // 128 table pages 64 times while the page order patches each page once.
+    LookupMemo memo = {&ld, {}};
+    scope.ctx = &memo;
+    scope.lookup = lookup_memo;
+    scope.by_page = false;
+    bench("relocate_object libbig.so memoized (65536 relocs)", 200 * scale, [&] {
+        memo.addr.clear();
+        relocate_object(&ld, &big, &scope);
+    });
+    scope.by_page = true;
+    bench("relocate_object libbig.so memoized by page (65536 relocs)", 200 * scale, [&] {
+        memo.addr.clear();
+        relocate_object(&ld, &big, &scope);
+    });
+
+    unmap_object(&big);
+    loader_fini(&ld);
+    return 0;
+}
@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include "test_helper.h"
+
+extern "C" {
+#include <loader.h>
+}
+
+// Shared libraries driven through `libdynld.a`, see `libloader.c`.
+static const char* kLib = "./libloader.so";
+static const char* kDep = "./libloader_dep.so";
+
+template<typename T>
+static T get(const Loader* ld, const Dso* dso, const char* name) {
+    return reinterpret_cast<T>(lookup_sym(ld, dso, name, 0 /* ver */));
+}
+
+void check_loader_map() {
+    Loader ld;
+    loader_init(&ld, 0 /* hwcap */, 0 /* hwcap2 */);
+
+    Dso dso;
+    ASSERT_EQ(true, map_object(&ld, kLib, &dso));
+    ASSERT_EQ(0ul, reinterpret_cast<uint64_t>(dso.map_start) % PAGE_SIZE);
+    ASSERT_EQ(8ul, get_num_relocs(&dso));
+    ASSERT_EQ(0u, dso.needed_len);
+
+    uint64_t start, end;
+    get_load_span(&dso, &start, &end);
+    ASSERT_EQ(reinterpret_cast<uint64_t>(dso.map_start), start);
+    ASSERT_EQ(dso.map_len, end - start);
+
+    ASSERT_EQ(true, find_sym(&dso, "gValue", 0 /* ver */, false /* tls */) != nullptr);
+    ASSERT_EQ(true, find_sym(&dso, "gValue", 0 /* ver */, true /* tls */) == nullptr);
+    ASSERT_EQ(true, find_sym(&dso, "sLocal", 0 /* ver */, false /* tls */) == nullptr);
+
+    unmap_object(&dso);
+    ASSERT_EQ(false, map_object(&ld, "./does-not-exist.so", &dso));
+    loader_fini(&ld);
+}
+
+void check_loader_reject() {
+    Loader ld;
+    loader_init(&ld, 0 /* hwcap */, 0 /* hwcap2 */);
+
+    // Files which are not shared objects are rejected.
+    Dso dso;
+    ASSERT_EQ(false, map_object(&ld, "./libloader.c", &dso));
+
+    ASSERT_EQ(true, map_object(&ld, kLib, &dso));
+
+    // The ELF header is mapped with the first `PT_LOAD` segment.
+    Elf64Ehdr ehdr = *reinterpret_cast<const Elf64Ehdr*>(dso.base);
+    ASSERT_EQ(true, check_ehdr(&ehdr) == nullptr);
+    ehdr.type = ET_NONE;
+    ASSERT_EQ("is not a dynamic library", check_ehdr(&ehdr));
+    ehdr.ident[EI_MAG0] = 0;
+    ASSERT_EQ("has a wrong ELF magic value", check_ehdr(&ehdr));
+
+    ObjectLayout layout;
+    ASSERT_EQ(true, decode_layout(dso.phdr, dso.phnum, &layout) == nullptr);
+    ASSERT_EQ("has no PT_LOAD segments", decode_layout(dso.phdr, 0 /* phnum */, &layout));
+
+    unmap_object(&dso);
+    loader_fini(&ld);
+}
+
+void check_loader_lookup_scope() {
+    Loader ld;
+    loader_init(&ld, 0 /* hwcap */, 0 /* hwcap2 */);
+
+    Dso scope[2];
+    ASSERT_EQ(true, map_object(&ld, kLib, &scope[0]));
+    ASSERT_EQ(true, map_object(&ld, kDep, &scope[1]));
+
+    // The first definition in scope order wins.
+    auto first = reinterpret_cast<int (*)()>(lookup_scope(&ld, scope, 2, "get_first", 0 /* ver */));
+    ASSERT_EQ(1, first());
+    first = reinterpret_cast<int (*)()>(lookup_scope(&ld, scope + 1, 1, "get_first", 0 /* ver */));
+    ASSERT_EQ(2, first());
+
+    // Undefined references are not definitions.
+    ASSERT_EQ(true, lookup_scope(&ld, scope, 1, "get_dep_value", 0 /* ver */) == nullptr);
+    ASSERT_EQ(true, lookup_scope(&ld, scope, 2, "get_dep_value", 0 /* ver */) != nullptr);
+    ASSERT_EQ(true, lookup_scope(&ld, scope, 2, "no_such_symbol", 0 /* ver */) == nullptr);
+
+    unmap_object(&scope[1]);
+    unmap_object(&scope[0]);
+    loader_fini(&ld);
+}
+
+static RelocScope make_scope(const Dso* dsos, unsigned len, bool by_page) {
+    RelocScope scope = {};
+    scope.dsos = dsos;
+    scope.len = len;
+    scope.by_page = by_page;
+    return scope;
+}
+
+static void check_relocate(bool by_page) {
+    Loader ld;
+    loader_init(&ld, 0 /* hwcap */, 0 /* hwcap2 */);
+
+    Dso scope[2];
+    ASSERT_EQ(true, map_object(&ld, kLib, &scope[0]));
+    ASSERT_EQ(true, map_object(&ld, kDep, &scope[1]));
+
+    // Each patched relocation is reported to the `resolved` hook.
+    uint64_t resolved = 0;
+    RelocScope rs = make_scope(scope, 2, by_page);
+    rs.ctx = &resolved;
+    rs.resolved = [](const RelocScope* s, const Dso*, const Elf64Rela*, const char*, const void*) { *static_cast<uint64_t*>(s->ctx) += 1; };
+    relocate_object(&ld, &scope[1], &rs);
+    ASSERT_EQ(get_num_relocs(&scope[1]), resolved);
+    relocate_object(&ld, &scope[0], &rs);
+    ASSERT_EQ(get_num_relocs(&scope[1]) + get_num_relocs(&scope[0]), resolved);
+
+    // R_X86_64_64 and R_X86_64_RELATIVE.
+    int* value = get<int*>(&ld, &scope[0], "gValue");
+    ASSERT_EQ(value, *get<int**>(&ld, &scope[0], "gValuePtr"));
+    ASSERT_EQ(get<int*>(&ld, &scope[0], "gArray") + 1, *get<int**>(&ld, &scope[0], "gArrayPtr"));
+    ASSERT_EQ(11, **get<int**>(&ld, &scope[0], "gArrayPtr"));
+    ASSERT_EQ(7, **get<int**>(&ld, &scope[0], "gLocalPtr"));
+    // Undefined weak reference.
+    ASSERT_EQ(true, *get<int**>(&ld, &scope[0], "gMissingPtr") == nullptr);
+
+    // R_X86_64_GLOB_DAT and R_X86_64_JUMP_SLOT into the dependency.
+    ASSERT_EQ(1042, get<int (*)()>(&ld, &scope[0], "get_value")());
+    ASSERT_EQ(1000, get<int (*)()>(&ld, &scope[0], "call_dep")());
+    *value = 58;
+    ASSERT_EQ(1058, get<int (*)()>(&ld, &scope[0], "get_value")());
+
+    // The IFUNC resolver gets the CPU features of the context, SSE2 is part
+    // of the x86-64 baseline.
+    ASSERT_EQ(true, (ld.cpu.usable & DYNLD_CPU_SSE2) != 0);
+    ASSERT_EQ(2, get<int (*)()>(&ld, &scope[0], "call_isa")());
+
+    unmap_object(&scope[1]);
+    unmap_object(&scope[0]);
+    loader_fini(&ld);
+}
+
+void check_loader_relocate() {
+    check_relocate(false /* by_page */);
+}
+
+void check_loader_relocate_by_page() {
+    check_relocate(true /* by_page */);
+}
+
+void check_loader_relocate_hooks() {
+    Loader ld;
+    loader_init(&ld, 0 /* hwcap */, 0 /* hwcap2 */);
+
+    Dso scope[2];
+    ASSERT_EQ(true, map_object(&ld, kLib, &scope[0]));
+    ASSERT_EQ(true, map_object(&ld, kDep, &scope[1]));
+    RelocScope rs = make_scope(scope, 2, false /* by_page */);
+    relocate_object(&ld, &scope[1], &rs);
+
+    // The `lookup` hook replaces the search of the scope, symbols it doesn't
+    // provide go to the `unresolved` hook.
+    static int sValue = 77;
+    static uint64_t sUnresolved;
+    sUnresolved = 0;
+    rs.lookup = [](const RelocScope*, const Dso*, const Elf64Rela*, const char* symname, uint32_t) -> void* {
+        return std::strcmp(symname, "gValue") == 0 ? &sValue : nullptr;
+    };
+    rs.unresolved = [](const RelocScope*, const Dso*, const Elf64Rela*, const char*) {
+        sUnresolved += 1;
+        return true;
+    };
+    relocate_object(&ld, &scope[0], &rs);
+    ASSERT_EQ(&sValue, *get<int**>(&ld, &scope[0], "gValuePtr"));
+    ASSERT_EQ(true, sUnresolved > 0);
+
+    unmap_object(&scope[1]);
+    unmap_object(&scope[0]);
+    loader_fini(&ld);
+}
+
+void check_loader_reload() {
+    Loader ld;
+    loader_init(&ld, 0 /* hwcap */, 0 /* hwcap2 */);
+
+    // Objects are unmapped without leaking address space or failing to map
+    // again.
+    for (unsigned i = 0; i < 256; ++i) {
+        Dso scope[2];
+        ASSERT_EQ(true, map_object(&ld, kLib, &scope[0]));
+        ASSERT_EQ(true, map_object(&ld, kDep, &scope[1]));
+        RelocScope rs = make_scope(scope, 2, false /* by_page */);
+        relocate_object(&ld, &scope[1], &rs);
+        relocate_object(&ld, &scope[0], &rs);
+        ASSERT_EQ(1000, get<int (*)()>(&ld, &scope[0], "call_dep")());
+        unmap_object(&scope[1]);
+        unmap_object(&scope[0]);
+    }
+    loader_fini(&ld);
+}
+
+int main() {
+    TEST_INIT;
+    TEST_ADD(check_loader_map);
+    TEST_ADD(check_loader_reject);
+    TEST_ADD(check_loader_lookup_scope);
+    TEST_ADD(check_loader_relocate);
+    TEST_ADD(check_loader_relocate_by_page);
+    TEST_ADD(check_loader_relocate_hooks);
+    TEST_ADD(check_loader_reload);
+    return TEST_RUN;
+}
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+// Scaling benchmarks of the thread pool of `libcommon` (see `thread.h`).
+//
+// The same `pool_parallel_for` jobs are run with 1, 2, 4, ... workers up to
+// the number of CPUs and with twice as many workers as CPUs (oversubscribed),
+// the speedup is relative to a single worker:
+//   compute  CPU bound, a hash chain per iteration.
+//   memory   Memory bandwidth bound, summing a 64 MiB array.
+//   fine     Scheduling bound, tiny ranges (grain 1) with little work each.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <thread.h>
+}
+
+// Per worker results, padded to avoid false sharing.
+struct alignas(64) Partial {
+    uint64_t value;
+};
+
+struct Job {
+    const uint64_t* data;
+    Partial* partial;  // Indexed by `lo` of the range modulo `kPartials`.
+};
+
+static constexpr uint64_t kPartials = 64;
+
+static void compute(void* ctx, uint64_t lo, uint64_t hi) {
+    auto* job = static_cast<Job*>(ctx);
+    uint64_t acc = 0;
+    for (uint64_t i = lo; i < hi; ++i) {
+        uint64_t x = i;
+        for (unsigned r = 0; r < 64; ++r) {
+            x ^= x >> 33;
+            x *= 0xff51afd7ed558ccdull;
+        }
+        acc += x;
+    }
+    __atomic_fetch_add(&job->partial[lo % kPartials].value, acc, __ATOMIC_RELAXED);
+}
+
+static void memory(void* ctx, uint64_t lo, uint64_t hi) {
+    auto* job = static_cast<Job*>(ctx);
+    uint64_t acc = 0;
+    for (uint64_t i = lo; i < hi; ++i) {
+        acc += job->data[i];
+    }
+    __atomic_fetch_add(&job->partial[lo % kPartials].value, acc, __ATOMIC_RELAXED);
+}
+
+struct Case {
+    const char* name;
+    PoolFn fn;
+    uint64_t iters;
+    uint64_t grain;
+};
+
+int main(int argc, char* argv[]) {
+    // Scale all iteration counts, eg `./thread_bench 10`.
+    const uint64_t scale = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1;
+    const uint32_t cpus = thread_num_cpus();
+
+    std::vector<uint64_t> data(8 << 20, 1);
+    std::vector<Partial> partial(kPartials);
+    Job job{data.data(), partial.data()};
+
+    const Case cases[] = {
+        {"compute", compute, 1 << 20, 1024},
+        {"memory", memory, data.size(), 16 << 10},
+        {"fine", compute, 1 << 16, 1},
+    };
+
+    std::vector<uint32_t> counts;
+    for (uint32_t workers = 1; workers < cpus; workers *= 2) {
+        counts.push_back(workers);
+    }
+    counts.push_back(cpus);
+    counts.push_back(2 * cpus);
+
+    std::cout << cpus << " CPUs" << std::endl;
+    for (const Case& c : cases) {
+        double base = 0;
+        for (uint32_t workers : counts) {
+            Pool pool;
+            pool_init(&pool, workers);
+
+            // Warm up.
+            pool_parallel_for(&pool, 0, c.iters, c.grain, c.fn, &job);
+
+            const auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < 5 * scale; ++i) {
+                pool_parallel_for(&pool, 0, c.iters, c.grain, c.fn, &job);
+            }
+            const auto end = std::chrono::steady_clock::now();
+            pool_fini(&pool);
+
+            const double us = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000.0 / (5 * scale);
+            base = workers == 1 ? us : base;
+            std::cout << c.name << " (" << workers << " workers): " << static_cast<uint64_t>(us) << " us/job, speedup "
+                      << static_cast<uint64_t>(base / us * 100) / 100.0 << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021, Johannes Stoelp <dev@memzero.de>
+
+#include "test_helper.h"
+
+#include <cstdint>
+
+extern "C" {
+#include <thread.h>
+}
+
+// Tests of the threading module of `libcommon` (see `thread.h`).
+//
+// Thread functions must not use thread local storage (see `thread.h`), hence
+// they only touch memory set up by the test.
+
+static constexpr uint32_t kThreads = 4;
+
+static void inc_flag(void* arg) {
+    __atomic_store_n(static_cast<int*>(arg), 1, __ATOMIC_RELEASE);
+}
+
+void check_thread_join() {
+    int flags[kThreads] = {};
+    Thread threads[kThreads];
+    for (uint32_t i = 0; i < kThreads; ++i) {
+        ASSERT_EQ(true, thread_create(&threads[i], inc_flag, &flags[i]));
+    }
+    for (uint32_t i = 0; i < kThreads; ++i) {
+        thread_join(&threads[i]);
+        ASSERT_EQ(1, flags[i]);
+        ASSERT_EQ(0u, threads[i].tid);
+    }
+    ASSERT_EQ(true, thread_num_cpus() >= 1);
+}
+
+struct Counter {
+    Mutex mutex;
+    uint64_t value;
+};
+
+static void count_locked(void* arg) {
+    auto* c = static_cast<Counter*>(arg);
+    for (unsigned i = 0; i < 100000; ++i) {
+        mutex_lock(&c->mutex);
+        c->value += 1;
+        mutex_unlock(&c->mutex);
+    }
+}
+
+void check_mutex() {
+    Counter c = {MUTEX_INIT, 0};
+    Thread threads[kThreads];
+    for (uint32_t i = 0; i < kThreads; ++i) {
+        ASSERT_EQ(true, thread_create(&threads[i], count_locked, &c));
+    }
+    for (uint32_t i = 0; i < kThreads; ++i) {
+        thread_join(&threads[i]);
+    }
+    ASSERT_EQ(kThreads * 100000ul, c.value);
+
+    ASSERT_EQ(true, mutex_trylock(&c.mutex));
+    ASSERT_EQ(false, mutex_trylock(&c.mutex));
+    mutex_unlock(&c.mutex);
+}
+
+// Single slot queue handing values from a producer to the consumers.
+struct Slot {
+    Mutex mutex;
+    Cond cond;
+    uint64_t value;  // 0 if empty, `UINT64_MAX` stops the consumers.
+    uint64_t sum;
+};
+
+static void consume(void* arg) {
+    auto* s = static_cast<Slot*>(arg);
+    mutex_lock(&s->mutex);
+    for (;;) {
+        while (s->value == 0) {
+            cond_wait(&s->cond, &s->mutex);
+        }
+        if (s->value == UINT64_MAX) {
+            break;
+        }
+        s->sum += s->value;
+        s->value = 0;
+        cond_broadcast(&s->cond);
+    }
+    mutex_unlock(&s->mutex);
+}
+
+void check_cond() {
+    Slot s = {MUTEX_INIT, COND_INIT, 0, 0};
+    Thread threads[kThreads];
+    for (uint32_t i = 0; i < kThreads; ++i) {
+        ASSERT_EQ(true, thread_create(&threads[i], consume, &s));
+    }
+
+    mutex_lock(&s.mutex);
+    for (uint64_t v = 1; v <= 1000; ++v) {
+        while (s.value != 0) {
+            cond_wait(&s.cond, &s.mutex);
+        }
+        s.value = v;
+        cond_signal(&s.cond);
+    }
+    while (s.value != 0) {
+        cond_wait(&s.cond, &s.mutex);
+    }
+    s.value = UINT64_MAX;
+    cond_broadcast(&s.cond);
+    mutex_unlock(&s.mutex);
+
+    for (uint32_t i = 0; i < kThreads; ++i) {
+        thread_join(&threads[i]);
+    }
+    ASSERT_EQ(1000ul * 1001 / 2, s.sum);
+}
+
+struct Rounds {
+    Barrier barrier;
+    uint32_t arrived[64];  // Threads arrived by round.
+    uint32_t last;         // Number of `barrier_wait` calls returning `true`.
+    bool ok;               // All threads of a round arrived before any left it.
+};
+
+static void run_rounds(void* arg) {
+    auto* r = static_cast<Rounds*>(arg);
+    for (unsigned round = 0; round < 64; ++round) {
+        __atomic_fetch_add(&r->arrived[round], 1, __ATOMIC_RELAXED);
+        if (barrier_wait(&r->barrier)) {
+            __atomic_fetch_add(&r->last, 1, __ATOMIC_RELAXED);
+        }
+        if (__atomic_load_n(&r->arrived[round], __ATOMIC_RELAXED) != kThreads) {
+            r->ok = false;
+        }
+    }
+}
+
+void check_barrier() {
+    Rounds r = {};
+    r.ok = true;
+    barrier_init(&r.barrier, kThreads);
+    Thread threads[kThreads];
+    for (uint32_t i = 0; i < kThreads; ++i) {
+        ASSERT_EQ(true, thread_create(&threads[i], run_rounds, &r));
+    }
+    for (uint32_t i = 0; i < kThreads; ++i) {
+        thread_join(&threads[i]);
+    }
+    ASSERT_EQ(true, r.ok);
+    ASSERT_EQ(64u, r.last);
+}
+
+static void mark(void* ctx, uint64_t lo, uint64_t hi) {
+    auto* visits = static_cast<uint8_t*>(ctx);
+    for (uint64_t i = lo; i < hi; ++i) {
+        __atomic_fetch_add(&visits[i], 1, __ATOMIC_RELAXED);
+    }
+}
+
+void check_pool_parallel_for() {
+    static uint8_t visits[1 << 20];
+
+    Pool pool;
+    pool_init(&pool, kThreads);
+    ASSERT_EQ(kThreads, pool.nworkers);
+
+    // Each iteration runs exactly once, for different grain sizes.
+    const uint64_t grains[] = {1, 7, 1024, 1 << 20};
+    for (uint64_t grain : grains) {
+        memset(visits, 0, sizeof(visits));
+        pool_parallel_for(&pool, 0, sizeof(visits), grain, mark, visits);
+        for (uint64_t i = 0; i < sizeof(visits); ++i) {
+            ASSERT_EQ(1, visits[i]);
+        }
+    }
+
+    // Empty and offset ranges.
+    memset(visits, 0, sizeof(visits));
+    pool_parallel_for(&pool, 10, 10, 1, mark, visits);
+    pool_parallel_for(&pool, 100, 200, 3, mark, visits);
+    for (uint64_t i = 0; i < 300; ++i) {
+        ASSERT_EQ(i >= 100 && i < 200 ? 1 : 0, visits[i]);
+    }
+
+    pool_fini(&pool);
+}
+
+int main() {
+    TEST_INIT;
+    TEST_ADD(check_thread_join);
+    TEST_ADD(check_mutex);
+    TEST_ADD(check_cond);
+    TEST_ADD(check_barrier);
+    TEST_ADD(check_pool_parallel_for);
+    return TEST_RUN;
+}